@@ -0,0 +1,180 @@
+﻿#include "bench.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+
+bool parse_bench_int(const char* option, const char* text, int& value, const int min)
+{
+	char* end;
+	const long parsed = std::strtol(text, &end, 10);
+	if (end == text || *end != '\0' || parsed < min || parsed > 1 << 30) {
+		std::cerr << "parse_bench_int() - Error: " << option << " expects a whole number of at least " << min << ", got '" << text << "'\n";
+		return false;
+	}
+	value = static_cast<int>(parsed);
+	return true;
+}
+
+bool parse_bench_uint64(const char* option, const char* text, uint64_t& value)
+{
+	char* end;
+	const unsigned long long parsed = std::strtoull(text, &end, 10);
+	if (end == text || *end != '\0' || *text == '-') {
+		std::cerr << "parse_bench_uint64() - Error: " << option << " expects a whole number, got '" << text << "'\n";
+		return false;
+	}
+	value = parsed;
+	return true;
+}
+
+bool parse_bench_options(const int argc, const char* const argv[], Bench_Options& options)
+{
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+
+		if (i + 1 >= argc) {
+			std::cerr << "parse_bench_options() - Error: unknown option or missing value: " << arg << '\n';
+			return false;
+		}
+		const char* value = argv[++i];
+
+		if (arg == "--filter") options.filter = value;
+		else if (arg == "--json") options.json_path = value;
+		else if (arg == "--min-time") options.min_time_ms = std::atof(value);
+		else if (arg == "--repetitions") options.repetitions = std::atoi(value);
+		else {
+			std::cerr << "parse_bench_options() - Error: unknown option " << arg << '\n';
+			return false;
+		}
+	}
+	return true;
+}
+
+std::string json_string(const std::string& text)
+{
+	std::string quoted = "\"";
+	for (const char c : text) {
+		if (c == '"' || c == '\\') quoted += '\\';
+		quoted += c;
+	}
+	return quoted + '"';
+}
+
+void write_json_context(std::ostream& out)
+{
+#if defined(__clang__)
+	const std::string compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+	const std::string compiler = "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+	const std::string compiler = "msvc " + std::to_string(_MSC_VER);
+#else
+	const std::string compiler = "unknown";
+#endif
+
+#ifdef NDEBUG
+	const bool optimized = true;
+#else
+	const bool optimized = false;
+#endif
+
+	out << "  \"context\": {\n";
+	out << "    \"compiler\": " << json_string(compiler) << ",\n";
+	out << "    \"ndebug\": " << (optimized ? "true" : "false") << ",\n";
+	out << "    \"hardware_threads\": " << std::thread::hardware_concurrency() << "\n";
+	out << "  },\n";
+}
+
+uint64_t peak_rss_bytes()
+{
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	// VmHWM follows reset_peak_rss(), ru_maxrss never goes down
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while (std::getline(status, line)) {
+		if (line.compare(0, 6, "VmHWM:") == 0) {
+			return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+		}
+	}
+
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(__APPLE__)
+	return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+	return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+bool reset_peak_rss()
+{
+#if defined(__linux__)
+	std::ofstream clear_refs("/proc/self/clear_refs");
+	clear_refs << "5";
+	clear_refs.flush();
+	return static_cast<bool>(clear_refs);
+#else
+	return false;
+#endif
+}
+
+void write_bench_json(std::ostream& out, const std::vector<Bench_Result>& results, const Perf_Counters* perf)
+{
+	out << "{\n";
+	write_json_context(out);
+	out << "  \"benchmarks\": [";
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const Bench_Result& r = results[i];
+		out << (i > 0 ? ",\n" : "\n");
+		out << "    {\"name\": " << json_string(r.name) << ", \"iterations\": " << r.iterations
+			<< std::setprecision(6) << ", \"ns_per_op\": " << r.ns_per_op << ", \"min_ns_per_op\": " << r.min_ns_per_op
+			<< ", \"ops_per_second\": " << r.ops_per_second;
+		if (perf) {
+			out << ", \"perf_per_op\": ";
+			write_perf_json(out, *perf, r.perf, static_cast<double>(std::max<uint64_t>(r.perf_ops, 1)));
+		}
+		out << "}";
+	}
+	out << "\n  ]\n}\n";
+}
+
+bool report_bench_results(const Bench_Options& options, const std::vector<Bench_Result>& results)
+{
+	for (const auto& r : results) {
+		std::cerr << std::left << std::setw(36) << r.name << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(12) << r.ns_per_op << " ns/op" << std::setw(14) << r.ops_per_second / 1e6 << " Mops/s\n";
+	}
+	std::cerr.unsetf(std::ios::floatfield);
+
+	if (options.json_path.empty()) {
+		write_bench_json(std::cout, results, options.perf);
+		return true;
+	}
+
+	std::ofstream file(options.json_path);
+	if (!file) {
+		std::cerr << "report_bench_results() - Error: Could not open " << options.json_path << " for writing\n";
+		return false;
+	}
+	write_bench_json(file, results, options.perf);
+	return true;
+}
@@ -0,0 +1,113 @@
+﻿// /*
+//  * bench.h
+//  */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "perf_counters.h"
+
+// Keeps the compiler from dropping a computation whose result nothing else reads
+template <typename T>
+inline void do_not_optimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static volatile const void* sink;
+	sink = &value;
+#endif
+}
+
+struct Bench_Options {
+	double min_time_ms  = 100.0;   // Per repetition
+	int repetitions     = 5;
+	std::string filter;            // Only benchmarks whose name contains this
+	std::string json_path;         // JSON goes to stdout when empty
+	Perf_Counters* perf = nullptr; // Read around the timed repetitions when set
+};
+
+struct Bench_Result {
+	std::string name;
+	uint64_t iterations   = 0; // Per repetition
+	double ns_per_op      = 0; // Median over the repetitions
+	double min_ns_per_op  = 0;
+	double ops_per_second = 0;
+	Perf_Sample perf;          // Over every timed repetition
+	uint64_t perf_ops     = 0; // Operations perf covers
+};
+
+// A whole number of at least min, or a 64-bit one for seeds, false (with a message on stderr) for anything else
+bool parse_bench_int(const char* option, const char* text, int& value, int min);
+bool parse_bench_uint64(const char* option, const char* text, uint64_t& value);
+
+// Parses --filter, --min-time, --repetitions and --json, false (with a message on stderr) for anything else
+bool parse_bench_options(int argc, const char* const argv[], Bench_Options& options);
+
+// Quoted and escaped for JSON
+std::string json_string(const std::string& text);
+
+// The "context" member shared by the benchmark JSON files: compiler, NDEBUG and hardware threads
+void write_json_context(std::ostream& out);
+
+// High-water mark of the resident set size in bytes, zero where the platform doesn't say
+uint64_t peak_rss_bytes();
+
+// Starts a new high-water mark at the current resident set size (Linux only), false when it can't
+bool reset_peak_rss();
+
+// Writes the results with a little context about the build and the machine, and hardware counters per operation
+// when perf is given
+void write_bench_json(std::ostream& out, const std::vector<Bench_Result>& results, const Perf_Counters* perf = nullptr);
+
+// Writes the JSON where the options say and a table to stderr
+bool report_bench_results(const Bench_Options& options, const std::vector<Bench_Result>& results);
+
+// Times body(i) for i in [0, iterations). The iteration count doubles until one run takes min_time, then that
+// many iterations are timed repetitions times. Filtered out benchmarks return false and leave results alone.
+template <typename Body>
+bool run_benchmark(const std::string& name, const Bench_Options& options, std::vector<Bench_Result>& results, Body body)
+{
+	if (!options.filter.empty() && name.find(options.filter) == std::string::npos) return false;
+
+	using Clock = std::chrono::steady_clock;
+
+	const auto time_ns = [&](const uint64_t iterations) {
+		const auto start = Clock::now();
+		for (uint64_t i = 0; i < iterations; i++) body(i);
+		return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+	};
+
+	// Calibration doubles as the warm-up
+	uint64_t iterations = 1;
+	while (time_ns(iterations) < options.min_time_ms * 1e6 && iterations < (uint64_t(1) << 40)) {
+		iterations *= 2;
+	}
+
+	Bench_Result result;
+	std::vector<double> per_op;
+
+	if (options.perf) options.perf->start();
+	for (int r = 0; r < std::max(options.repetitions, 1); r++) {
+		per_op.push_back(time_ns(iterations) / static_cast<double>(iterations));
+	}
+	if (options.perf) {
+		result.perf     = options.perf->stop();
+		result.perf_ops = iterations * per_op.size();
+	}
+	std::sort(per_op.begin(), per_op.end());
+
+	result.name           = name;
+	result.iterations     = iterations;
+	result.ns_per_op      = per_op[per_op.size() / 2];
+	result.min_ns_per_op  = per_op.front();
+	result.ops_per_second = 1e9 / result.ns_per_op;
+	results.push_back(result);
+	return true;
+}
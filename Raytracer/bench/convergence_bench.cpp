@@ -0,0 +1,369 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "builtin_scenes.h"
+#include "hdr_image.h"
+#include "renderer.h"
+#include "scene_file.h"
+#include "math/numeric.h"
+
+// Time-to-quality of sampling settings. One scene is rendered once at a high sample count as the reference, then
+// every candidate configuration renders it at growing sample counts (or, for adaptive sampling, shrinking error
+// thresholds). Each render's wall time and its error against the reference make one point of the candidate's
+// convergence curve, and the curves are compared at equal time: rays/s says nothing about whether a sampler
+// or integrator change makes the image better sooner.
+//
+// Errors are over the linear RGB channels: RMSE, and relMSE (squared error over the squared reference value plus
+// relmse_offset), which keeps bright pixels from drowning out the rest.
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr double relmse_offset = 1e-2;
+static constexpr double time_slack    = 1.05;
+
+struct Convergence_Scene {
+	std::string name;
+	std::function<Scene_Description()> build;
+};
+
+struct Candidate {
+	std::string name;
+	Pixel_Sampler sampler;
+	int roulette_depth;
+	bool adaptive; // Sweeps the adaptive error threshold, with the largest sample count as the cap
+};
+
+struct Convergence_Options {
+	Render_Settings settings;    // Size, depth, seed and threads, the candidates fill in the rest
+	std::string scene = "five_spheres";
+	std::string filter;          // Only candidates whose name contains this
+	std::string reference_path;  // Reference PFM, loaded when it exists and written when it doesn't
+	std::string json_path;       // JSON goes to stdout when empty
+	int reference_spp = 4096;
+	int max_spp       = 256;
+	int repetitions   = 1;       // Fastest of this many renders per point
+};
+
+struct Curve_Point {
+	int samples_per_pixel = 0; // Most samples a pixel may take
+	float adaptive_error  = 0.0f;
+	double mean_spp       = 0; // Samples the pixels actually took
+	double time_ms        = 0;
+	double rmse           = 0;
+	double relmse         = 0;
+};
+
+struct Convergence_Curve {
+	Candidate candidate;
+	std::vector<Curve_Point> points;
+};
+
+static double ms_since(const Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static bool parse_convergence_options(const int argc, const char* const argv[], Convergence_Options& options)
+{
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+
+		if (i + 1 >= argc) {
+			std::cerr << "parse_convergence_options() - Error: unknown option or missing value: " << arg << '\n';
+			return false;
+		}
+		const char* value = argv[++i];
+		bool ok           = true;
+		int threads       = 0;
+
+		if (arg == "--scene") options.scene = value;
+		else if (arg == "--candidate") options.filter = value;
+		else if (arg == "--reference") options.reference_path = value;
+		else if (arg == "--json") options.json_path = value;
+		else if (arg == "--reference-spp") ok = parse_bench_int(arg.c_str(), value, options.reference_spp, 1);
+		else if (arg == "--max-spp") ok = parse_bench_int(arg.c_str(), value, options.max_spp, 1);
+		else if (arg == "--repetitions") ok = parse_bench_int(arg.c_str(), value, options.repetitions, 1);
+		else if (arg == "--width") ok = parse_bench_int(arg.c_str(), value, options.settings.width, 1);
+		else if (arg == "--height") ok = parse_bench_int(arg.c_str(), value, options.settings.height, 1);
+		else if (arg == "--depth") ok = parse_bench_int(arg.c_str(), value, options.settings.max_depth, 1);
+		else if (arg == "--threads") {
+			ok                            = parse_bench_int(arg.c_str(), value, threads, 0);
+			options.settings.thread_count = static_cast<unsigned>(threads);
+		}
+		else if (arg == "--seed") ok = parse_bench_uint64(arg.c_str(), value, options.settings.seed);
+		else {
+			std::cerr << "parse_convergence_options() - Error: unknown option " << arg << '\n';
+			return false;
+		}
+		if (!ok) return false;
+	}
+	return true;
+}
+
+static void measure_error(const Hdr_Image& image, const Hdr_Image& reference, Curve_Point& point)
+{
+	double squared  = 0.0;
+	double relative = 0.0;
+	for (size_t i = 0; i < image.pixels.size(); i++) {
+		for (int c = 0; c < 3; c++) {
+			const double expected = reference.pixels[i].e[c];
+			const double error    = image.pixels[i].e[c] - expected;
+			squared += error * error;
+			relative += error * error / (expected * expected + relmse_offset);
+		}
+	}
+
+	const double channels = 3.0 * static_cast<double>(image.pixels.size());
+	point.rmse            = std::sqrt(squared / channels);
+	point.relmse          = relative / channels;
+}
+
+// The reference file is only trusted for its size, delete it after changing the scene or the depth
+static bool get_reference(const Scene& world, const Camera& camera, const Convergence_Options& options, Hdr_Image& reference)
+{
+	if (!options.reference_path.empty() && std::ifstream(options.reference_path) && load_pfm(options.reference_path, reference)) {
+		if (reference.width == options.settings.width && reference.height == options.settings.height) {
+			std::cerr << "Reference loaded from " << options.reference_path << '\n';
+			return true;
+		}
+		std::cerr << options.reference_path << " is " << reference.width << 'x' << reference.height << ", rendering a new reference\n";
+	}
+
+	// Its own seed, so its noise doesn't line up with the candidates'
+	Render_Settings settings   = options.settings;
+	settings.samples_per_pixel = options.reference_spp;
+	settings.seed              = hash_seed(options.settings.seed, 1);
+
+	Aov_Buffers framebuffer(settings.width, settings.height);
+	const auto start = Clock::now();
+	if (!Renderer(settings).render(world, camera, framebuffer)) return false;
+	std::cerr << "Reference: " << options.reference_spp << " spp in " << std::fixed << std::setprecision(1) << ms_since(start) / 1e3 << " s\n";
+	std::cerr.unsetf(std::ios::floatfield);
+
+	reference = std::move(framebuffer[Aov::Beauty]);
+	return options.reference_path.empty() || save_pfm(options.reference_path, reference);
+}
+
+static bool run_point(const Scene& world, const Camera& camera, const Hdr_Image& reference, const Render_Settings& settings,
+                      const int repetitions, Curve_Point& point)
+{
+	point.samples_per_pixel = settings.samples_per_pixel;
+	point.adaptive_error    = settings.adaptive_error;
+	point.time_ms           = infinity;
+
+	// Every repetition renders the same image, only the time can differ
+	Aov_Buffers framebuffer(settings.width, settings.height, {Aov::Sample_Count});
+	for (int r = 0; r < std::max(repetitions, 1); r++) {
+		const auto start = Clock::now();
+		if (!Renderer(settings).render(world, camera, framebuffer)) return false;
+		point.time_ms = std::min(point.time_ms, ms_since(start));
+	}
+
+	double samples = 0.0;
+	for (const Color3& count : framebuffer[Aov::Sample_Count].pixels) samples += count.r;
+	point.mean_spp = samples / static_cast<double>(settings.width * settings.height);
+
+	measure_error(framebuffer[Aov::Beauty], reference, point);
+	return true;
+}
+
+// Log-log interpolation of the curve's relMSE at a time, negative outside the times it covers. Renders of the same
+// sample count differ by a few percent between candidates, so times that close past either end take the end's error.
+static double relmse_at(const std::vector<Curve_Point>& points, const double time_ms)
+{
+	std::vector<Curve_Point> sorted = points;
+	std::sort(sorted.begin(), sorted.end(), [](const Curve_Point& a, const Curve_Point& b) { return a.time_ms < b.time_ms; });
+
+	if (sorted.empty()) return -1.0;
+	if (time_ms < sorted.front().time_ms) return time_ms * time_slack >= sorted.front().time_ms ? sorted.front().relmse : -1.0;
+	if (time_ms > sorted.back().time_ms) return time_ms <= sorted.back().time_ms * time_slack ? sorted.back().relmse : -1.0;
+
+	for (size_t i = 0; i + 1 < sorted.size(); i++) {
+		const Curve_Point& a = sorted[i];
+		const Curve_Point& b = sorted[i + 1];
+		if (time_ms < a.time_ms || time_ms > b.time_ms) continue;
+		if (b.time_ms <= a.time_ms) return a.relmse;
+
+		const double t = std::log(time_ms / a.time_ms) / std::log(b.time_ms / a.time_ms);
+		return std::exp(std::log(a.relmse) + t * (std::log(b.relmse) - std::log(a.relmse)));
+	}
+	return -1.0;
+}
+
+// Times of the first curve's points, the budgets every candidate is compared at
+static std::vector<double> equal_time_budgets(const std::vector<Convergence_Curve>& curves)
+{
+	std::vector<double> budgets;
+	if (curves.empty()) return budgets;
+	for (const auto& point : curves.front().points) budgets.push_back(point.time_ms);
+	return budgets;
+}
+
+static void write_convergence_json(std::ostream& out, const Convergence_Options& options, const std::vector<Convergence_Curve>& curves)
+{
+	const Render_Settings& settings = options.settings;
+
+	out << "{\n";
+	write_json_context(out);
+	out << "  \"settings\": {\"scene\": " << json_string(options.scene) << ", \"width\": " << settings.width
+		<< ", \"height\": " << settings.height << ", \"max_depth\": " << settings.max_depth << ", \"seed\": " << settings.seed
+		<< ", \"threads\": " << settings.thread_count << ", \"reference_spp\": " << options.reference_spp
+		<< ", \"max_spp\": " << options.max_spp << ", \"relmse_offset\": " << relmse_offset << "},\n";
+	out << "  \"candidates\": [";
+
+	for (size_t i = 0; i < curves.size(); i++) {
+		const Candidate& candidate = curves[i].candidate;
+
+		out << (i > 0 ? ",\n" : "\n");
+		out << "    {\"name\": " << json_string(candidate.name) << ", \"sampler\": \"" << pixel_sampler_name(candidate.sampler)
+			<< "\", \"roulette_depth\": " << candidate.roulette_depth << ", \"adaptive\": " << (candidate.adaptive ? "true" : "false")
+			<< ", \"curve\": [";
+
+		for (size_t p = 0; p < curves[i].points.size(); p++) {
+			const Curve_Point& point = curves[i].points[p];
+			out << (p > 0 ? ", " : "") << std::setprecision(6) << "{\"samples_per_pixel\": " << point.samples_per_pixel
+				<< ", \"adaptive_error\": " << point.adaptive_error << ", \"mean_spp\": " << point.mean_spp
+				<< ", \"time_ms\": " << point.time_ms << ", \"rmse\": " << point.rmse << ", \"relmse\": " << point.relmse << "}";
+		}
+		out << "]}";
+	}
+
+	// The same comparison the table on stderr shows, null where a curve doesn't reach the time
+	out << "\n  ],\n  \"equal_time_relmse\": [";
+	const std::vector<double> budgets = equal_time_budgets(curves);
+	for (size_t b = 0; b < budgets.size(); b++) {
+		out << (b > 0 ? ",\n" : "\n") << "    {\"time_ms\": " << budgets[b];
+		for (const auto& curve : curves) {
+			const double relmse = relmse_at(curve.points, budgets[b]);
+			out << ", " << json_string(curve.candidate.name) << ": ";
+			if (relmse < 0.0) out << "null";
+			else out << relmse;
+		}
+		out << "}";
+	}
+	out << "\n  ]\n}\n";
+}
+
+static void print_equal_time_table(const std::vector<Convergence_Curve>& curves)
+{
+	std::cerr << "\nrelMSE at equal time\n" << std::setw(12) << "ms";
+	for (const auto& curve : curves) std::cerr << std::setw(22) << curve.candidate.name;
+	std::cerr << '\n';
+
+	for (const double budget : equal_time_budgets(curves)) {
+		std::vector<double> errors;
+		double best = -1.0;
+		for (const auto& curve : curves) {
+			errors.push_back(relmse_at(curve.points, budget));
+			if (errors.back() >= 0.0 && (best < 0.0 || errors.back() < best)) best = errors.back();
+		}
+
+		std::cerr << std::fixed << std::setprecision(1) << std::setw(12) << budget << std::scientific << std::setprecision(3);
+		for (const double error : errors) {
+			if (error < 0.0) std::cerr << std::setw(22) << "-";
+			else std::cerr << std::setw(20) << error << (error == best ? " *" : "  ");
+		}
+		std::cerr << '\n';
+	}
+	std::cerr.unsetf(std::ios::floatfield);
+}
+
+int main(int argc, char* argv[])
+{
+	Convergence_Options options;
+	options.settings.width     = 160;
+	options.settings.height    = 106;
+	options.settings.max_depth = 12;
+	options.settings.seed      = 1;
+
+	if (!parse_convergence_options(argc, argv, options)) {
+		std::cerr << "Usage: " << argv[0] << " [--scene NAME] [--candidate TEXT] [--reference PATH] [--reference-spp N]"
+			" [--max-spp N] [--repetitions N] [--width N] [--height N] [--depth N] [--threads N] [--seed N] [--json PATH]\n";
+		return 1;
+	}
+
+	const std::vector<Convergence_Scene> scenes = {
+		{"five_spheres", []() { return default_scene(); }},
+		{"small_lights", []() { return small_lights_scene(); }},
+		{"glowing_spheres", []() { return glowing_spheres_scene(); }},
+		{"random_scene", []() { return random_scene(); }},
+	};
+
+	// The first candidate is the baseline whose times the others are compared at
+	const std::vector<Candidate> candidates = {
+		{"random", Pixel_Sampler::Random, 0, false},
+		{"stratified", Pixel_Sampler::Stratified, 0, false},
+		{"roulette", Pixel_Sampler::Random, 3, false},
+		{"stratified_roulette", Pixel_Sampler::Stratified, 3, false},
+		{"adaptive", Pixel_Sampler::Stratified, 3, true},
+	};
+
+	const auto scene = std::find_if(scenes.begin(), scenes.end(), [&](const Convergence_Scene& s) { return s.name == options.scene; });
+	if (scene == scenes.end()) {
+		std::cerr << "main() - Error: no scene named " << options.scene << '\n';
+		return 1;
+	}
+
+	seed_random(options.settings.seed);
+	const Scene_Description description = scene->build();
+	Scene world                         = build_scene(description);
+	world.build();
+	const Camera camera = build_camera(description.camera, static_cast<float>(options.settings.width) / static_cast<float>(options.settings.height));
+
+	Hdr_Image reference;
+	if (!get_reference(world, camera, options, reference)) return 1;
+
+	// Powers of two up to max_spp, adaptive candidates halve their error threshold as often
+	std::vector<int> sample_counts;
+	for (int spp = 1; spp <= options.max_spp; spp *= 2) sample_counts.push_back(spp);
+
+	std::vector<Convergence_Curve> curves;
+	for (const auto& candidate : candidates) {
+		if (!options.filter.empty() && candidate.name.find(options.filter) == std::string::npos) continue;
+
+		Convergence_Curve curve{candidate, {}};
+		Render_Settings settings      = options.settings;
+		settings.sampler              = candidate.sampler;
+		settings.roulette_depth       = candidate.roulette_depth;
+		settings.adaptive_min_samples = 8;
+
+		for (size_t step = 0; step < sample_counts.size(); step++) {
+			settings.samples_per_pixel = candidate.adaptive ? options.max_spp : sample_counts[step];
+			settings.adaptive_error    = candidate.adaptive ? 0.5f / static_cast<float>(1 << step) : 0.0f;
+
+			Curve_Point point;
+			if (!run_point(world, camera, reference, settings, options.repetitions, point)) return 1;
+			curve.points.push_back(point);
+
+			std::cerr << std::left << std::setw(22) << candidate.name << std::right << std::fixed << std::setprecision(1)
+				<< std::setw(8) << point.mean_spp << " spp" << std::setw(10) << point.time_ms << " ms" << std::scientific
+				<< std::setprecision(3) << std::setw(12) << point.rmse << " RMSE" << std::setw(12) << point.relmse << " relMSE\n";
+			std::cerr.unsetf(std::ios::floatfield);
+		}
+		curves.push_back(curve);
+	}
+
+	print_equal_time_table(curves);
+
+	if (options.json_path.empty()) {
+		write_convergence_json(std::cout, options, curves);
+		return 0;
+	}
+
+	std::ofstream file(options.json_path);
+	if (!file) {
+		std::cerr << "main() - Error: Could not open " << options.json_path << " for writing\n";
+		return 1;
+	}
+	write_convergence_json(file, options, curves);
+	return 0;
+}
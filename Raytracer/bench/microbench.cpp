@@ -0,0 +1,155 @@
+﻿#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "bench.h"
+#include "camera.h"
+#include "hittables.h"
+#include "material.h"
+#include "sphere.h"
+#include "sphere_set.h"
+#include "tonemap.h"
+#include "triangle_mesh.h"
+#include "math/numeric.h"
+#include "math/vec3.h"
+
+// Microbenchmarks for the hot paths. Inputs are generated up front from fixed seeds and cycled through, so
+// the numbers measure the kernels rather than the random number generator and repeat from run to run.
+
+static constexpr size_t input_count = 1024; // Power of two, inputs are picked with i & (input_count - 1)
+
+static size_t wrap(const uint64_t i) { return static_cast<size_t>(i & (input_count - 1)); }
+
+// Rays from a ring around the origin towards points near it, roughly half of them hit a unit sphere there
+static std::vector<Ray> make_rays()
+{
+	std::vector<Ray> rays;
+	for (size_t i = 0; i < input_count; i++) {
+		const Point3 origin = 5.0f * random_unit_vector();
+		const Point3 target = 2.0f * random_in_unit_sphere();
+		rays.emplace_back(origin, target - origin);
+	}
+	return rays;
+}
+
+static std::vector<Sphere_Desc> make_spheres(const int count)
+{
+	// Spread so that a fixed fraction of the volume is covered whatever the count
+	const float extent = 2.0f * std::cbrt(static_cast<float>(count));
+
+	std::vector<Sphere_Desc> spheres;
+	for (int i = 0; i < count; i++) {
+		spheres.push_back({extent * Vec3::random(-1.0f, 1.0f), 0.3f, 0});
+	}
+	return spheres;
+}
+
+int main(int argc, char* argv[])
+{
+	Bench_Options options;
+	if (!parse_bench_options(argc, argv, options)) {
+		std::cerr << "Usage: " << argv[0] << " [--filter TEXT] [--min-time MS] [--repetitions N] [--json PATH]\n";
+		return 1;
+	}
+
+	// Hardware counters around every benchmark, where the platform has them
+	Perf_Counters perf;
+	options.perf = &perf;
+	if (!perf.available()) std::cerr << "Hardware counters unavailable: " << perf.unavailable_reason() << '\n';
+
+	seed_random(1);
+	std::vector<Bench_Result> results;
+
+	const auto rays     = make_rays();
+	const auto diffuse  = make_shared<Lambertian>(Color3(0.5f, 0.5f, 0.5f));
+	const Sphere sphere = Sphere(Point3(0, 0, 0), 1.0f, diffuse);
+
+	run_benchmark("sphere_hit", options, results, [&](const uint64_t i) {
+		Hit_Record record;
+		do_not_optimize(sphere.hit(rays[wrap(i)], 0.001f, infinity, record));
+	});
+
+	// Linear lists against the BVH over the same spheres
+	for (const int count : {1, 10, 100, 1000}) {
+		Hittables list;
+		for (const auto& s : make_spheres(count)) list.add(make_shared<Sphere>(s.center, s.radius, diffuse));
+
+		run_benchmark("hittables_hit/" + std::to_string(count), options, results, [&](const uint64_t i) {
+			Hit_Record record;
+			do_not_optimize(list.hit(rays[wrap(i)], 0.001f, infinity, record));
+		});
+	}
+
+	for (const int count : {10, 1000, 100000}) {
+		const Sphere_Set set(make_spheres(count), {diffuse});
+
+		run_benchmark("sphere_set_hit/" + std::to_string(count), options, results, [&](const uint64_t i) {
+			Hit_Record record;
+			do_not_optimize(set.hit(rays[wrap(i)], 0.001f, infinity, record));
+		});
+	}
+
+	// The unit sphere again, tessellated into about 1k, 65k and 1M triangles
+	for (const int rings : {16, 128, 512}) {
+		const Triangle_Mesh mesh(make_sphere_mesh(Point3(0, 0, 0), 1.0f, rings, 2 * rings), {diffuse});
+
+		run_benchmark("triangle_mesh_hit/" + std::to_string(mesh.primitive_count()), options, results, [&](const uint64_t i) {
+			Hit_Record record;
+			do_not_optimize(mesh.hit(rays[wrap(i)], 0.001f, infinity, record));
+		});
+	}
+
+	seed_random(2);
+	run_benchmark("random_in_unit_sphere", options, results, [](uint64_t) { do_not_optimize(random_in_unit_sphere()); });
+	run_benchmark("random_unit_vector", options, results, [](uint64_t) { do_not_optimize(random_unit_vector()); });
+
+	// Scattering off the points where the rays above hit the unit sphere
+	std::vector<std::pair<Ray, Hit_Record>> hits;
+	for (const auto& ray : rays) {
+		Hit_Record record;
+		if (sphere.hit(ray, 0.001f, infinity, record)) hits.emplace_back(ray, record);
+	}
+	for (size_t i = 0, hit_count = hits.size(); hits.size() < input_count; i++) hits.push_back(hits[i % hit_count]);
+
+	const std::pair<const char*, shared_ptr<Material>> materials[] = {
+		{"lambertian", diffuse},
+		{"metal_smooth", make_shared<Metal>(Color3(0.8f, 0.6f, 0.4f), 0.0f)},
+		{"metal_rough", make_shared<Metal>(Color3(0.8f, 0.6f, 0.4f), 0.5f)},
+		{"dielectric", make_shared<Dielectric>(1.5f)},
+	};
+
+	for (const auto& material : materials) {
+		run_benchmark(std::string("scatter/") + material.first, options, results, [&](const uint64_t i) {
+			const auto& hit = hits[wrap(i)];
+			Color3 attenuation;
+			Ray scattered;
+			do_not_optimize(material.second->scatter(hit.first, hit.second, attenuation, scattered));
+			do_not_optimize(scattered);
+		});
+	}
+
+	const Camera camera(Point3(3, 1, 3), Point3(0, 0, 0), Vec3(0, 1, 0), 25.0f, 1.5f, 0.1f, 4.0f);
+	run_benchmark("camera_get_ray", options, results, [&](const uint64_t i) {
+		const float u = static_cast<float>(i & 1023) / 1023.0f;
+		const float v = static_cast<float>((i >> 10) & 1023) / 1023.0f;
+		do_not_optimize(camera.get_ray(u, v));
+	});
+
+	std::vector<Color3> colors;
+	for (size_t i = 0; i < input_count; i++) colors.push_back(1.5f * Color3::random());
+
+	run_benchmark("get_color", options, results, [&](const uint64_t i) { do_not_optimize(get_color(colors[wrap(i)], 1)); });
+
+	// Whole rows, which is how images are resolved
+	constexpr int row_width = 256;
+	std::vector<uint8_t> row(row_width * 3);
+	for (const auto op : {Tone_Operator::Gamma_2, Tone_Operator::Aces}) {
+		const Tone_Mapper tone_mapper(op);
+		run_benchmark(std::string("tone_map_row_256/") + tone_operator_name(op), options, results, [&](const uint64_t i) {
+			tone_mapper.resolve_bgr(&colors[(i * row_width) & (input_count - 1)], row.data(), row_width);
+			do_not_optimize(row[0]);
+		});
+	}
+
+	return report_bench_results(options, results) ? 0 : 1;
+}
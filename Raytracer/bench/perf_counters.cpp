@@ -0,0 +1,164 @@
+﻿#include "perf_counters.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ostream>
+
+#include "bench.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+const char* perf_event_name(const Perf_Event event)
+{
+	switch (event) {
+	case Perf_Event::Cycles: return "cycles";
+	case Perf_Event::Instructions: return "instructions";
+	case Perf_Event::Cache_References: return "cache_references";
+	case Perf_Event::Cache_Misses: return "cache_misses";
+	case Perf_Event::Branches: return "branches";
+	case Perf_Event::Branch_Misses: return "branch_misses";
+	default: return "unknown";
+	}
+}
+
+#if defined(__linux__)
+static uint64_t perf_config(const Perf_Event event)
+{
+	switch (event) {
+	case Perf_Event::Cycles: return PERF_COUNT_HW_CPU_CYCLES;
+	case Perf_Event::Instructions: return PERF_COUNT_HW_INSTRUCTIONS;
+	case Perf_Event::Cache_References: return PERF_COUNT_HW_CACHE_REFERENCES;
+	case Perf_Event::Cache_Misses: return PERF_COUNT_HW_CACHE_MISSES;
+	case Perf_Event::Branches: return PERF_COUNT_HW_BRANCH_INSTRUCTIONS;
+	case Perf_Event::Branch_Misses: return PERF_COUNT_HW_BRANCH_MISSES;
+	default: return 0;
+	}
+}
+
+// Disabled, -1 on failure with errno set
+static int open_counter(const Perf_Event event)
+{
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size           = sizeof(attr);
+	attr.type           = PERF_TYPE_HARDWARE;
+	attr.config         = perf_config(event);
+	attr.disabled       = 1;
+	attr.inherit        = 1; // Render workers are started after the counters are opened
+	attr.exclude_kernel = 1; // Allowed at the default perf_event_paranoid level
+	attr.exclude_hv     = 1;
+	attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	// Calling thread on any CPU, no group: inherited counters can't be read as a group
+	return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+#endif
+
+Perf_Counters::Perf_Counters()
+{
+	for (int& fd : fds) fd = -1;
+
+#if defined(__linux__)
+	// Only finds out which counters open, start() opens the ones measured
+	for (int i = 0; i < static_cast<int>(Perf_Event::Count); i++) {
+		const int fd = open_counter(static_cast<Perf_Event>(i));
+
+		if (fd >= 0) {
+			opened[i] = true;
+			open_count++;
+			close(fd);
+		}
+		else if (reason.empty()) {
+			reason = std::string("perf_event_open(") + perf_event_name(static_cast<Perf_Event>(i)) + "): " + strerror(errno);
+		}
+	}
+#else
+	reason = "hardware counters need Linux perf_event_open";
+#endif
+}
+
+Perf_Counters::~Perf_Counters()
+{
+	close_all();
+}
+
+void Perf_Counters::close_all()
+{
+#if defined(__linux__)
+	for (int& fd : fds) {
+		if (fd >= 0) close(fd);
+		fd = -1;
+	}
+#endif
+}
+
+void Perf_Counters::start()
+{
+#if defined(__linux__)
+	// Fresh counters rather than a reset: PERF_EVENT_IOC_RESET leaves the counts (and enabled and running times)
+	// folded in from exited child threads, so the workers of the previous measurement would be counted again
+	close_all();
+	for (int i = 0; i < static_cast<int>(Perf_Event::Count); i++) {
+		if (opened[i]) fds[i] = open_counter(static_cast<Perf_Event>(i));
+	}
+	for (const int fd : fds) {
+		if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+Perf_Sample Perf_Counters::stop()
+{
+	Perf_Sample sample;
+
+#if defined(__linux__)
+	for (const int fd : fds) {
+		if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	}
+
+	for (int i = 0; i < static_cast<int>(Perf_Event::Count); i++) {
+		if (fds[i] < 0) continue;
+
+		uint64_t data[3]; // Value, time enabled, time running
+		if (read(fds[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || data[2] == 0) continue;
+
+		// More counters than the PMU has were multiplexed, extrapolate to the whole enabled time
+		const double scale = static_cast<double>(data[1]) / static_cast<double>(data[2]);
+		sample.values[i]   = static_cast<uint64_t>(static_cast<double>(data[0]) * scale);
+		sample.valid[i]    = true;
+	}
+	close_all();
+#endif
+
+	return sample;
+}
+
+void write_perf_json(std::ostream& out, const Perf_Counters& counters, const Perf_Sample& sample, const double per)
+{
+	if (!counters.available()) {
+		out << "{\"available\": false, \"reason\": " << json_string(counters.unavailable_reason()) << "}";
+		return;
+	}
+
+	out << "{\"available\": true";
+	for (int i = 0; i < static_cast<int>(Perf_Event::Count); i++) {
+		if (!sample.valid[i]) continue;
+		out << ", \"" << perf_event_name(static_cast<Perf_Event>(i)) << "\": " << static_cast<double>(sample.values[i]) / per;
+	}
+
+	const auto ratio = [&](const char* name, const Perf_Event numerator, const Perf_Event denominator) {
+		if (sample.has(numerator) && sample.has(denominator) && sample[denominator] > 0) {
+			out << ", \"" << name << "\": " << static_cast<double>(sample[numerator]) / static_cast<double>(sample[denominator]);
+		}
+	};
+	ratio("ipc", Perf_Event::Instructions, Perf_Event::Cycles);
+	ratio("cache_miss_rate", Perf_Event::Cache_Misses, Perf_Event::Cache_References);
+	ratio("branch_miss_rate", Perf_Event::Branch_Misses, Perf_Event::Branches);
+	out << "}";
+}
@@ -0,0 +1,68 @@
+﻿// /*
+//  * perf_counters.h
+//  */
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+// Hardware performance counters through Linux perf_event_open. Every measurement opens its own counters, which
+// follow the thread calling start() and the threads it starts afterwards (their counts arrive once they exit, so
+// read after joining them), user space only. Counts of threads from earlier measurements can't leak in. Counters
+// the CPU, the kernel or a container won't give are left out, and everything reads as unavailable on other
+// platforms.
+
+enum class Perf_Event : int {
+	Cycles,
+	Instructions,
+	Cache_References, // Last level cache accesses
+	Cache_Misses,     // Last level cache misses
+	Branches,
+	Branch_Misses,
+	Count
+};
+
+const char* perf_event_name(Perf_Event event);
+
+struct Perf_Sample {
+	uint64_t values[static_cast<int>(Perf_Event::Count)] = {}; // Scaled up when the kernel multiplexed the counter
+	bool valid[static_cast<int>(Perf_Event::Count)]      = {};
+
+	bool has(const Perf_Event event) const { return valid[static_cast<int>(event)]; }
+	uint64_t operator[](const Perf_Event event) const { return values[static_cast<int>(event)]; }
+};
+
+class Perf_Counters {
+public:
+	Perf_Counters();
+	~Perf_Counters();
+
+	Perf_Counters(const Perf_Counters&)            = delete;
+	Perf_Counters& operator=(const Perf_Counters&) = delete;
+
+	// At least one counter opened
+	bool available() const { return open_count > 0; }
+
+	// Why counters are missing (the first failure), empty when all of them opened
+	const std::string& unavailable_reason() const { return reason; }
+
+	// Opens and enables a fresh set of the counters that opened at construction
+	void start();
+
+	// Disables the counters, reads and closes them
+	Perf_Sample stop();
+
+private:
+	void close_all();
+
+	int fds[static_cast<int>(Perf_Event::Count)];
+	bool opened[static_cast<int>(Perf_Event::Count)] = {}; // Worked at construction, the only ones start() opens
+	int open_count = 0;
+	std::string reason;
+};
+
+// One JSON object with every valid counter divided by per (operations, rays, ...), IPC and miss rates where their
+// inputs are valid, {"available": false, "reason": ...} when no counter is
+void write_perf_json(std::ostream& out, const Perf_Counters& counters, const Perf_Sample& sample, double per = 1.0);
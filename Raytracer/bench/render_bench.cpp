@@ -0,0 +1,224 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "perf_counters.h"
+#include "builtin_scenes.h"
+#include "renderer.h"
+#include "scene_file.h"
+#include "math/numeric.h"
+
+// End-to-end renders of fixed reference scenes at a fixed resolution, sample count and seed. Every scene is
+// built from scratch and rendered once, the timings cover what a user waits for: building the scene (BVH
+// included), the first finished tile and the whole frame.
+
+using Clock = std::chrono::steady_clock;
+
+struct Reference_Scene {
+	std::string name;
+	std::function<Scene_Description()> build;
+};
+
+struct Render_Bench_Options {
+	Render_Settings settings;
+	std::string filter;    // Only scenes whose name contains this
+	std::string json_path; // JSON goes to stdout when empty
+};
+
+struct Render_Bench_Result {
+	std::string name;
+	size_t spheres                = 0;
+	size_t instances              = 0;
+	double build_ms               = 0; // Description, materials, BVH and scene ids
+	double time_to_first_pixel_ms = 0; // From the start of the build to the first finished tile
+	double render_ms              = 0;
+	double wall_ms                = 0; // Build and render
+	Render_Stats stats;
+	uint64_t peak_rss             = 0;
+	Perf_Sample build_perf;
+	Perf_Sample render_perf;
+};
+
+static double ms_since(const Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static bool parse_render_bench_options(const int argc, const char* const argv[], Render_Bench_Options& options)
+{
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+
+		if (i + 1 >= argc) {
+			std::cerr << "parse_render_bench_options() - Error: unknown option or missing value: " << arg << '\n';
+			return false;
+		}
+		const char* value = argv[++i];
+		bool ok           = true;
+		int threads       = 0;
+
+		if (arg == "--scene") options.filter = value;
+		else if (arg == "--json") options.json_path = value;
+		else if (arg == "--width") ok = parse_bench_int(arg.c_str(), value, options.settings.width, 1);
+		else if (arg == "--height") ok = parse_bench_int(arg.c_str(), value, options.settings.height, 1);
+		else if (arg == "--spp") ok = parse_bench_int(arg.c_str(), value, options.settings.samples_per_pixel, 1);
+		else if (arg == "--depth") ok = parse_bench_int(arg.c_str(), value, options.settings.max_depth, 1);
+		else if (arg == "--threads") {
+			ok                            = parse_bench_int(arg.c_str(), value, threads, 0);
+			options.settings.thread_count = static_cast<unsigned>(threads);
+		}
+		else if (arg == "--seed") ok = parse_bench_uint64(arg.c_str(), value, options.settings.seed);
+		else {
+			std::cerr << "parse_render_bench_options() - Error: unknown option " << arg << '\n';
+			return false;
+		}
+		if (!ok) return false;
+	}
+	return true;
+}
+
+// False when the renderer gives up, result is then incomplete
+static bool run_scene(const Reference_Scene& reference, const Render_Settings& settings, Perf_Counters& perf, Render_Bench_Result& result)
+{
+	result.name = reference.name;
+
+	const auto start = Clock::now();
+	perf.start();
+
+	// The random placement is part of the fixed scene, so it gets the same seed every run
+	seed_random(settings.seed);
+	const Scene_Description description = reference.build();
+	result.spheres   = description.spheres.size();
+	result.instances = description.instances.size();
+
+	Scene world = build_scene(description);
+	world.build();
+	const Camera camera = build_camera(description.camera, static_cast<float>(settings.width) / static_cast<float>(settings.height));
+	result.build_perf = perf.stop();
+	result.build_ms   = ms_since(start);
+
+	std::atomic<bool> first_tile(true);
+	Aov_Buffers framebuffer(settings.width, settings.height);
+
+	const auto render_start = Clock::now();
+	perf.start();
+	const bool rendered = Renderer(settings).render(world, camera, framebuffer, [&](const Tile&, Aov_Buffers&) {
+		if (first_tile.exchange(false)) {
+			result.time_to_first_pixel_ms = ms_since(start);
+		}
+	}, &result.stats);
+	result.render_perf = perf.stop(); // The workers have been joined, their counts are in
+	result.render_ms   = ms_since(render_start);
+	result.wall_ms     = ms_since(start);
+
+	result.peak_rss = peak_rss_bytes();
+	return rendered;
+}
+
+static void write_render_bench_json(std::ostream& out, const Render_Settings& settings, const bool peak_rss_per_scene,
+                                    const Perf_Counters& perf, const std::vector<Render_Bench_Result>& results)
+{
+	out << "{\n";
+	write_json_context(out);
+	out << "  \"settings\": {\"width\": " << settings.width << ", \"height\": " << settings.height
+		<< ", \"samples_per_pixel\": " << settings.samples_per_pixel << ", \"max_depth\": " << settings.max_depth
+		<< ", \"seed\": " << settings.seed << ", \"threads\": " << settings.thread_count
+		<< ", \"peak_rss_per_scene\": " << (peak_rss_per_scene ? "true" : "false") << "},\n";
+	out << "  \"scenes\": [";
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const Render_Bench_Result& r = results[i];
+		const double render_s        = r.render_ms / 1e3;
+
+		out << (i > 0 ? ",\n" : "\n");
+		out << "    {\"name\": " << json_string(r.name) << ", \"spheres\": " << r.spheres << ", \"instances\": " << r.instances << std::setprecision(6)
+			<< ", \"wall_ms\": " << r.wall_ms << ", \"build_ms\": " << r.build_ms << ", \"render_ms\": " << r.render_ms
+			<< ", \"time_to_first_pixel_ms\": " << r.time_to_first_pixel_ms
+			<< ", \"primary_rays\": " << r.stats.primary_rays << ", \"secondary_rays\": " << r.stats.secondary_rays
+			<< ", \"primary_rays_per_second\": " << r.stats.primary_rays / render_s
+			<< ", \"secondary_rays_per_second\": " << r.stats.secondary_rays / render_s
+			<< ", \"peak_rss_bytes\": " << r.peak_rss << ", \"ray_stats\": ";
+		write_ray_stats_json(out, r.stats.rays);
+
+		// Build counters are totals, render counters per traced ray
+		out << ", \"perf_build\": ";
+		write_perf_json(out, perf, r.build_perf);
+		out << ", \"perf_render_per_ray\": ";
+		write_perf_json(out, perf, r.render_perf, static_cast<double>(std::max<uint64_t>(r.stats.primary_rays + r.stats.secondary_rays, 1)));
+		out << "}";
+	}
+	out << "\n  ]\n}\n";
+}
+
+int main(int argc, char* argv[])
+{
+	Render_Bench_Options options;
+	options.settings.width             = 300;
+	options.settings.height            = 200;
+	options.settings.samples_per_pixel = 16;
+	options.settings.seed              = 1;
+
+	if (!parse_render_bench_options(argc, argv, options)) {
+		std::cerr << "Usage: " << argv[0] << " [--scene TEXT] [--width N] [--height N] [--spp N] [--depth N] [--threads N]"
+			" [--seed N] [--json PATH]\n";
+		return 1;
+	}
+
+	const std::vector<Reference_Scene> scenes = {
+		{"five_spheres", []() { return default_scene(); }},
+		{"random_scene", []() { return random_scene(); }},
+		{"random_instanced", []() { return random_scene(11, true); }},
+		{"random_10k", []() { return random_scene(50); }},
+		{"random_100k", []() { return random_scene(158); }},
+		{"random_instanced_100k", []() { return random_scene(158, true); }},
+		{"random_1m", []() { return random_scene(500); }},
+	};
+
+	// Only probes the counters, each start() opens fresh ones that follow the workers started after it
+	Perf_Counters perf;
+	if (!perf.available()) std::cerr << "Hardware counters unavailable: " << perf.unavailable_reason() << '\n';
+
+	// Scenes run from small to large, so without a per-scene reset the peak is still right for the largest so far
+	bool peak_rss_per_scene = true;
+	std::vector<Render_Bench_Result> results;
+
+	for (const auto& scene : scenes) {
+		if (!options.filter.empty() && scene.name.find(options.filter) == std::string::npos) continue;
+
+		peak_rss_per_scene = reset_peak_rss() && peak_rss_per_scene;
+		Render_Bench_Result result;
+		if (!run_scene(scene, options.settings, perf, result)) {
+			std::cerr << "main() - Error: " << scene.name << " failed to render\n";
+			return 1;
+		}
+		results.push_back(result);
+
+		const Render_Bench_Result& r = results.back();
+		std::cerr << std::left << std::setw(24) << r.name << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(10) << r.wall_ms << " ms" << std::setw(10) << r.time_to_first_pixel_ms << " ms to first pixel"
+			<< std::setw(10) << (r.stats.primary_rays + r.stats.secondary_rays) / (r.render_ms * 1e3) << " Mrays/s"
+			<< std::setw(10) << r.peak_rss / 1e6 << " MB peak\n";
+		std::cerr.unsetf(std::ios::floatfield);
+	}
+
+	if (options.json_path.empty()) {
+		write_render_bench_json(std::cout, options.settings, peak_rss_per_scene, perf, results);
+		return 0;
+	}
+
+	std::ofstream file(options.json_path);
+	if (!file) {
+		std::cerr << "main() - Error: Could not open " << options.json_path << " for writing\n";
+		return 1;
+	}
+	write_render_bench_json(file, options.settings, peak_rss_per_scene, perf, results);
+	return 0;
+}
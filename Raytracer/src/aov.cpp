@@ -0,0 +1,162 @@
+﻿#include "aov.h"
+
+#include <cmath>
+
+
+const char* aov_name(const Aov aov)
+{
+	switch (aov) {
+	case Aov::Beauty: return "beauty";
+	case Aov::Albedo: return "albedo";
+	case Aov::Normal: return "normal";
+	case Aov::Depth: return "depth";
+	case Aov::Material_Id: return "material_id";
+	case Aov::Object_Id: return "object_id";
+	case Aov::Sample_Count: return "sample_count";
+	case Aov::Traversal_Cost: return "traversal_cost";
+	case Aov::Render_Time: return "render_time";
+	case Aov::Variance: return "variance";
+	default: return "unknown";
+	}
+}
+
+void Aov_Pixel::add(const Aov_Sample& sample)
+{
+	if (samples == 0) {
+		material_id = sample.material_id;
+		object_id   = sample.object_id;
+	}
+
+	beauty += sample.beauty;
+	beauty_squares += sample.beauty * sample.beauty;
+	albedo += sample.albedo;
+	normal += sample.normal;
+	traversal_cost += sample.traversal_cost;
+	samples++;
+
+	if (!std::isinf(sample.depth)) {
+		depth_sum += sample.depth;
+		depth_hits++;
+	}
+}
+
+Aov_Buffers::Aov_Buffers(const int width, const int height, const std::vector<Aov>& aovs)
+	: width(width), height(height), buffers(static_cast<int>(Aov::Count))
+{
+	enable(Aov::Beauty);
+	for (const Aov aov : aovs) {
+		enable(aov);
+	}
+}
+
+void Aov_Buffers::enable(const Aov aov)
+{
+	if (!enabled(aov)) {
+		buffers[static_cast<int>(aov)] = Hdr_Image(width, height);
+	}
+}
+
+std::vector<Aov> Aov_Buffers::enabled_aovs() const
+{
+	std::vector<Aov> aovs;
+	for (int i = 0; i < static_cast<int>(Aov::Count); i++) {
+		if (enabled(static_cast<Aov>(i))) aovs.push_back(static_cast<Aov>(i));
+	}
+	return aovs;
+}
+
+static Color3 splat(const float value)
+{
+	return {value, value, value};
+}
+
+void Aov_Buffers::store(const int x, const int y, const Aov_Pixel& pixel)
+{
+	const float scale = pixel.samples > 0 ? 1.0f / static_cast<float>(pixel.samples) : 0.0f;
+
+	(*this)[Aov::Beauty].at(x, y) = scale * pixel.beauty;
+
+	if (enabled(Aov::Albedo)) (*this)[Aov::Albedo].at(x, y) = scale * pixel.albedo;
+	if (enabled(Aov::Normal)) (*this)[Aov::Normal].at(x, y) = scale * pixel.normal;
+	if (enabled(Aov::Depth)) {
+		(*this)[Aov::Depth].at(x, y) = splat(pixel.depth_hits > 0 ? pixel.depth_sum / static_cast<float>(pixel.depth_hits) : infinity);
+	}
+	if (enabled(Aov::Material_Id)) (*this)[Aov::Material_Id].at(x, y) = splat(static_cast<float>(pixel.material_id));
+	if (enabled(Aov::Object_Id)) (*this)[Aov::Object_Id].at(x, y) = splat(static_cast<float>(pixel.object_id));
+	if (enabled(Aov::Sample_Count)) (*this)[Aov::Sample_Count].at(x, y) = splat(static_cast<float>(pixel.samples));
+	if (enabled(Aov::Traversal_Cost)) (*this)[Aov::Traversal_Cost].at(x, y) = splat(static_cast<float>(pixel.traversal_cost));
+	if (enabled(Aov::Render_Time)) (*this)[Aov::Render_Time].at(x, y) = splat(static_cast<float>(pixel.render_time_ns));
+	if (enabled(Aov::Variance)) {
+		// Unbiased estimate, zero below two samples
+		const float n        = static_cast<float>(pixel.samples);
+		const Color3 mean    = scale * pixel.beauty;
+		const Color3 squares = pixel.beauty_squares - n * mean * mean;
+		const float bessel   = pixel.samples > 1 ? 1.0f / (n - 1.0f) : 0.0f;
+		(*this)[Aov::Variance].at(x, y) = Color3(fmaxf(squares.r, 0.0f), fmaxf(squares.g, 0.0f), fmaxf(squares.b, 0.0f)) * bessel;
+	}
+}
+
+void Aov_Buffers::store_tile(const int x0, const int y0, const Aov_Buffers& tile)
+{
+	for (int i = 0; i < static_cast<int>(Aov::Count); i++) {
+		const Aov aov = static_cast<Aov>(i);
+		if (!enabled(aov) || !tile.enabled(aov)) continue;
+
+		for (int y = 0; y < tile.height; y++) {
+			for (int x = 0; x < tile.width; x++) {
+				(*this)[aov].at(x0 + x, y0 + y) = tile[aov].at(x, y);
+			}
+		}
+	}
+}
+
+bool Aov_Buffers::save(const std::string& prefix) const
+{
+	bool ok = true;
+	for (int i = 1; i < static_cast<int>(Aov::Count); i++) {
+		const Aov aov = static_cast<Aov>(i);
+		if (enabled(aov)) {
+			ok = save_pfm(prefix + "." + aov_name(aov) + ".pfm", (*this)[aov]) && ok;
+		}
+	}
+	return ok;
+}
+
+bool Aov_Buffers::save_exr(const std::string& path) const
+{
+	std::vector<Exr_Channel> channels;
+
+	for (int i = 0; i < static_cast<int>(Aov::Count); i++) {
+		const Aov aov = static_cast<Aov>(i);
+		if (!enabled(aov)) continue;
+
+		const Hdr_Image* image = &(*this)[aov];
+		const std::string name = aov_name(aov);
+
+		switch (aov) {
+		case Aov::Beauty:
+			channels.push_back({"R", image, 0});
+			channels.push_back({"G", image, 1});
+			channels.push_back({"B", image, 2});
+			break;
+		case Aov::Albedo:
+			channels.push_back({name + ".R", image, 0});
+			channels.push_back({name + ".G", image, 1});
+			channels.push_back({name + ".B", image, 2});
+			break;
+		case Aov::Normal:
+			channels.push_back({name + ".X", image, 0});
+			channels.push_back({name + ".Y", image, 1});
+			channels.push_back({name + ".Z", image, 2});
+			break;
+		case Aov::Depth:
+			channels.push_back({"Z", image, 0});
+			break;
+		default:
+			channels.push_back({name, image, 0});
+			break;
+		}
+	}
+
+	return ::save_exr(path, channels);
+}
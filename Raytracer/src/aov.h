@@ -0,0 +1,93 @@
+﻿// /*
+//  * aov.h
+//  */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "hdr_image.h"
+#include "math/numeric.h"
+#include "math/vec3.h"
+
+// Arbitrary output variables, every one of them filled from the same camera samples as the beauty pass
+enum class Aov : int {
+	Beauty,
+	Albedo,         // First-hit reflectance, background radiance for escaped rays
+	Normal,         // First-hit world space normal, facing the camera
+	Depth,          // Distance to the first hit, infinity for escaped rays
+	Material_Id,    // Id of the first-hit material, -1 for escaped rays, see max_exact_aov_id
+	Object_Id,      // Id of the first-hit object, -1 for escaped rays, see max_exact_aov_id
+	Sample_Count,   // Camera samples taken for the pixel
+	Traversal_Cost, // BVH nodes visited plus primitives tested by the pixel's paths
+	Render_Time,    // Nanoseconds spent tracing the pixel's samples
+	Variance,       // Per-channel sample variance of the beauty samples, divide by the sample count for the mean's
+	Count
+};
+
+// Id channels are floats like every other buffer and only hold integers up to 2^24 exactly, renders of scenes
+// with more objects or materials than this can't be rendered with id AOVs
+constexpr int max_exact_aov_id = 1 << 24;
+
+const char* aov_name(Aov aov);
+
+// What one camera sample reports
+struct Aov_Sample {
+	Color3 beauty = Color3(0.0f, 0.0f, 0.0f);
+	Color3 albedo = Color3(0.0f, 0.0f, 0.0f);
+	Vec3 normal   = Vec3(0.0f, 0.0f, 0.0f);
+	float depth   = infinity;
+	int material_id = -1;
+	int object_id   = -1;
+	uint64_t traversal_cost = 0;
+};
+
+// Running totals of a pixel's samples
+struct Aov_Pixel {
+	void add(const Aov_Sample& sample);
+
+	Color3 beauty         = Color3(0.0f, 0.0f, 0.0f);
+	Color3 beauty_squares = Color3(0.0f, 0.0f, 0.0f);
+	Color3 albedo         = Color3(0.0f, 0.0f, 0.0f);
+	Vec3 normal           = Vec3(0.0f, 0.0f, 0.0f);
+	float depth_sum = 0.0f;
+	int depth_hits  = 0;
+	int material_id = -1; // Ids can't be averaged, the first sample's are kept
+	int object_id   = -1;
+	int samples     = 0;
+	uint64_t traversal_cost = 0;
+	uint64_t render_time_ns = 0; // Set by the renderer for the whole pixel, add() leaves it alone
+};
+
+// Registry of the output buffers of one render, row 0 at the top. Beauty is always enabled.
+class Aov_Buffers {
+public:
+	Aov_Buffers(int width, int height, const std::vector<Aov>& aovs = {});
+
+	void enable(Aov aov);
+	bool enabled(Aov aov) const { return !buffers[static_cast<int>(aov)].pixels.empty(); }
+	std::vector<Aov> enabled_aovs() const;
+
+	Hdr_Image& operator[](Aov aov) { return buffers[static_cast<int>(aov)]; }
+	const Hdr_Image& operator[](Aov aov) const { return buffers[static_cast<int>(aov)]; }
+
+	// Resolves a pixel's totals into every enabled buffer, scalars are written to all three channels
+	void store(int x, int y, const Aov_Pixel& pixel);
+
+	// Copies a tile rendered with the same AOVs into place, its top-left corner at (x0, y0)
+	void store_tile(int x0, int y0, const Aov_Buffers& tile);
+
+	// Writes every enabled AOV except beauty to <prefix>.<name>.pfm
+	bool save(const std::string& prefix) const;
+
+	// Writes every enabled AOV into one multi-channel EXR: beauty as R, G, B, depth as Z, the rest as <name> layers
+	bool save_exr(const std::string& path) const;
+
+	int width;
+	int height;
+
+private:
+	std::vector<Hdr_Image> buffers; // Indexed by Aov, empty when disabled
+};
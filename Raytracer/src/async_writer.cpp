@@ -0,0 +1,33 @@
+﻿#include "async_writer.h"
+
+#include "trace.h"
+
+
+Async_Writer::Async_Writer(const size_t capacity) : queue(capacity)
+{
+	thread = std::thread([this]() {
+		std::function<void()> job;
+		while (queue.pop(job)) {
+			trace_name_thread("io");
+			job();
+		}
+	});
+}
+
+void Async_Writer::submit(std::function<void()> job)
+{
+	if (finished) {
+		job();
+		return;
+	}
+	queue.push(std::move(job));
+}
+
+void Async_Writer::finish()
+{
+	if (finished) return;
+
+	finished = true;
+	queue.close();
+	thread.join();
+}
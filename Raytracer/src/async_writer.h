@@ -0,0 +1,79 @@
+﻿// /*
+//  * async_writer.h
+//  */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Fixed capacity FIFO shared between threads: push() waits while it is full, pop() while it is empty
+template <typename T>
+class Bounded_Queue {
+public:
+	explicit Bounded_Queue(const size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+	void push(T item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		not_full.wait(lock, [this]() { return items.size() < capacity; });
+		items.push_back(std::move(item));
+		not_empty.notify_one();
+	}
+
+	// False once the queue has been closed and drained
+	bool pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		not_empty.wait(lock, [this]() { return !items.empty() || closed; });
+		if (items.empty()) return false;
+
+		item = std::move(items.front());
+		items.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+
+	// Wakes the consumer for good once everything queued so far has been popped
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		not_empty.notify_all();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable not_empty;
+	std::condition_variable not_full;
+	std::deque<T> items;
+	size_t capacity;
+	bool closed = false;
+};
+
+// Background I/O thread: image encoding (gamma, quantization, row flips) and file writes are queued here so
+// render workers don't do them. The queue is bounded on purpose: once capacity jobs are waiting, a disk that
+// can't keep up blocks submit(), and with it the render worker that finished the tile, rather than letting
+// finished tiles and frames pile up in memory. Workers only wait on the disk when it is that far behind.
+class Async_Writer {
+public:
+	explicit Async_Writer(size_t capacity = 16);
+	~Async_Writer() { finish(); }
+
+	Async_Writer(const Async_Writer&)            = delete;
+	Async_Writer& operator=(const Async_Writer&) = delete;
+
+	// Queues a job, blocking only while capacity jobs are already waiting
+	void submit(std::function<void()> job);
+
+	// Runs every queued job and stops the thread, later submissions run on the caller's thread
+	void finish();
+
+private:
+	Bounded_Queue<std::function<void()>> queue;
+	std::thread thread;
+	bool finished = false;
+};
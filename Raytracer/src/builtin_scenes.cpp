@@ -0,0 +1,145 @@
+﻿#include "builtin_scenes.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "math/numeric.h"
+
+
+// Appends a material and returns its index
+static uint32_t add_material(Scene_Description& scene, const Material_Type type, const Color3& color, const float parameter = 0.0f)
+{
+	scene.materials.push_back({type, color, parameter});
+	return static_cast<uint32_t>(scene.materials.size() - 1);
+}
+
+static void add_sphere(Scene_Description& scene, const Point3& center, const float radius, const uint32_t material)
+{
+	scene.spheres.push_back({center, radius, material});
+}
+
+// The five spheres shared by the default and small lights scenes
+static void add_five_spheres(Scene_Description& scene)
+{
+	const auto ground = add_material(scene, Material_Type::Lambertian, Color3(0.8f, 0.8f, 0.0f));
+	const auto center = add_material(scene, Material_Type::Lambertian, Color3(0.1f, 0.2f, 0.5f));
+	const auto left   = add_material(scene, Material_Type::Dielectric, Color3(), 1.5f);
+	const auto right  = add_material(scene, Material_Type::Metal, Color3(0.8f, 0.6f, 0.4f), 0.5f);
+
+	add_sphere(scene, Point3( 0.0f, -100.5f, -1.0f), 100.0f, ground);
+	add_sphere(scene, Point3( 0.0f,    0.0f, -1.0f),   0.5f, center);
+	add_sphere(scene, Point3(-1.0f,    0.0f, -1.0f),   0.5f, left);
+	add_sphere(scene, Point3(-1.0f,    0.0f, -1.0f), -0.45f, left);
+	add_sphere(scene, Point3( 1.0f,    0.0f, -1.0f),   0.5f, right);
+}
+
+// Ground sphere, three large spheres and the camera of Ray Tracing in One Weekend's final scene. The ground grows
+// with the field so every small sphere still has ground below it.
+static void add_book_set(Scene_Description& scene, const float ground_radius)
+{
+	scene.camera.look_from  = Point3(13, 2, 3);
+	scene.camera.look_at    = Point3(0, 0, 0);
+	scene.camera.fov        = 20.0f;
+	scene.camera.aperture   = 0.1f;
+	scene.camera.focus_dist = 10.0f;
+
+	add_sphere(scene, Point3(0, -ground_radius, 0), ground_radius, add_material(scene, Material_Type::Lambertian, Color3(0.5f, 0.5f, 0.5f)));
+	add_sphere(scene, Point3(0, 1, 0), 1.0f, add_material(scene, Material_Type::Dielectric, Color3(), 1.5f));
+	add_sphere(scene, Point3(-4, 1, 0), 1.0f, add_material(scene, Material_Type::Lambertian, Color3(0.4f, 0.2f, 0.1f)));
+	add_sphere(scene, Point3(4, 1, 0), 1.0f, add_material(scene, Material_Type::Metal, Color3(0.7f, 0.6f, 0.5f), 0.0f));
+}
+
+// Height of the top of a ground sphere touching y = 0 at the origin
+static float ground_height(const float ground_radius, const float x, const float z)
+{
+	return std::sqrt(ground_radius * ground_radius - x * x - z * z) - ground_radius;
+}
+
+Scene_Description default_scene()
+{
+	Scene_Description scene;
+	add_five_spheres(scene);
+	return scene;
+}
+
+Scene_Description random_scene(const int half_grid, const bool instanced)
+{
+	Scene_Description scene;
+	if (instanced) scene.geometries.push_back({Geometry_Type::Sphere, std::string()});
+
+	const float ground_radius = std::max(1000.0f, 2.0f * static_cast<float>(half_grid));
+	add_book_set(scene, ground_radius);
+
+	const size_t cells = 4 * static_cast<size_t>(half_grid) * static_cast<size_t>(half_grid);
+	scene.spheres.reserve(scene.spheres.size() + (instanced ? 0 : cells));
+	scene.instances.reserve(instanced ? cells : 0);
+	scene.materials.reserve(scene.materials.size() + cells);
+
+	for (int a = -half_grid; a < half_grid; a++) {
+		for (int b = -half_grid; b < half_grid; b++) {
+			const auto choose_mat = random_float();
+			Point3 center(static_cast<float>(a) + 0.9f * random_float(), 0.2f, static_cast<float>(b) + 0.9f * random_float());
+
+			if ((center - Point3(4, 0.2f, 0)).length() <= 0.9f) {
+				continue;
+			}
+			center.y += ground_height(ground_radius, center.x, center.z);
+
+			uint32_t material;
+			if (choose_mat < 0.8f) {
+				// diffuse
+				material = add_material(scene, Material_Type::Lambertian, Color3::random() * Color3::random());
+			}
+			else if (choose_mat < 0.95f) {
+				// metal
+				const auto albedo = Color3::random(0.5f, 1.0f);
+				material          = add_material(scene, Material_Type::Metal, albedo, random_float(0.0f, 0.5f));
+			}
+			else {
+				// glass
+				material = add_material(scene, Material_Type::Dielectric, Color3(), 1.5f);
+			}
+			if (instanced) {
+				scene.instances.push_back({0, material, Transform::translate(center) * Transform::scale(Vec3(0.2f, 0.2f, 0.2f))});
+			}
+			else {
+				add_sphere(scene, center, 0.2f, material);
+			}
+		}
+	}
+
+	return scene;
+}
+
+Scene_Description small_lights_scene()
+{
+	Scene_Description scene;
+	scene.environment = Environment_Type::None;
+	add_five_spheres(scene);
+
+	const auto warm_light = add_material(scene, Material_Type::Light, Color3(400.0f, 300.0f, 200.0f));
+	const auto cool_light = add_material(scene, Material_Type::Light, Color3(100.0f, 150.0f, 300.0f));
+	add_sphere(scene, Point3( 0.5f, 1.5f,  0.5f), 0.05f, warm_light);
+	add_sphere(scene, Point3(-1.5f, 1.0f, -2.0f), 0.08f, cool_light);
+
+	return scene;
+}
+
+Scene_Description glowing_spheres_scene()
+{
+	Scene_Description scene;
+	scene.environment = Environment_Type::None;
+	add_book_set(scene, 1000.0f);
+
+	for (int a = -50; a < 50; a++) {
+		for (int b = -50; b < 50; b++) {
+			Point3 center(static_cast<float>(a) + 0.9f * random_float(), 0.1f, static_cast<float>(b) + 0.9f * random_float());
+			center.y += ground_height(1000.0f, center.x, center.z);
+
+			const auto emit = random_float(2.0f, 20.0f) * Color3::random(0.2f, 1.0f);
+			add_sphere(scene, center, 0.1f, add_material(scene, Material_Type::Light, emit));
+		}
+	}
+
+	return scene;
+}
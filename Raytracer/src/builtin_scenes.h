@@ -0,0 +1,25 @@
+﻿// /*
+//  * builtin_scenes.h
+//  */
+
+#pragma once
+
+#include "scene_file.h"
+
+// Scenes built into the renderer and the benchmarks, as descriptions so they come with a camera and go through
+// build_scene() like scene files do. Random placement uses the calling thread's generator, seed it first for a
+// repeatable scene.
+
+// The original five spheres under the gradient sky
+Scene_Description default_scene();
+
+// The final scene of Ray Tracing in One Weekend: three large spheres and a (2 * half_grid)^2 grid of small random
+// ones on a ground sphere, 11 gives the book's ~480 spheres, 50, 158 and 500 about 10k, 100k and 1M. Instanced
+// places the small spheres as instances of one unit sphere instead, the same scene through an Instance_Set.
+Scene_Description random_scene(int half_grid = 11, bool instanced = false);
+
+// The default scene under a night sky, lit only by a few small, bright spheres
+Scene_Description small_lights_scene();
+
+// Light sampling benchmark: a 100x100 field of small glowing spheres in the style of random_scene()
+Scene_Description glowing_spheres_scene();
@@ -0,0 +1,174 @@
+﻿#include "bvh.h"
+
+#include <algorithm>
+
+#include "trace.h"
+
+
+struct Build_Item {
+	Aabb bounds;
+	Point3 centroid;
+	uint32_t primitive;
+};
+
+static constexpr uint32_t max_leaf_size = 4;
+
+// Past this depth splits go to the median, which bounds the tree depth for traversal stacks
+static constexpr int max_sah_depth = 40;
+
+// Relative cost of visiting a node against testing one primitive
+static constexpr float traversal_cost = 1.0f;
+
+static uint32_t build_recursive(std::vector<Build_Item>& items, const size_t begin, const size_t end,
+                                std::vector<Bvh_Node>& nodes, std::vector<uint32_t>& order, const int depth)
+{
+	const auto node_index = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+
+	Aabb bounds;
+	Aabb centroids;
+	for (size_t i = begin; i < end; i++) {
+		bounds.expand(items[i].bounds);
+		centroids.expand(items[i].centroid);
+	}
+
+	const auto make_leaf = [&]() {
+		nodes[node_index].bounds = bounds;
+		nodes[node_index].offset = static_cast<uint32_t>(order.size());
+		nodes[node_index].count  = static_cast<uint32_t>(end - begin);
+		for (size_t i = begin; i < end; i++) order.push_back(items[i].primitive);
+		return node_index;
+	};
+
+	const size_t count = end - begin;
+	if (count == 1) return make_leaf();
+
+	// Binned split minimizing the surface area heuristic
+	constexpr int bin_count = 12;
+	const Vec3 extent       = centroids.diagonal();
+	const float leaf_cost   = static_cast<float>(count);
+	float best_cost         = infinity;
+	int best_axis           = -1;
+	int best_bin            = 0;
+
+	for (int axis = 0; axis < 3 && depth < max_sah_depth; axis++) {
+		if (extent[axis] <= 0.0f) continue;
+
+		Aabb bins[bin_count];
+		uint32_t bin_counts[bin_count] = {};
+		for (size_t i = begin; i < end; i++) {
+			const float offset = (items[i].centroid[axis] - centroids.min[axis]) / extent[axis];
+			const int b        = std::min(static_cast<int>(offset * bin_count), bin_count - 1);
+			bins[b].expand(items[i].bounds);
+			bin_counts[b]++;
+		}
+
+		// Sweep from the right to get the area and count above every split plane
+		float above_area[bin_count];
+		uint32_t above_count[bin_count];
+		Aabb above;
+		uint32_t n = 0;
+		for (int b = bin_count - 1; b > 0; b--) {
+			above.expand(bins[b]);
+			n += bin_counts[b];
+			above_area[b]  = above.surface_area();
+			above_count[b] = n;
+		}
+
+		Aabb below;
+		n = 0;
+		for (int split = 1; split < bin_count; split++) {
+			below.expand(bins[split - 1]);
+			n += bin_counts[split - 1];
+			if (n == 0 || above_count[split] == 0) continue;
+
+			const float cost = below.surface_area() * static_cast<float>(n)
+				+ above_area[split] * static_cast<float>(above_count[split]);
+			if (cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_bin  = split;
+			}
+		}
+	}
+
+	const float area = bounds.surface_area();
+	best_cost        = area > 0.0f ? traversal_cost + best_cost / area : infinity;
+
+	if (count <= max_leaf_size && best_cost >= leaf_cost) return make_leaf();
+
+	size_t mid = begin + count / 2;
+
+	if (best_axis >= 0) {
+		const auto first_above = std::partition(items.begin() + begin, items.begin() + end, [&](const Build_Item& item) {
+			const float offset = (item.centroid[best_axis] - centroids.min[best_axis]) / extent[best_axis];
+			return std::min(static_cast<int>(offset * bin_count), bin_count - 1) < best_bin;
+		});
+		mid = static_cast<size_t>(first_above - items.begin());
+	}
+	else {
+		// Coincident centroids (or a very deep tree), fall back to an even split
+		const int axis = centroids.largest_axis();
+		std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end,
+		                 [axis](const Build_Item& a, const Build_Item& b) { return a.centroid[axis] < b.centroid[axis]; });
+	}
+
+	build_recursive(items, begin, mid, nodes, order, depth + 1);
+	const uint32_t second = build_recursive(items, mid, end, nodes, order, depth + 1);
+
+	nodes[node_index].bounds = bounds;
+	nodes[node_index].offset = second;
+	nodes[node_index].count  = 0;
+	return node_index;
+}
+
+void build_bvh(const std::vector<Aabb>& bounds, std::vector<Bvh_Node>& nodes, std::vector<uint32_t>& order)
+{
+	Trace_Span span("build bvh", "scene");
+	nodes.clear();
+	order.clear();
+	if (bounds.empty()) return;
+
+	std::vector<Build_Item> items(bounds.size());
+	for (uint32_t i = 0; i < bounds.size(); i++) {
+		items[i].bounds    = bounds[i];
+		items[i].centroid  = bounds[i].center();
+		items[i].primitive = i;
+	}
+
+	nodes.reserve(2 * items.size() - 1);
+	order.reserve(items.size());
+	build_recursive(items, 0, items.size(), nodes, order, 0);
+}
+
+bool valid_bvh(const Bvh_Node* nodes, const uint32_t node_count, const uint32_t primitive_count)
+{
+	if (node_count == 0) return true;
+
+	// A depth first layout visits the nodes in index order, which also rules out cycles and shared subtrees
+	std::vector<uint32_t> stack = {0};
+	std::vector<int> depths     = {1};
+	uint32_t next               = 0;
+
+	while (!stack.empty()) {
+		const uint32_t index = stack.back();
+		const int depth      = depths.back();
+		stack.pop_back();
+		depths.pop_back();
+
+		if (index != next++ || index >= node_count || depth > bvh_max_depth) return false;
+
+		const Bvh_Node& node = nodes[index];
+		if (node.count > 0) {
+			if (static_cast<uint64_t>(node.offset) + node.count > primitive_count) return false;
+			continue;
+		}
+		if (node.offset <= index + 1 || node.offset >= node_count) return false;
+
+		stack.push_back(node.offset);
+		stack.push_back(index + 1);
+		depths.push_back(depth + 1);
+		depths.push_back(depth + 1);
+	}
+	return next == node_count;
+}
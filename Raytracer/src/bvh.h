@@ -0,0 +1,115 @@
+﻿// /*
+//  * bvh.h
+//  */
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "ray.h"
+#include "math/aabb.h"
+
+// Node of a flattened bounding volume hierarchy, 32 bytes and free of pointers so a built tree can be written
+// to disk and mapped back as is. The first child of an interior node is stored right after it.
+struct Bvh_Node {
+	Aabb bounds;
+	uint32_t offset = 0; // Second child for interior nodes, first primitive for leaves
+	uint32_t count  = 0; // Primitives in a leaf, zero for interior nodes
+};
+
+// Built trees are never deeper than this, so traversal stacks can have a fixed size
+static constexpr int bvh_max_depth = 96;
+
+// Binned SAH build over primitive bounds. order receives the primitive indices in leaf order, so that leaves
+// reference contiguous ranges once the primitives are stored in that order.
+void build_bvh(const std::vector<Aabb>& bounds, std::vector<Bvh_Node>& nodes, std::vector<uint32_t>& order);
+
+// Whether a tree read from outside can be walked safely: laid out depth first like build_bvh() does it, with
+// every child and leaf range in bounds and no deeper than bvh_max_depth. Linear in the node count.
+bool valid_bvh(const Bvh_Node* nodes, uint32_t node_count, uint32_t primitive_count);
+
+// Slab test, t_entry receives the distance where the ray enters the box. Rounding can put t_near past t_far for
+// a ray through a face, edge or corner of the box, which would skip the primitives touching it and open cracks
+// between triangles. Widening t_far by 2 gamma(3) keeps the test conservative (Ize, "Robust BVH Ray Traversal",
+// JCGT 2013).
+inline bool hit_bounds(const Aabb& box, const Point3& origin, const Vec3& inv_direction, const float t_min,
+                       const float t_max, float& t_entry)
+{
+	constexpr float far_scale = 1.0f + 3.0f * std::numeric_limits<float>::epsilon();
+
+	float t0 = t_min;
+	float t1 = t_max;
+
+	for (int axis = 0; axis < 3; axis++) {
+		float t_near = (box.min[axis] - origin[axis]) * inv_direction[axis];
+		float t_far  = (box.max[axis] - origin[axis]) * inv_direction[axis];
+		if (t_near > t_far) std::swap(t_near, t_far);
+		t_far *= far_scale;
+
+		t0 = t_near > t0 ? t_near : t0;
+		t1 = t_far < t1 ? t_far : t1;
+		if (t1 < t0) return false;
+	}
+
+	t_entry = t0;
+	return true;
+}
+
+// Boxes and nodes one walk_bvh() call tested, for the statistics and the traversal cost AOV
+struct Bvh_Walk_Counts {
+	uint64_t nodes = 0; // Visited, the root counts as visited when the ray misses it
+	uint64_t boxes = 0;
+};
+
+// Front to back traversal for the closest hit. leaf(first, count) tests a leaf's primitives and lowers t_max
+// whenever it finds a closer one, the nodes beyond it are skipped from then on.
+template <typename Leaf>
+inline void walk_bvh(const Bvh_Node* nodes, const Point3& origin, const Vec3& inv_direction, const float t_min,
+                     const float& t_max, Bvh_Walk_Counts& counts, Leaf&& leaf)
+{
+	float entry;
+	counts.boxes++;
+	if (!hit_bounds(nodes[0].bounds, origin, inv_direction, t_min, t_max, entry)) {
+		counts.nodes++;
+		return;
+	}
+
+	uint32_t stack[bvh_max_depth];
+	int stack_size      = 0;
+	uint32_t node_index = 0;
+
+	while (true) {
+		const Bvh_Node& node = nodes[node_index];
+		counts.nodes++;
+
+		if (node.count > 0) {
+			leaf(node.offset, node.count);
+		}
+		else {
+			// Visit the nearer child first, the farther one waits on the stack
+			const uint32_t first  = node_index + 1;
+			const uint32_t second = node.offset;
+			float entry_first, entry_second;
+			counts.boxes += 2;
+			const bool hit_first  = hit_bounds(nodes[first].bounds, origin, inv_direction, t_min, t_max, entry_first);
+			const bool hit_second = hit_bounds(nodes[second].bounds, origin, inv_direction, t_min, t_max, entry_second);
+
+			if (hit_first && hit_second) {
+				const bool first_nearer = entry_first <= entry_second;
+				stack[stack_size++]     = first_nearer ? second : first;
+				node_index              = first_nearer ? first : second;
+				continue;
+			}
+			if (hit_first || hit_second) {
+				node_index = hit_first ? first : second;
+				continue;
+			}
+		}
+
+		if (stack_size == 0) break;
+		node_index = stack[--stack_size];
+	}
+}
@@ -0,0 +1,119 @@
+﻿#include "denoiser.h"
+
+#include "parallel.h"
+
+
+// Albedo below this is treated as black when dividing it out
+static constexpr float min_albedo = 0.01f;
+
+static Color3 demodulate(const Color3& color, const Color3& albedo)
+{
+	return {
+		color.r / fmaxf(albedo.r, min_albedo),
+		color.g / fmaxf(albedo.g, min_albedo),
+		color.b / fmaxf(albedo.b, min_albedo)
+	};
+}
+
+static Color3 remodulate(const Color3& illumination, const Color3& albedo)
+{
+	return {
+		illumination.r * fmaxf(albedo.r, min_albedo),
+		illumination.g * fmaxf(albedo.g, min_albedo),
+		illumination.b * fmaxf(albedo.b, min_albedo)
+	};
+}
+
+static float depth_weight(const float depth_p, const float depth_q, const float sigma, const int step)
+{
+	const bool escaped_p = std::isinf(depth_p);
+	const bool escaped_q = std::isinf(depth_q);
+	if (escaped_p || escaped_q) return escaped_p == escaped_q ? 1.0f : 0.0f;
+
+	return expf(-fabs(depth_p - depth_q) / (sigma * depth_p * static_cast<float>(step) + 1e-6f));
+}
+
+// One pass of the 5x5 B3-spline kernel with holes of size step
+static void atrous_pass(const Hdr_Image& input, const Hdr_Image& albedo, const Hdr_Image& normal, const Hdr_Image& depth,
+                        Hdr_Image& output,
+                        const int step, const float sigma_color, const Denoise_Settings& settings)
+{
+	static constexpr float kernel[5] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+
+	const int width  = input.width;
+	const int height = input.height;
+
+	const float inv_color2  = 1.0f / (sigma_color * sigma_color);
+	const float inv_normal  = 1.0f / settings.sigma_normal;
+	const float inv_albedo2 = 1.0f / (settings.sigma_albedo * settings.sigma_albedo);
+
+	parallel_for(height, [&](const int y) {
+		for (int x = 0; x < width; x++) {
+			const size_t p        = static_cast<size_t>(y) * width + x;
+			const Color3 color_p  = input.pixels[p];
+			const Vec3 normal_p   = normal.pixels[p];
+			const Color3 albedo_p = albedo.pixels[p];
+			const float depth_p   = depth.pixels[p].r;
+
+			Color3 sum(0.0f, 0.0f, 0.0f);
+			float weight_sum = 0.0f;
+
+			for (int j = -2; j <= 2; j++) {
+				const int qy = y + j * step;
+				if (qy < 0 || qy >= height) continue;
+
+				for (int i = -2; i <= 2; i++) {
+					const int qx = x + i * step;
+					if (qx < 0 || qx >= width) continue;
+
+					const size_t q = static_cast<size_t>(qy) * width + qx;
+
+					const Vec3 color_diff  = input.pixels[q] - color_p;
+					const Vec3 albedo_diff = albedo.pixels[q] - albedo_p;
+					const float normal_cos = dot(normal_p, normal.pixels[q]);
+
+					const float weight = kernel[i + 2] * kernel[j + 2]
+						* expf(-color_diff.length2() * inv_color2
+						       - fmaxf(0.0f, 1.0f - normal_cos) * inv_normal
+						       - albedo_diff.length2() * inv_albedo2)
+						* depth_weight(depth_p, depth.pixels[q].r, settings.sigma_depth, step);
+
+					sum += weight * input.pixels[q];
+					weight_sum += weight;
+				}
+			}
+
+			// The center tap always has a weight of one times its kernel value
+			output.pixels[p] = sum / weight_sum;
+		}
+	}, settings.threads);
+}
+
+void denoise(const Hdr_Image& color, const Hdr_Image& albedo, const Hdr_Image& normal, const Hdr_Image& depth,
+             Hdr_Image& output, const Denoise_Settings& settings)
+{
+	Hdr_Image current(color.width, color.height);
+	Hdr_Image next(color.width, color.height);
+
+	// Normals are averaged over the pixel's samples, bring them back to unit length
+	Hdr_Image unit_normal = normal;
+	for (auto& n : unit_normal.pixels) {
+		if (n.length2() > 0.0f) n = unit_vector(n);
+	}
+
+	for (size_t i = 0; i < color.pixels.size(); i++) {
+		current.pixels[i] = demodulate(color.pixels[i], albedo.pixels[i]);
+	}
+
+	float sigma_color = settings.sigma_color;
+	for (int iteration = 0; iteration < settings.iterations; iteration++) {
+		atrous_pass(current, albedo, unit_normal, depth, next, 1 << iteration, sigma_color, settings);
+		std::swap(current, next);
+		sigma_color *= 0.5f;
+	}
+
+	output = Hdr_Image(color.width, color.height);
+	for (size_t i = 0; i < color.pixels.size(); i++) {
+		output.pixels[i] = remodulate(current.pixels[i], albedo.pixels[i]);
+	}
+}
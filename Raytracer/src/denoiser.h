@@ -0,0 +1,23 @@
+﻿// /*
+//  * denoiser.h
+//  */
+
+#pragma once
+
+#include "hdr_image.h"
+#include "math/numeric.h"
+
+struct Denoise_Settings {
+	int iterations     = 5;     // Filter passes, the footprint doubles every pass
+	float sigma_color  = 0.6f;  // Illumination difference tolerated, tightened every pass
+	float sigma_normal = 0.1f;  // 1 - cos of the normal angle tolerated
+	float sigma_depth  = 0.05f; // Relative depth difference tolerated per pixel of distance
+	float sigma_albedo = 0.1f;
+	unsigned threads   = 0;     // Zero for every hardware thread
+};
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) guided by the first-hit albedo, normal and depth
+// AOVs (depth in the red channel). Albedo is divided out before filtering and multiplied back afterwards so
+// texture detail survives.
+void denoise(const Hdr_Image& color, const Hdr_Image& albedo, const Hdr_Image& normal, const Hdr_Image& depth,
+             Hdr_Image& output, const Denoise_Settings& settings = Denoise_Settings());
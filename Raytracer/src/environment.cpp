@@ -0,0 +1,72 @@
+﻿#include "environment.h"
+
+
+Environment_Map::Environment_Map(Hdr_Image map, const float strength, const float rotation_degrees)
+	: intensity(strength), image(std::move(map)), rotation(degrees_to_radians(rotation_degrees))
+{
+	// Rows near the poles cover less solid angle, weight them by sin(theta)
+	std::vector<float> weights(static_cast<size_t>(image.width) * image.height);
+
+	for (int y = 0; y < image.height; y++) {
+		const float sin_theta = sinf(pi * (static_cast<float>(y) + 0.5f) / static_cast<float>(image.height));
+		for (int x = 0; x < image.width; x++) {
+			weights[static_cast<size_t>(y) * image.width + x] = luminance(image.at(x, y)) * sin_theta;
+		}
+	}
+
+	distribution = Distribution_2D(weights, image.width, image.height);
+}
+
+void Environment_Map::direction_to_uv(const Vec3& direction, float& u, float& v) const
+{
+	const Vec3 d    = unit_vector(direction);
+	const float phi = atan2f(d.z, d.x) + rotation;
+
+	u = phi / (2.0f * pi);
+	u -= floorf(u);
+	v = acosf(clamp(d.y, -1.0f, 1.0f)) / pi;
+}
+
+Vec3 Environment_Map::uv_to_direction(const float u, const float v) const
+{
+	const float phi   = u * 2.0f * pi - rotation;
+	const float theta = v * pi;
+	return {sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)};
+}
+
+// Nearest texel, so lookups match the piecewise-constant density exactly
+Color3 Environment_Map::radiance(const Vec3& direction) const
+{
+	float u, v;
+	direction_to_uv(direction, u, v);
+
+	const int x = clamp(static_cast<int>(u * static_cast<float>(image.width)), 0, image.width - 1);
+	const int y = clamp(static_cast<int>(v * static_cast<float>(image.height)), 0, image.height - 1);
+	return intensity * image.at(x, y);
+}
+
+bool Environment_Map::sample(Vec3& direction, float& pdf) const
+{
+	float u, v;
+	const float pdf_uv = distribution.sample_continuous(random_float(), random_float(), u, v);
+	if (pdf_uv <= 0.0f) return false;
+
+	const float sin_theta = sinf(v * pi);
+	if (sin_theta <= 0.0f) return false;
+
+	// Jacobian of the lat-long mapping: d(omega) = 2 pi^2 sin(theta) du dv
+	direction = uv_to_direction(u, v);
+	pdf       = pdf_uv / (2.0f * pi * pi * sin_theta);
+	return true;
+}
+
+float Environment_Map::pdf(const Vec3& direction) const
+{
+	float u, v;
+	direction_to_uv(direction, u, v);
+
+	const float sin_theta = sinf(v * pi);
+	if (sin_theta <= 0.0f) return 0.0f;
+
+	return distribution.pdf(u, v) / (2.0f * pi * pi * sin_theta);
+}
@@ -0,0 +1,61 @@
+﻿// /*
+//  * environment.h
+//  */
+
+#pragma once
+
+#include "hdr_image.h"
+#include "math/distribution.h"
+#include "math/numeric.h"
+#include "math/vec3.h"
+
+// Radiance arriving from infinitely far away, seen by every ray that escapes the scene
+class Environment {
+public:
+	virtual ~Environment() = default;
+
+	virtual Color3 radiance(const Vec3& direction) const = 0;
+
+	// Picks a direction for explicit lighting, false if the environment isn't importance sampled
+	virtual bool sample(Vec3& direction, float& pdf) const { return false; }
+
+	// Solid angle density of sample(), zero when it isn't sampled
+	virtual float pdf(const Vec3& direction) const { return 0.0f; }
+};
+
+// The original white to blue gradient, too smooth to be worth sampling explicitly
+class Gradient_Sky : public Environment {
+public:
+	explicit Gradient_Sky(const float strength = 1.0f) : intensity(strength) {}
+
+	Color3 radiance(const Vec3& direction) const override
+	{
+		// Convert (-1 to 1) y part of the unit direction to (0 to 1)
+		const auto t = 0.5f * (get_normal(direction).y + 1.0f);
+
+		// When y is min, set color to white, when at max set to blue
+		return intensity * ((1.0f - t) * Color3(1.0f, 1.0f, 1.0f) + t * Color3(0.4f, 0.6f, 1.0f));
+	}
+
+	float intensity;
+};
+
+// Latitude-longitude HDR map, +y up, importance sampled by luminance
+class Environment_Map : public Environment {
+public:
+	explicit Environment_Map(Hdr_Image map, float strength = 1.0f, float rotation_degrees = 0.0f);
+
+	Color3 radiance(const Vec3& direction) const override;
+	bool sample(Vec3& direction, float& pdf) const override;
+	float pdf(const Vec3& direction) const override;
+
+	float intensity;
+
+private:
+	void direction_to_uv(const Vec3& direction, float& u, float& v) const;
+	Vec3 uv_to_direction(float u, float v) const;
+
+	Hdr_Image image;
+	Distribution_2D distribution;
+	float rotation; // Radians around +y
+};
@@ -0,0 +1,402 @@
+﻿#include "hdr_image.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "trace.h"
+
+
+static bool has_extension(const std::string& path, const char* extension)
+{
+	const auto n = strlen(extension);
+	if (path.size() < n) return false;
+
+	for (size_t i = 0; i < n; i++) {
+		if (tolower(path[path.size() - n + i]) != extension[i]) return false;
+	}
+	return true;
+}
+
+bool load_pfm(const std::string& path, Hdr_Image& image)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << "load_pfm() - Error: Could not open " << path << '\n';
+		return false;
+	}
+
+	std::string magic;
+	int width, height;
+	float scale;
+	file >> magic >> width >> height >> scale;
+	file.get(); // Single whitespace before the raster
+
+	if (!file || (magic != "PF" && magic != "Pf") || width <= 0 || height <= 0) {
+		std::cerr << "load_pfm() - Error: " << path << " is not a valid PFM file\n";
+		return false;
+	}
+
+	const int channels       = magic == "PF" ? 3 : 1;
+	const bool little_endian = scale < 0.0f;
+	const bool swap_bytes    = little_endian != host_is_little_endian();
+
+	std::vector<float> raster(static_cast<size_t>(width) * height * channels);
+	file.read(reinterpret_cast<char*>(raster.data()), static_cast<std::streamsize>(raster.size() * sizeof(float)));
+	if (!file) {
+		std::cerr << "load_pfm() - Error: " << path << " is truncated\n";
+		return false;
+	}
+
+	if (swap_bytes) {
+		for (auto& value : raster) {
+			uint8_t bytes[4];
+			memcpy(bytes, &value, 4);
+			std::swap(bytes[0], bytes[3]);
+			std::swap(bytes[1], bytes[2]);
+			memcpy(&value, bytes, 4);
+		}
+	}
+
+	// PFM rows run bottom to top
+	image = Hdr_Image(width, height);
+	for (int y = 0; y < height; y++) {
+		const float* row = &raster[static_cast<size_t>(height - 1 - y) * width * channels];
+		for (int x = 0; x < width; x++) {
+			const float* px = row + x * channels;
+			image.at(x, y)  = channels == 3 ? Color3(px[0], px[1], px[2]) : Color3(px[0], px[0], px[0]);
+		}
+	}
+	return true;
+}
+
+static Color3 rgbe_to_color(const uint8_t* rgbe)
+{
+	if (rgbe[3] == 0) return {0.0f, 0.0f, 0.0f};
+
+	const float f = ldexpf(1.0f, static_cast<int>(rgbe[3]) - (128 + 8));
+	return {(rgbe[0] + 0.5f) * f, (rgbe[1] + 0.5f) * f, (rgbe[2] + 0.5f) * f};
+}
+
+// One scanline of RGBE pixels, either flat or in the adaptive run-length encoding (one run per component)
+static bool read_rgbe_scanline(std::istream& file, const int width, std::vector<uint8_t>& scanline)
+{
+	uint8_t header[4];
+	if (!file.read(reinterpret_cast<char*>(header), 4)) return false;
+
+	const bool run_length_encoded = header[0] == 2 && header[1] == 2 && (header[2] & 0x80) == 0 && width >= 8 && width < 32768;
+
+	if (!run_length_encoded) {
+		memcpy(scanline.data(), header, 4);
+		return static_cast<bool>(file.read(reinterpret_cast<char*>(scanline.data() + 4), static_cast<std::streamsize>(width) * 4 - 4));
+	}
+
+	if (((header[2] << 8) | header[3]) != width) return false;
+
+	for (int component = 0; component < 4; component++) {
+		int x = 0;
+		while (x < width) {
+			const int count = file.get();
+			if (count == EOF) return false;
+
+			if (count > 128) {
+				const int run   = count - 128;
+				const int value = file.get();
+				if (value == EOF || x + run > width) return false;
+				for (int i = 0; i < run; i++) scanline[(x++) * 4 + component] = static_cast<uint8_t>(value);
+			}
+			else {
+				if (count == 0 || x + count > width) return false;
+				for (int i = 0; i < count; i++) {
+					const int value = file.get();
+					if (value == EOF) return false;
+					scanline[(x++) * 4 + component] = static_cast<uint8_t>(value);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+bool load_rgbe(const std::string& path, Hdr_Image& image)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << "load_rgbe() - Error: Could not open " << path << '\n';
+		return false;
+	}
+
+	std::string line;
+	std::getline(file, line);
+	if (line.compare(0, 2, "#?") != 0) {
+		std::cerr << "load_rgbe() - Error: " << path << " is not a Radiance HDR file\n";
+		return false;
+	}
+
+	// Header variables end at the first empty line
+	while (std::getline(file, line) && !line.empty()) {
+		if (line.compare(0, 7, "FORMAT=") == 0 && line != "FORMAT=32-bit_rle_rgbe") {
+			std::cerr << "load_rgbe() - Error: " << path << " uses unsupported " << line << '\n';
+			return false;
+		}
+	}
+
+	// Only the standard top-to-bottom, left-to-right orientation is supported
+	int width, height;
+	std::getline(file, line);
+	if (sscanf(line.c_str(), "-Y %d +X %d", &height, &width) != 2 || width <= 0 || height <= 0) {
+		std::cerr << "load_rgbe() - Error: " << path << " has an unsupported resolution line\n";
+		return false;
+	}
+
+	image = Hdr_Image(width, height);
+	std::vector<uint8_t> scanline(static_cast<size_t>(width) * 4);
+
+	for (int y = 0; y < height; y++) {
+		if (!read_rgbe_scanline(file, width, scanline)) {
+			std::cerr << "load_rgbe() - Error: " << path << " is truncated or corrupt\n";
+			return false;
+		}
+		for (int x = 0; x < width; x++) {
+			image.at(x, y) = rgbe_to_color(&scanline[x * 4]);
+		}
+	}
+	return true;
+}
+
+bool load_hdr_image(const std::string& path, Hdr_Image& image)
+{
+	if (has_extension(path, ".pfm")) return load_pfm(path, image);
+	if (has_extension(path, ".hdr") || has_extension(path, ".pic")) return load_rgbe(path, image);
+
+	std::cerr << "load_hdr_image() - Error: Unknown HDR image format " << path << '\n';
+	return false;
+}
+
+// BMP and EXR are little-endian throughout
+static void put_u32(std::string& out, const uint32_t value)
+{
+	for (int i = 0; i < 4; i++) out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+static void put_u64(std::string& out, const uint64_t value)
+{
+	for (int i = 0; i < 8; i++) out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+static void put_u16(std::string& out, const uint16_t value)
+{
+	out.push_back(static_cast<char>(value & 0xff));
+	out.push_back(static_cast<char>(value >> 8));
+}
+
+bool save_bitmap(const std::string& path, const bitmap_image& bitmap)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << "save_bitmap() - Error: Could not open " << path << '\n';
+		return false;
+	}
+
+	const uint32_t row_size   = bitmap.width() * bitmap.bytes_per_pixel();
+	const uint32_t row_stride = (row_size + 3) & ~3u;
+	const uint32_t image_size = row_stride * bitmap.height();
+
+	std::string header;
+	header += "BM";
+	put_u32(header, 14 + 40 + image_size);
+	put_u32(header, 0);
+	put_u32(header, 14 + 40);
+	put_u32(header, 40);
+	put_u32(header, bitmap.width());
+	put_u32(header, bitmap.height()); // Positive height: bottom-up rows
+	put_u16(header, 1);
+	put_u16(header, static_cast<uint16_t>(8 * bitmap.bytes_per_pixel()));
+	put_u32(header, 0);
+	put_u32(header, image_size);
+	header.append(16, '\0');
+	file.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+	const char padding[4] = {};
+	for (uint32_t y = bitmap.height(); y-- > 0;) {
+		file.write(reinterpret_cast<const char*>(bitmap.row(y)), row_size);
+		file.write(padding, row_stride - row_size);
+	}
+
+	file.close();
+	if (!file) {
+		std::cerr << "save_bitmap() - Error: Could not write " << path << '\n';
+		return false;
+	}
+	return true;
+}
+
+bool save_bmp(const std::string& path, const Hdr_Image& image, const Tone_Mapper& tone_mapper)
+{
+	Trace_Span span("save bmp", "io");
+	bitmap_image bitmap(image.width, image.height);
+
+	{
+		Trace_Span resolve("resolve", "io");
+		for (int y = 0; y < image.height; y++) {
+			tone_mapper.resolve_bgr(&image.at(0, y), bitmap.row(y), image.width);
+		}
+	}
+
+	return save_bitmap(path, bitmap);
+}
+
+bool save_pfm(const std::string& path, const Hdr_Image& image)
+{
+	Trace_Span span("save pfm", "io");
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << "save_pfm() - Error: Could not open " << path << '\n';
+		return false;
+	}
+
+	// A negative scale marks little-endian data
+	file << "PF\n" << image.width << ' ' << image.height << '\n' << (host_is_little_endian() ? "-1.0" : "1.0") << '\n';
+
+	std::vector<float> row(static_cast<size_t>(image.width) * 3);
+	for (int y = image.height - 1; y >= 0; y--) {
+		for (int x = 0; x < image.width; x++) {
+			const Color3& c = image.at(x, y);
+			row[x * 3 + 0]  = c.r;
+			row[x * 3 + 1]  = c.g;
+			row[x * 3 + 2]  = c.b;
+		}
+		file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(float)));
+	}
+
+	// Buffered data only reaches the disk, and can only fail, on close
+	file.close();
+	if (!file) {
+		std::cerr << "save_pfm() - Error: Could not write " << path << '\n';
+		return false;
+	}
+	return true;
+}
+
+static void put_f32(std::string& out, const float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+	put_u32(out, bits);
+}
+
+static void put_attribute(std::string& out, const char* name, const char* type, const std::string& value)
+{
+	out += name;
+	out.push_back('\0');
+	out += type;
+	out.push_back('\0');
+	put_u32(out, static_cast<uint32_t>(value.size()));
+	out += value;
+}
+
+std::string exr_header(const std::vector<std::string>& channel_names, const int width, const int height)
+{
+	std::string header;
+	put_u32(header, 20000630); // Magic number
+	put_u32(header, 2);        // Version 2, single part scanline
+
+	std::string channel_list;
+	for (const auto& name : channel_names) {
+		channel_list += name;
+		channel_list.push_back('\0');
+		put_u32(channel_list, 2); // FLOAT
+		put_u32(channel_list, 0); // pLinear and reserved bytes
+		put_u32(channel_list, 1); // x sampling
+		put_u32(channel_list, 1); // y sampling
+	}
+	channel_list.push_back('\0');
+
+	std::string window;
+	put_u32(window, 0);
+	put_u32(window, 0);
+	put_u32(window, static_cast<uint32_t>(width - 1));
+	put_u32(window, static_cast<uint32_t>(height - 1));
+
+	std::string one, center;
+	put_f32(one, 1.0f);
+	put_f32(center, 0.0f);
+	put_f32(center, 0.0f);
+
+	put_attribute(header, "channels", "chlist", channel_list);
+	put_attribute(header, "compression", "compression", std::string(1, '\0'));
+	put_attribute(header, "dataWindow", "box2i", window);
+	put_attribute(header, "displayWindow", "box2i", window);
+	put_attribute(header, "lineOrder", "lineOrder", std::string(1, '\0'));
+	put_attribute(header, "pixelAspectRatio", "float", one);
+	put_attribute(header, "screenWindowCenter", "v2f", center);
+	put_attribute(header, "screenWindowWidth", "float", one);
+	header.push_back('\0');
+
+	// Uncompressed files hold one scanline per chunk, each prefixed by its y and byte count
+	const uint64_t chunk_bytes = exr_chunk_size(static_cast<int>(channel_names.size()), width);
+	const uint64_t first_chunk = header.size() + static_cast<uint64_t>(height) * 8;
+
+	for (int y = 0; y < height; y++) {
+		put_u64(header, first_chunk + static_cast<uint64_t>(y) * chunk_bytes);
+	}
+	return header;
+}
+
+bool save_exr(const std::string& path, const std::vector<Exr_Channel>& input_channels)
+{
+	Trace_Span span("save exr", "io");
+	if (input_channels.empty()) return false;
+
+	const int width  = input_channels[0].image->width;
+	const int height = input_channels[0].image->height;
+
+	// Readers expect channels sorted by name
+	std::vector<Exr_Channel> channels = input_channels;
+	std::sort(channels.begin(), channels.end(), [](const Exr_Channel& a, const Exr_Channel& b) { return a.name < b.name; });
+
+	std::vector<std::string> names;
+	for (const auto& channel : channels) {
+		names.push_back(channel.name);
+	}
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << "save_exr() - Error: Could not open " << path << '\n';
+		return false;
+	}
+
+	const std::string header = exr_header(names, width, height);
+	file.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+	const auto line_bytes = static_cast<uint32_t>(exr_chunk_size(static_cast<int>(channels.size()), width) - 8);
+
+	std::string chunk;
+	chunk.reserve(line_bytes + 8);
+	for (int y = 0; y < height; y++) {
+		chunk.clear();
+		put_u32(chunk, static_cast<uint32_t>(y));
+		put_u32(chunk, line_bytes);
+
+		for (const auto& channel : channels) {
+			for (int x = 0; x < width; x++) {
+				put_f32(chunk, channel.image->at(x, y)[channel.component]);
+			}
+		}
+		file.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+	}
+
+	file.close();
+	if (!file) {
+		std::cerr << "save_exr() - Error: Could not write " << path << '\n';
+		return false;
+	}
+	return true;
+}
+
+bool save_exr(const std::string& path, const Hdr_Image& image)
+{
+	return save_exr(path, {{"R", &image, 0}, {"G", &image, 1}, {"B", &image, 2}});
+}
@@ -0,0 +1,64 @@
+﻿// /*
+//  * hdr_image.h
+//  */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "tonemap.h"
+#include "math/vec3.h"
+
+// Linear floating point RGB image, row 0 at the top
+struct Hdr_Image {
+	int width  = 0;
+	int height = 0;
+	std::vector<Color3> pixels;
+
+	Hdr_Image() = default;
+	Hdr_Image(const int w, const int h) : width(w), height(h), pixels(static_cast<size_t>(w) * h) {}
+
+	Color3& at(const int x, const int y) { return pixels[static_cast<size_t>(y) * width + x]; }
+	const Color3& at(const int x, const int y) const { return pixels[static_cast<size_t>(y) * width + x]; }
+};
+
+// Portable float map (.pfm), color or grayscale
+bool load_pfm(const std::string& path, Hdr_Image& image);
+
+// Radiance RGBE (.hdr / .pic), flat or run-length encoded scanlines
+bool load_rgbe(const std::string& path, Hdr_Image& image);
+
+// Picks the loader from the file extension, errors are reported on stderr
+bool load_hdr_image(const std::string& path, Hdr_Image& image);
+
+// Writes an 8-bit bitmap, unlike bitmap_image::save_image() reporting whether it made it to disk
+bool save_bitmap(const std::string& path, const bitmap_image& bitmap);
+
+// 24-bit BMP, resolved to 8-bit by the given tone mapper
+bool save_bmp(const std::string& path, const Hdr_Image& image, const Tone_Mapper& tone_mapper = Tone_Mapper());
+
+// Little-endian color PFM
+bool save_pfm(const std::string& path, const Hdr_Image& image);
+
+// One channel of an EXR file, taken from a component (0 = r, 1 = g, 2 = b) of an image
+struct Exr_Channel {
+	std::string name;
+	const Hdr_Image* image;
+	int component;
+};
+
+// Uncompressed scanline OpenEXR with 32-bit float channels, all images must share the same size
+bool save_exr(const std::string& path, const std::vector<Exr_Channel>& channels);
+
+// RGB convenience form
+bool save_exr(const std::string& path, const Hdr_Image& image);
+
+// Header and scanline offset table of an uncompressed float EXR, channel names must be sorted
+std::string exr_header(const std::vector<std::string>& channel_names, int width, int height);
+
+// Bytes in one scanline chunk of such a file: y, byte count, then each channel's row of floats
+inline uint64_t exr_chunk_size(const int channel_count, const int width)
+{
+	return 8 + static_cast<uint64_t>(channel_count) * width * 4;
+}
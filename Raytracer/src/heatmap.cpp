@@ -0,0 +1,37 @@
+﻿#include "heatmap.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+
+bool save_heatmap(const std::string& path, const Hdr_Image& cost, float* scale_max)
+{
+	if (cost.width <= 0 || cost.height <= 0) {
+		std::cerr << "save_heatmap() - Error: empty cost image for " << path << '\n';
+		return false;
+	}
+
+	std::vector<float> sorted;
+	sorted.reserve(cost.pixels.size());
+	for (const Color3& c : cost.pixels) sorted.push_back(c.r);
+
+	const size_t percentile = (sorted.size() - 1) * 99 / 100;
+	std::nth_element(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(percentile), sorted.end());
+	const float top = std::max(sorted[percentile], 1e-6f);
+
+	bitmap_image bitmap(cost.width, cost.height);
+
+	for (int y = 0; y < cost.height; y++) {
+		for (int x = 0; x < cost.width; x++) {
+			const float t    = std::min(std::max(cost.at(x, y).r / top, 0.0f), 1.0f);
+			const auto index = std::min(static_cast<int>(t * 1000.0f), 999);
+			bitmap.set_pixel(x, y, jet_colormap[index]);
+		}
+	}
+
+	if (!save_bitmap(path, bitmap)) return false;
+
+	if (scale_max) *scale_max = top;
+	return true;
+}
@@ -0,0 +1,14 @@
+﻿// /*
+//  * heatmap.h
+//  */
+
+#pragma once
+
+#include <string>
+
+#include "hdr_image.h"
+
+// Writes a per-pixel cost (the red channel of the render time or traversal cost AOV) as a false-color BMP, blue
+// for the cheapest pixels through red for the most expensive. The scale tops out at the 99th percentile so a few
+// outliers don't flatten everything else, scale_max receives the cost that stands for.
+bool save_heatmap(const std::string& path, const Hdr_Image& cost, float* scale_max = nullptr);
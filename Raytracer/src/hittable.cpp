@@ -1 +1,3 @@
 ﻿#include "hittable.h"
+
+thread_local uint64_t intersection_tests = 0;
@@ -9,12 +9,21 @@
 #include "math/vec3.h"
 
 class Material;
+class Hittable;
+
+// Intersection work done by the calling thread so far, BVH nodes visited plus primitives tested (a plain list
+// counts each member as a test), read by the traversal cost AOV
+extern thread_local uint64_t intersection_tests;
 
 struct Hit_Record {
 	Point3 p    = Vec3(0.0f, 0.0f, 0.0f);
 	Vec3 normal = Vec3(0.0f, 0.0f, 0.0f);
 	shared_ptr<Material> mat_ptr;
+	const Hittable* object = nullptr; // Object that was hit, used to look up lights
+	int primitive          = 0;       // Index within objects that hold many primitives
 	float t         = 0.0f;
+	float u         = 0.0f; // Texture coordinates, from meshes with uvs
+	float v         = 0.0f;
 	bool front_face = true;
 
 	inline void set_face_normal(const Ray& r, const Vec3& outward_normal)
@@ -27,4 +36,7 @@ struct Hit_Record {
 class Hittable {
 public:
 	virtual bool hit(const Ray& r, float t_min, float t_max, Hit_Record& record) const = 0;
+
+	// Primitives addressed through Hit_Record::primitive, each gets its own object id
+	virtual int primitive_count() const { return 1; }
 };
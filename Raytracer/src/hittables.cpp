@@ -9,6 +9,8 @@ bool Hittables::hit(const Ray& r, const float t_min, const float t_max, Hit_Reco
 
 	auto current_closest = t_max;
 
+	intersection_tests += objects.size();
+
 	for (const auto& object : objects) {
 		if (object->hit(r, t_min, current_closest, temp_record)) {
 			hit_anything    = true;
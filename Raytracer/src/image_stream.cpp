@@ -0,0 +1,136 @@
+﻿#include "image_stream.h"
+
+#include <cstring>
+#include <utility>
+
+#include "math/vec3.h"
+
+
+static void store_u16(uint8_t* out, const uint16_t value)
+{
+	out[0] = static_cast<uint8_t>(value & 0xff);
+	out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+static void store_u32(uint8_t* out, const uint32_t value)
+{
+	for (int i = 0; i < 4; i++) out[i] = static_cast<uint8_t>((value >> (8 * i)) & 0xff);
+}
+
+static void store_f32(uint8_t* out, const float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+	store_u32(out, bits);
+}
+
+Bmp_Stream::Bmp_Stream(const std::string& path, const int width, const int height, Tone_Mapper tone_mapper)
+	: tone_mapper(std::move(tone_mapper))
+{
+	this->width  = width;
+	this->height = height;
+	row_stride   = (static_cast<uint64_t>(width) * 3 + 3) & ~static_cast<uint64_t>(3);
+
+	constexpr uint32_t header_size = 14 + 40;
+	const uint64_t image_size      = row_stride * height;
+
+	if (!file.create(path, header_size + image_size)) return;
+
+	uint8_t* h = file.data();
+	h[0]       = 'B';
+	h[1]       = 'M';
+	store_u32(h + 2, static_cast<uint32_t>(header_size + image_size));
+	store_u32(h + 10, header_size);
+	store_u32(h + 14, 40);
+	store_u32(h + 18, static_cast<uint32_t>(width));
+	store_u32(h + 22, static_cast<uint32_t>(height)); // Positive height: bottom-up rows
+	store_u16(h + 26, 1);
+	store_u16(h + 28, 24);
+	store_u32(h + 34, static_cast<uint32_t>(image_size));
+}
+
+bool Bmp_Stream::write_tile(const int x0, const int y0, const Hdr_Image& tile)
+{
+	if (!is_open()) return false;
+
+	for (int y = 0; y < tile.height; y++) {
+		const int row = height - 1 - (y0 + y);
+		uint8_t* out  = file.data() + 54 + row * row_stride + static_cast<uint64_t>(x0) * 3;
+
+		tone_mapper.resolve_bgr(&tile.at(0, y), out, tile.width);
+	}
+	return true;
+}
+
+Pfm_Stream::Pfm_Stream(const std::string& path, const int width, const int height)
+{
+	this->width  = width;
+	this->height = height;
+
+	const std::string header = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+	header_size              = header.size();
+
+	if (!file.create(path, header_size + static_cast<uint64_t>(width) * height * 12)) return;
+
+	memcpy(file.data(), header.data(), header.size());
+}
+
+bool Pfm_Stream::write_tile(const int x0, const int y0, const Hdr_Image& tile)
+{
+	if (!is_open()) return false;
+
+	for (int y = 0; y < tile.height; y++) {
+		const int row = height - 1 - (y0 + y);
+		uint8_t* out  = file.data() + header_size + (static_cast<uint64_t>(row) * width + x0) * 12;
+
+		for (int x = 0; x < tile.width; x++) {
+			const Color3& c = tile.at(x, y);
+			store_f32(out + x * 12 + 0, c.r);
+			store_f32(out + x * 12 + 4, c.g);
+			store_f32(out + x * 12 + 8, c.b);
+		}
+	}
+	return true;
+}
+
+Exr_Stream::Exr_Stream(const std::string& path, const int width, const int height)
+{
+	this->width  = width;
+	this->height = height;
+
+	// Channels in the sorted order EXR requires
+	const std::string header = exr_header({"B", "G", "R"}, width, height);
+	header_size              = header.size();
+
+	const uint64_t chunk_size = exr_chunk_size(3, width);
+	if (!file.create(path, header_size + chunk_size * height)) return;
+
+	memcpy(file.data(), header.data(), header.size());
+
+	for (int y = 0; y < height; y++) {
+		uint8_t* chunk = file.data() + header_size + y * chunk_size;
+		store_u32(chunk, static_cast<uint32_t>(y));
+		store_u32(chunk + 4, static_cast<uint32_t>(chunk_size - 8));
+	}
+}
+
+bool Exr_Stream::write_tile(const int x0, const int y0, const Hdr_Image& tile)
+{
+	if (!is_open()) return false;
+
+	const uint64_t chunk_size = exr_chunk_size(3, width);
+	const uint64_t plane_size = static_cast<uint64_t>(width) * 4;
+
+	for (int y = 0; y < tile.height; y++) {
+		uint8_t* chunk = file.data() + header_size + (y0 + y) * chunk_size + 8;
+
+		for (int x = 0; x < tile.width; x++) {
+			const Color3& c    = tile.at(x, y);
+			const uint64_t col = static_cast<uint64_t>(x0 + x) * 4;
+			store_f32(chunk + 0 * plane_size + col, c.b);
+			store_f32(chunk + 1 * plane_size + col, c.g);
+			store_f32(chunk + 2 * plane_size + col, c.r);
+		}
+	}
+	return true;
+}
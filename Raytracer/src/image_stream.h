@@ -0,0 +1,70 @@
+﻿// /*
+//  * image_stream.h
+//  */
+
+#pragma once
+
+#include <string>
+
+#include "hdr_image.h"
+#include "mapped_file.h"
+#include "tonemap.h"
+
+// An output file written tile by tile while the render runs. The file is preallocated at its final size and
+// memory-mapped, so only the tiles in flight are held in RAM and every finished tile is already in the file if
+// the process dies. write_tile() may be called concurrently for tiles that don't overlap.
+class Image_Stream {
+public:
+	virtual ~Image_Stream() = default;
+
+	// Writes a block of linear pixels with its top-left corner at (x0, y0), row 0 at the top. False if the file
+	// isn't open, the disk only reports errors on close().
+	virtual bool write_tile(int x0, int y0, const Hdr_Image& tile) = 0;
+
+	// Starts writing finished pixels back to disk without waiting for them
+	bool flush() { return file.flush(); }
+
+	// Waits for the file to be written, false (reported on stderr) if it couldn't be
+	bool close() { return file.close(); }
+
+	bool is_open() const { return file.is_open(); }
+
+protected:
+	Mapped_File file;
+	int width  = 0;
+	int height = 0;
+};
+
+// 24-bit bottom-up BMP, resolved to 8-bit by a Tone_Mapper
+class Bmp_Stream : public Image_Stream {
+public:
+	Bmp_Stream(const std::string& path, int width, int height, Tone_Mapper tone_mapper = Tone_Mapper());
+
+	bool write_tile(int x0, int y0, const Hdr_Image& tile) override;
+
+private:
+	Tone_Mapper tone_mapper;
+	uint64_t row_stride = 0;
+};
+
+// Linear little-endian color PFM, rows stored bottom to top
+class Pfm_Stream : public Image_Stream {
+public:
+	Pfm_Stream(const std::string& path, int width, int height);
+
+	bool write_tile(int x0, int y0, const Hdr_Image& tile) override;
+
+private:
+	uint64_t header_size = 0;
+};
+
+// Linear uncompressed float RGB EXR, scanline chunks laid out back to back after the offset table
+class Exr_Stream : public Image_Stream {
+public:
+	Exr_Stream(const std::string& path, int width, int height);
+
+	bool write_tile(int x0, int y0, const Hdr_Image& tile) override;
+
+private:
+	uint64_t header_size = 0;
+};
@@ -0,0 +1,107 @@
+﻿#include "instance_set.h"
+
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+#include "ray_stats.h"
+
+
+// Below this the inverse is mostly rounding error
+static constexpr float min_determinant = 1e-12f;
+
+static bool valid_instances(const std::vector<Instance>& instances, const size_t geometry_count, const size_t material_count)
+{
+	for (size_t i = 0; i < instances.size(); i++) {
+		const Instance& instance = instances[i];
+
+		if (instance.geometry >= geometry_count) {
+			std::cerr << "Instance_Set() - Error: instance " << i << " refers to geometry " << instance.geometry << ", the table has "
+					  << geometry_count << " entries\n";
+			return false;
+		}
+		if (instance.material != Instance::own_material && instance.material >= material_count) {
+			std::cerr << "Instance_Set() - Error: instance " << i << " refers to material " << instance.material << ", the table has "
+					  << material_count << " entries\n";
+			return false;
+		}
+		if (!(std::fabs(instance.object_to_world.determinant()) > min_determinant)) {
+			std::cerr << "Instance_Set() - Error: instance " << i << " has a singular transform\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+Instance_Set::Instance_Set(std::vector<shared_ptr<Hittable>> geometries, const std::vector<Aabb>& geometry_bounds,
+						   const std::vector<Instance>& instances, std::vector<shared_ptr<Material>> materials)
+	: geometries(std::move(geometries)), materials(std::move(materials))
+{
+	if (geometry_bounds.size() != this->geometries.size()) {
+		std::cerr << "Instance_Set() - Error: " << geometry_bounds.size() << " bounds for " << this->geometries.size() << " geometries\n";
+		return;
+	}
+	if (instances.empty() || !valid_instances(instances, this->geometries.size(), this->materials.size())) return;
+
+	std::vector<Aabb> instance_bounds(instances.size());
+	for (size_t i = 0; i < instances.size(); i++) {
+		instance_bounds[i] = instances[i].object_to_world.bounds(geometry_bounds[instances[i].geometry]);
+		box.expand(instance_bounds[i]);
+	}
+
+	std::vector<uint32_t> order;
+	build_bvh(instance_bounds, nodes, order);
+	nodes.shrink_to_fit();
+
+	// Instances in leaf order
+	this->instances.resize(instances.size());
+	for (size_t i = 0; i < instances.size(); i++) {
+		const Instance& instance           = instances[order[i]];
+		this->instances[i].world_to_object = instance.object_to_world.inverse();
+		this->instances[i].geometry        = instance.geometry;
+		this->instances[i].material        = instance.material;
+	}
+}
+
+size_t Instance_Set::memory_bytes() const
+{
+	return instances.capacity() * sizeof(Placed_Instance) + nodes.capacity() * sizeof(Bvh_Node);
+}
+
+bool Instance_Set::hit(const Ray& r, const float t_min, const float t_max, Hit_Record& record) const
+{
+	if (nodes.empty()) return false;
+
+	const Vec3 direction = r.direction();
+	const Vec3 inv_dir   = Vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	int64_t closest      = -1;
+	float closest_t      = t_max;
+	Hit_Record closest_record;
+	Bvh_Walk_Counts counts;
+
+	walk_bvh(nodes.data(), r.origin(), inv_dir, t_min, closest_t, counts, [&](const uint32_t first, const uint32_t count) {
+		for (uint32_t i = first; i < first + count; i++) {
+			const Placed_Instance& instance = instances[i];
+			const Ray local(instance.world_to_object.point(r.origin()), instance.world_to_object.vector(direction));
+
+			if (geometries[instance.geometry]->hit(local, t_min, closest_t, closest_record)) {
+				closest_t = closest_record.t;
+				closest   = i;
+			}
+		}
+	});
+
+	intersection_tests += counts.nodes;
+	RAY_STAT(box_tests += counts.boxes);
+	if (closest < 0) return false;
+
+	// The side was decided in object space, and the inverse transpose keeps it
+	const Placed_Instance& instance = instances[static_cast<size_t>(closest)];
+	record                          = closest_record;
+	record.p                        = r.at(closest_t);
+	record.normal                   = unit_vector(instance.world_to_object.normal(closest_record.normal));
+	record.object                   = this;
+	record.primitive                = static_cast<int>(closest);
+	if (instance.material != Instance::own_material) record.mat_ptr = materials[instance.material];
+	return true;
+}
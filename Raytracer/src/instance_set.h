@@ -0,0 +1,65 @@
+﻿// /*
+//  * instance_set.h
+//  */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "bvh.h"
+#include "hittable.h"
+#include "hittables.h"
+#include "math/aabb.h"
+#include "math/transform.h"
+
+// One placement of a shared geometry
+struct Instance {
+	static constexpr uint32_t own_material = 0xffffffffu;
+
+	uint32_t geometry;
+	uint32_t material = own_material; // Index into the set's material table, own_material keeps the geometry's
+	Transform object_to_world;
+};
+
+// Copies of shared geometry in a two-level hierarchy: each geometry keeps its own acceleration structure (a
+// Triangle_Mesh or Sphere_Set BVH, or a single primitive) and a BVH over the instances' world space bounds finds
+// the copies a ray may hit. Memory grows with the distinct geometry plus 56 bytes and a share of the top-level
+// nodes per instance, however large the geometry.
+//
+// Rays are moved into object space rather than the geometry into world space. Directions aren't renormalized, so
+// distances along a ray are the same in both spaces and t_min and t_max carry over. Hits report the instance's
+// index in BVH leaf order in Hit_Record::primitive, so every instance gets its own object id.
+class Instance_Set : public Hittable {
+public:
+	// Geometry bounds are in object space, Hittable doesn't report its own. Instances referring to a geometry or
+	// material out of range or with a singular transform are reported on stderr and leave the set empty.
+	Instance_Set(std::vector<shared_ptr<Hittable>> geometries, const std::vector<Aabb>& geometry_bounds, const std::vector<Instance>& instances,
+				 std::vector<shared_ptr<Material>> materials);
+
+	bool hit(const Ray& r, float t_min, float t_max, Hit_Record& record) const override;
+
+	int primitive_count() const override { return static_cast<int>(instances.size()); }
+
+	size_t instance_count() const { return instances.size(); }
+	const Aabb& bounds() const { return box; }
+	const std::vector<shared_ptr<Hittable>>& geometry_table() const { return geometries; }
+	const std::vector<shared_ptr<Material>>& material_table() const { return materials; }
+
+	// Instances and top-level BVH, the geometry is counted by its own memory_bytes()
+	size_t memory_bytes() const;
+
+private:
+	// Rays and normals only ever go from world to object space
+	struct Placed_Instance {
+		Transform world_to_object;
+		uint32_t geometry;
+		uint32_t material;
+	};
+
+	std::vector<shared_ptr<Hittable>> geometries;
+	std::vector<Placed_Instance> instances;
+	std::vector<Bvh_Node> nodes;
+	std::vector<shared_ptr<Material>> materials;
+	Aabb box;
+};
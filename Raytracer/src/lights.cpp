@@ -0,0 +1,354 @@
+#include "lights.h"
+
+#include <algorithm>
+
+#include "material.h"
+#include "trace.h"
+
+
+// cos(max(0, theta_a - theta_b)) and sin(max(0, theta_a - theta_b)) from the sines and cosines of both angles
+
+static float cos_sub_clamped(const float sin_a, const float cos_a, const float sin_b, const float cos_b)
+{
+	if (cos_a > cos_b) return 1.0f;
+	return cos_a * cos_b + sin_a * sin_b;
+}
+
+static float sin_sub_clamped(const float sin_a, const float cos_a, const float sin_b, const float cos_b)
+{
+	if (cos_a > cos_b) return 0.0f;
+	return sin_a * cos_b - cos_a * sin_b;
+}
+
+static float safe_sin(const float cos_theta)
+{
+	return sqrtf(fmaxf(0.0f, 1.0f - cos_theta * cos_theta));
+}
+
+float Light_Bounds::importance(const Point3& p, const Vec3& normal) const
+{
+	// Distance to the cluster, clamped so points inside or very close to it don't blow up
+	const Point3 pc    = bounds.center();
+	const float half   = 0.5f * bounds.diagonal().length();
+	const float dist2  = (p - pc).length2();
+	const float d2     = fmaxf(dist2, half);
+
+	const Vec3 wi = dist2 > 0.0f ? (p - pc) / sqrtf(dist2) : axis;
+
+	// Angle subtended by the cluster's bounding sphere
+	float cos_theta_b = -1.0f;
+	if (!bounds.contains(p)) {
+		const float sin2_theta_b = half * half / dist2;
+		if (sin2_theta_b < 1.0f) cos_theta_b = sqrtf(1.0f - sin2_theta_b);
+	}
+	const float sin_theta_b = safe_sin(cos_theta_b);
+
+	// Smallest angle between the emitters' normals and the direction to p
+	const float cos_theta_w = dot(axis, wi);
+	const float sin_theta_w = safe_sin(cos_theta_w);
+	const float sin_theta_o = safe_sin(cos_theta_o);
+	const float cos_theta_x = cos_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+	const float sin_theta_x = sin_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+	const float cos_theta_p = cos_sub_clamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+
+	if (cos_theta_p <= cos_theta_e) return 0.0f;
+
+	float result = power * cos_theta_p / d2;
+
+	// Smallest angle between the receiving surface's normal and the cluster
+	if (!normal.near_zero()) {
+		const float cos_theta_i  = dot(-wi, normal);
+		const float sin_theta_i  = safe_sin(cos_theta_i);
+		const float cos_theta_pi = cos_sub_clamped(sin_theta_i, cos_theta_i, sin_theta_b, cos_theta_b);
+		result *= fmaxf(0.0f, cos_theta_pi);
+	}
+
+	return fmaxf(0.0f, result);
+}
+
+// Smallest cone containing two cones, cone_a/cone_b given as (axis, cos of half angle)
+static void union_cones(const Vec3& axis_a, const float cos_a, const Vec3& axis_b, const float cos_b,
+                        Vec3& axis, float& cos_theta)
+{
+	const float theta_a = acosf(clamp(cos_a, -1.0f, 1.0f));
+	const float theta_b = acosf(clamp(cos_b, -1.0f, 1.0f));
+	const float theta_d = acosf(clamp(dot(axis_a, axis_b), -1.0f, 1.0f));
+
+	// One cone already covers the other
+	if (fminf(theta_d + theta_b, pi) <= theta_a) {
+		axis      = axis_a;
+		cos_theta = cos_a;
+		return;
+	}
+	if (fminf(theta_d + theta_a, pi) <= theta_b) {
+		axis      = axis_b;
+		cos_theta = cos_b;
+		return;
+	}
+
+	const float theta_o = (theta_a + theta_d + theta_b) / 2.0f;
+	if (theta_o >= pi) {
+		axis      = axis_a;
+		cos_theta = -1.0f;
+		return;
+	}
+
+	// Rotate axis_a towards axis_b so the merged cone is centered
+	const float theta_r = theta_o - theta_a;
+	const Vec3 w_r      = cross(axis_a, axis_b);
+	if (w_r.length2() == 0.0f) {
+		axis      = axis_a;
+		cos_theta = -1.0f;
+		return;
+	}
+
+	const Vec3 k  = unit_vector(w_r);
+	const float c = cosf(theta_r);
+	const float s = sinf(theta_r);
+	axis          = unit_vector(axis_a * c + cross(k, axis_a) * s + k * dot(k, axis_a) * (1.0f - c));
+	cos_theta     = cosf(theta_o);
+}
+
+static Light_Bounds union_bounds(const Light_Bounds& a, const Light_Bounds& b)
+{
+	if (a.power == 0.0f) return b;
+	if (b.power == 0.0f) return a;
+
+	Light_Bounds result;
+	result.bounds      = surrounding_box(a.bounds, b.bounds);
+	result.power       = a.power + b.power;
+	result.cos_theta_e = fminf(a.cos_theta_e, b.cos_theta_e);
+	union_cones(a.axis, a.cos_theta_o, b.axis, b.cos_theta_o, result.axis, result.cos_theta_o);
+	return result;
+}
+
+// Orientation term of the surface area orientation heuristic
+static float cone_measure(const Light_Bounds& b)
+{
+	const float theta_o = acosf(clamp(b.cos_theta_o, -1.0f, 1.0f));
+	const float theta_e = acosf(clamp(b.cos_theta_e, -1.0f, 1.0f));
+	const float theta_w = fminf(theta_o + theta_e, pi);
+	const float sin_o   = sinf(theta_o);
+
+	return 2.0f * pi * (1.0f - b.cos_theta_o)
+		+ pi / 2.0f * (2.0f * theta_w * sin_o - cosf(theta_o - 2.0f * theta_w) - 2.0f * theta_o * sin_o + b.cos_theta_o);
+}
+
+void Lights::clear()
+{
+	objects.clear();
+	nodes.clear();
+	keys.clear();
+	light_index.clear();
+	bit_trails.clear();
+}
+
+void Lights::add(shared_ptr<Sphere> light)
+{
+	const Hittable* object = light.get();
+	add(std::move(light), object, 0);
+}
+
+void Lights::add(shared_ptr<Sphere> light, const Hittable* object, const int primitive)
+{
+	const Light_Key key = {object, primitive};
+	if (light_index.emplace(key, static_cast<uint32_t>(objects.size())).second) {
+		objects.push_back(std::move(light));
+		keys.push_back(key);
+	}
+}
+
+void Lights::build()
+{
+	Trace_Span span("build light bvh", "scene");
+	nodes.clear();
+	bit_trails.assign(objects.size(), 0);
+
+	std::vector<Build_Item> items;
+	items.reserve(objects.size());
+
+	for (uint32_t i = 0; i < objects.size(); i++) {
+		const Sphere& sphere = *objects[i];
+		const float r        = fabs(sphere.radius);
+
+		// Spheres emit in every direction: a full normal cone, each normal emitting over its hemisphere
+		Build_Item item;
+		item.bounds.bounds      = sphere.bounding_box();
+		item.bounds.cos_theta_o = -1.0f;
+		item.bounds.cos_theta_e = 0.0f;
+		item.bounds.power       = pi * 4.0f * pi * r * r * luminance(sphere.mat_ptr->emitted(Ray(), Hit_Record()));
+		item.centroid           = sphere.center;
+		item.light              = i;
+
+		if (item.bounds.power > 0.0f) {
+			items.push_back(item);
+		}
+	}
+
+	if (!items.empty()) {
+		nodes.reserve(2 * items.size() - 1);
+		build_recursive(items, 0, items.size(), 0, 0);
+	}
+}
+
+uint32_t Lights::build_recursive(std::vector<Build_Item>& items, const size_t begin, const size_t end,
+                                 const uint64_t bit_trail, const int depth)
+{
+	const auto node_index = static_cast<uint32_t>(nodes.size());
+	nodes.emplace_back();
+
+	if (end - begin == 1) {
+		nodes[node_index].bounds = items[begin].bounds;
+		nodes[node_index].index  = items[begin].light;
+		nodes[node_index].leaf   = true;
+		bit_trails[items[begin].light] = bit_trail;
+		return node_index;
+	}
+
+	Aabb centroids;
+	Light_Bounds all;
+	for (size_t i = begin; i < end; i++) {
+		centroids.expand(items[i].centroid);
+		all = union_bounds(all, items[i].bounds);
+	}
+
+	// Every level spends a bit of the trail, so leaves can't go deeper than it is wide. Even splits need
+	// ceil(log2(count)) more levels, SAH splits are only taken while one extra level still leaves room for that.
+	constexpr int trail_bits = 64;
+	int even_levels          = 0;
+	while ((size_t(1) << even_levels) < end - begin) even_levels++;
+	const bool sah_fits = depth + 1 + even_levels <= trail_bits;
+
+	// Binned split minimizing power * area * orientation of both halves
+	constexpr int bin_count = 12;
+	size_t mid              = begin + (end - begin) / 2;
+	const Vec3 extent       = centroids.diagonal();
+	float best_cost         = infinity;
+	int best_axis           = -1;
+	int best_bin            = 0;
+
+	for (int axis = 0; axis < 3 && sah_fits; axis++) {
+		if (extent[axis] <= 0.0f) continue;
+
+		Light_Bounds bins[bin_count];
+		for (size_t i = begin; i < end; i++) {
+			const float offset = (items[i].centroid[axis] - centroids.min[axis]) / extent[axis];
+			const int b        = std::min(static_cast<int>(offset * bin_count), bin_count - 1);
+			bins[b]            = union_bounds(bins[b], items[i].bounds);
+		}
+
+		for (int split = 1; split < bin_count; split++) {
+			Light_Bounds below, above;
+			for (int b = 0; b < split; b++) below = union_bounds(below, bins[b]);
+			for (int b = split; b < bin_count; b++) above = union_bounds(above, bins[b]);
+
+			const float cost = below.power * below.bounds.surface_area() * cone_measure(below)
+				+ above.power * above.bounds.surface_area() * cone_measure(above);
+
+			if (below.power > 0.0f && above.power > 0.0f && cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_bin  = split;
+			}
+		}
+	}
+
+	if (best_axis >= 0) {
+		const auto first_above = std::partition(items.begin() + begin, items.begin() + end, [&](const Build_Item& item) {
+			const float offset = (item.centroid[best_axis] - centroids.min[best_axis]) / extent[best_axis];
+			return std::min(static_cast<int>(offset * bin_count), bin_count - 1) < best_bin;
+		});
+		mid = static_cast<size_t>(first_above - items.begin());
+	}
+	else {
+		// Coincident centroids (or a very deep tree), fall back to an even split
+		const int axis = centroids.largest_axis();
+		std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end,
+		                 [axis](const Build_Item& a, const Build_Item& b) { return a.centroid[axis] < b.centroid[axis]; });
+	}
+
+	build_recursive(items, begin, mid, bit_trail, depth + 1);
+	const uint32_t second = build_recursive(items, mid, end, bit_trail | (uint64_t(1) << depth), depth + 1);
+
+	nodes[node_index].bounds = all;
+	nodes[node_index].index  = second;
+	nodes[node_index].leaf   = false;
+	return node_index;
+}
+
+bool Lights::sample(const Point3& origin, const Vec3& normal, Light_Sample& sample) const
+{
+	if (nodes.empty()) return false;
+
+	// A lone light is always picked, importance only matters relative to a sibling
+	if (nodes[0].leaf && nodes[0].bounds.importance(origin, normal) <= 0.0f) return false;
+
+	uint32_t node_index = 0;
+	float pmf           = 1.0f;
+
+	while (!nodes[node_index].leaf) {
+		const uint32_t first  = node_index + 1;
+		const uint32_t second = nodes[node_index].index;
+
+		const float importance_first  = nodes[first].bounds.importance(origin, normal);
+		const float importance_second = nodes[second].bounds.importance(origin, normal);
+		const float total             = importance_first + importance_second;
+
+		if (total <= 0.0f) return false;
+
+		const float p_first = importance_first / total;
+		if (random_float() < p_first) {
+			node_index = first;
+			pmf *= p_first;
+		}
+		else {
+			node_index = second;
+			pmf *= 1.0f - p_first;
+		}
+	}
+
+	const Sphere& light = *objects[nodes[node_index].index];
+
+	float pdf;
+	if (!light.sample_direction(origin, sample.direction, pdf)) return false;
+
+	sample.pdf   = pdf * pmf;
+	sample.light     = &light;
+	sample.object    = keys[nodes[node_index].index].object;
+	sample.primitive = keys[nodes[node_index].index].primitive;
+	return true;
+}
+
+float Lights::pdf(const Point3& origin, const Vec3& normal, const Hittable* object, const int primitive) const
+{
+	const auto found = light_index.find({object, primitive});
+	if (found == light_index.end() || nodes.empty()) return 0.0f;
+
+	// Replay the choices sample() makes on the way down to this light's leaf
+	uint64_t bit_trail  = bit_trails[found->second];
+	uint32_t node_index = 0;
+	float pmf           = 1.0f;
+
+	if (nodes[0].leaf && nodes[0].bounds.importance(origin, normal) <= 0.0f) return 0.0f;
+
+	while (!nodes[node_index].leaf) {
+		const uint32_t first  = node_index + 1;
+		const uint32_t second = nodes[node_index].index;
+
+		const float importance_first  = nodes[first].bounds.importance(origin, normal);
+		const float importance_second = nodes[second].bounds.importance(origin, normal);
+		const float total             = importance_first + importance_second;
+
+		if (total <= 0.0f) return 0.0f;
+
+		const bool take_second = bit_trail & 1;
+		pmf *= (take_second ? importance_second : importance_first) / total;
+		node_index = take_second ? second : first;
+		bit_trail >>= 1;
+	}
+
+	// Lights without power never make it into the tree
+	if (nodes[node_index].index != found->second) return 0.0f;
+
+	return pmf * objects[found->second]->pdf_value(origin);
+}
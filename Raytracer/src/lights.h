@@ -0,0 +1,99 @@
+// /*
+//  * lights.h
+//  */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "sphere.h"
+#include "math/aabb.h"
+#include "math/numeric.h"
+#include "math/vec3.h"
+
+struct Light_Sample {
+	Vec3 direction;
+	float pdf              = 0.0f;    // Solid angle density, including the probability of picking this light
+	const Sphere* light    = nullptr; // Emitter the direction was sampled towards
+	const Hittable* object = nullptr; // What a ray reaching the emitter hits: the sphere itself or the set holding it
+	int primitive          = 0;       // Hit_Record::primitive of that hit
+};
+
+// Spatial and directional extent of a group of emitters, used to estimate how much they contribute at a point
+struct Light_Bounds {
+	Aabb bounds;
+	Vec3 axis         = Vec3(0.0f, 0.0f, 1.0f); // Bounding cone of emitter normals
+	float cos_theta_o = 1.0f;                   // Spread of the normals around axis
+	float cos_theta_e = 0.0f;                   // Spread of emission around each normal
+	float power       = 0.0f;
+
+	float importance(const Point3& p, const Vec3& normal) const;
+};
+
+struct Light_Node {
+	Light_Bounds bounds;
+	uint32_t index = 0; // Second child for interior nodes (first child follows the node), light for leaves
+	bool leaf      = false;
+};
+
+// Emissive spheres of a scene, sampled explicitly for direct lighting (next event estimation).
+// Lights are kept in a bounding volume hierarchy with bounding cones (Conty & Kulla 2018) so that picking one
+// proportionally to its estimated contribution is logarithmic in the number of emitters.
+class Lights {
+public:
+	Lights() = default;
+
+	void clear();
+
+	// An emitter that is in the scene on its own
+	void add(shared_ptr<Sphere> light);
+
+	// An emitter stored as a primitive of object (a Sphere_Set), light is a copy of it to sample
+	void add(shared_ptr<Sphere> light, const Hittable* object, int primitive);
+
+	bool empty() const { return objects.empty(); }
+
+	// Builds the hierarchy, must be called after the last add() and before sampling
+	void build();
+
+	// Picks a light and a direction towards it as seen from a surface at origin facing normal
+	bool sample(const Point3& origin, const Vec3& normal, Light_Sample& sample) const;
+
+	// Density sample() would have produced a direction from origin that hits the given primitive, zero if it isn't
+	// a light
+	float pdf(const Point3& origin, const Vec3& normal, const Hittable* object, int primitive = 0) const;
+
+	std::vector<shared_ptr<Sphere>> objects;
+
+private:
+	// What hits on a light report
+	struct Light_Key {
+		const Hittable* object;
+		int primitive;
+
+		bool operator==(const Light_Key& other) const { return object == other.object && primitive == other.primitive; }
+	};
+
+	struct Light_Key_Hash {
+		size_t operator()(const Light_Key& key) const
+		{
+			return std::hash<const Hittable*>()(key.object) ^ (static_cast<size_t>(key.primitive) * 0x9e3779b9u);
+		}
+	};
+
+	struct Build_Item {
+		Light_Bounds bounds;
+		Point3 centroid;
+		uint32_t light;
+	};
+
+	uint32_t build_recursive(std::vector<Build_Item>& items, size_t begin, size_t end, uint64_t bit_trail, int depth);
+
+	std::vector<Light_Node> nodes;
+	std::vector<Light_Key> keys;
+	std::unordered_map<Light_Key, uint32_t, Light_Key_Hash> light_index;
+	std::vector<uint64_t> bit_trails; // Child choices from the root down to each light's leaf, one bit per level
+};
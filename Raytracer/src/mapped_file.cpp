@@ -0,0 +1,200 @@
+﻿#include "mapped_file.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+
+bool Mapped_File::create(const std::string& path, const uint64_t size)
+{
+	close();
+
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+	                          FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		std::cerr << "Mapped_File::create() - Error: Could not create " << path << '\n';
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32),
+	                                    static_cast<DWORD>(size & 0xffffffff), nullptr);
+	void* view     = mapping ? MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, static_cast<SIZE_T>(size)) : nullptr;
+	if (!view) {
+		std::cerr << "Mapped_File::create() - Error: Could not map " << path << '\n';
+		if (mapping) CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	this->path     = path;
+	file_handle    = file;
+	mapping_handle = mapping;
+	bytes          = static_cast<uint8_t*>(view);
+	length         = size;
+	writable       = true;
+	return true;
+}
+
+bool Mapped_File::open_read(const std::string& path)
+{
+	close();
+
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		std::cerr << "Mapped_File::open_read() - Error: Could not open " << path << '\n';
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+
+	HANDLE mapping = size.QuadPart > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	void* view     = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!view) {
+		std::cerr << "Mapped_File::open_read() - Error: Could not map " << path << '\n';
+		if (mapping) CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	this->path     = path;
+	file_handle    = file;
+	mapping_handle = mapping;
+	bytes          = static_cast<uint8_t*>(view);
+	length         = static_cast<uint64_t>(size.QuadPart);
+	writable       = false;
+	return true;
+}
+
+bool Mapped_File::flush(const bool wait)
+{
+	if (!bytes || !writable) return true;
+
+	const bool flushed = FlushViewOfFile(bytes, 0) != 0;
+	return flushed && (!wait || FlushFileBuffers(file_handle) != 0);
+}
+
+bool Mapped_File::close()
+{
+	bool ok = flush(true);
+	if (bytes && !UnmapViewOfFile(bytes)) ok = false;
+	if (mapping_handle) CloseHandle(mapping_handle);
+	if (file_handle && !CloseHandle(file_handle)) ok = false;
+	if (!ok) std::cerr << "Mapped_File::close() - Error: Could not write " << path << '\n';
+
+	bytes          = nullptr;
+	length         = 0;
+	mapping_handle = nullptr;
+	file_handle    = nullptr;
+	return ok;
+}
+
+#else
+
+// Allocates the blocks up front rather than leaving a sparse file, whose pages would only be allocated when the
+// mapping is written and turn a full disk into SIGBUS. Falls back to ftruncate where that isn't supported.
+static bool reserve(const int fd, const uint64_t size)
+{
+#ifdef __APPLE__
+	return ftruncate(fd, static_cast<off_t>(size)) == 0;
+#else
+	const int result = size > 0 ? posix_fallocate(fd, 0, static_cast<off_t>(size)) : EINVAL;
+	if (result == EINVAL || result == EOPNOTSUPP) return ftruncate(fd, static_cast<off_t>(size)) == 0;
+	return result == 0;
+#endif
+}
+
+bool Mapped_File::create(const std::string& path, const uint64_t size)
+{
+	close();
+
+	const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		std::cerr << "Mapped_File::create() - Error: Could not create " << path << '\n';
+		return false;
+	}
+
+	if (!reserve(fd, size)) {
+		std::cerr << "Mapped_File::create() - Error: Could not allocate " << size << " bytes for " << path << '\n';
+		::close(fd);
+		return false;
+	}
+
+	void* view = size > 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	if (view == MAP_FAILED) {
+		std::cerr << "Mapped_File::create() - Error: Could not map " << path << '\n';
+		::close(fd);
+		return false;
+	}
+
+	this->path = path;
+	descriptor = fd;
+	bytes      = static_cast<uint8_t*>(view);
+	length     = size;
+	writable   = true;
+	return true;
+}
+
+bool Mapped_File::open_read(const std::string& path)
+{
+	close();
+
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::cerr << "Mapped_File::open_read() - Error: Could not open " << path << '\n';
+		return false;
+	}
+
+	struct stat info {};
+	fstat(fd, &info);
+	const auto size = static_cast<uint64_t>(info.st_size);
+
+	void* view = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	if (view == MAP_FAILED) {
+		std::cerr << "Mapped_File::open_read() - Error: Could not map " << path << '\n';
+		::close(fd);
+		return false;
+	}
+
+	this->path = path;
+	descriptor = fd;
+	bytes      = static_cast<uint8_t*>(view);
+	length     = size;
+	writable   = false;
+	return true;
+}
+
+bool Mapped_File::flush(const bool wait)
+{
+	if (!bytes || !writable) return true;
+
+	return msync(bytes, length, wait ? MS_SYNC : MS_ASYNC) == 0;
+}
+
+bool Mapped_File::close()
+{
+	// I/O errors on pages written through the mapping only show up here
+	bool ok = flush(true);
+	if (bytes && munmap(bytes, length) != 0) ok = false;
+	if (descriptor >= 0 && ::close(descriptor) != 0) ok = false;
+	if (!ok) std::cerr << "Mapped_File::close() - Error: Could not write " << path << '\n';
+
+	bytes      = nullptr;
+	length     = 0;
+	descriptor = -1;
+	return ok;
+}
+
+#endif
@@ -0,0 +1,51 @@
+﻿// /*
+//  * mapped_file.h
+//  */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// A file mapped into memory. Writes to a writable mapping land in the page cache and reach the disk even if the
+// process dies, without the file ever having to fit in the heap.
+class Mapped_File {
+public:
+	Mapped_File() = default;
+	~Mapped_File() { close(); }
+
+	Mapped_File(const Mapped_File&)            = delete;
+	Mapped_File& operator=(const Mapped_File&) = delete;
+
+	// Creates (or truncates) a file of the given size and maps it writable, errors are reported on stderr
+	bool create(const std::string& path, uint64_t size);
+
+	// Maps an existing file read-only
+	bool open_read(const std::string& path);
+
+	// Schedules dirty pages for writing, blocking until they are written when wait is set. False if the system
+	// reported an error, which for a wait means the data didn't make it to disk.
+	bool flush(bool wait = false);
+
+	// Writes back a writable mapping and waits for it before unmapping, errors are reported on stderr. The
+	// destructor closes too, but has nobody to tell.
+	bool close();
+
+	bool is_open() const { return bytes != nullptr; }
+	uint8_t* data() { return bytes; }
+	const uint8_t* data() const { return bytes; }
+	uint64_t size() const { return length; }
+
+private:
+	std::string path;
+	uint8_t* bytes  = nullptr;
+	uint64_t length = 0;
+	bool writable   = false;
+
+#ifdef _WIN32
+	void* file_handle    = nullptr;
+	void* mapping_handle = nullptr;
+#else
+	int descriptor = -1;
+#endif
+};
@@ -1 +1,105 @@
 ﻿#include "material.h"
+
+
+// Schlick's approximation with the albedo as reflectance at normal incidence
+Color3 Metal::fresnel(const float cos_theta) const
+{
+	const float m = powf(1.0f - clamp(cos_theta, 0.0f, 1.0f), 5);
+	return albedo + (Color3(1.0f, 1.0f, 1.0f) - albedo) * m;
+}
+
+// GGX normal distribution, h in the local frame around the shading normal (z up)
+float Metal::ndf(const Vec3& h) const
+{
+	const float a2 = fuzz * fuzz;
+	const float d  = h.z * h.z * (a2 - 1.0f) + 1.0f;
+	return a2 / (pi * d * d);
+}
+
+// Smith auxiliary function for GGX
+float Metal::lambda(const Vec3& w) const
+{
+	const float cos2 = w.z * w.z;
+	if (cos2 <= 0.0f) return infinity;
+
+	const float tan2 = fmaxf(0.0f, 1.0f - cos2) / cos2;
+	return 0.5f * (-1.0f + sqrtf(1.0f + fuzz * fuzz * tan2));
+}
+
+Vec3 Metal::sample_visible_normal(const Vec3& wo) const
+{
+	// Stretch the view direction into the hemisphere configuration
+	const Vec3 vh = unit_vector(Vec3(fuzz * wo.x, fuzz * wo.y, wo.z));
+
+	const float length2 = vh.x * vh.x + vh.y * vh.y;
+	const Vec3 t1       = length2 > 0.0f ? Vec3(-vh.y, vh.x, 0.0f) / sqrtf(length2) : Vec3(1.0f, 0.0f, 0.0f);
+	const Vec3 t2       = cross(vh, t1);
+
+	// Uniform disk sample, warped towards the visible half of the projected hemisphere
+	const float r   = sqrtf(random_float());
+	const float phi = 2.0f * pi * random_float();
+	const float p1  = r * cosf(phi);
+	const float s   = 0.5f * (1.0f + vh.z);
+	const float p2  = (1.0f - s) * sqrtf(fmaxf(0.0f, 1.0f - p1 * p1)) + s * r * sinf(phi);
+
+	const Vec3 nh = p1 * t1 + p2 * t2 + sqrtf(fmaxf(0.0f, 1.0f - p1 * p1 - p2 * p2)) * vh;
+
+	// Unstretch
+	return unit_vector(Vec3(fuzz * nh.x, fuzz * nh.y, fmaxf(0.0f, nh.z)));
+}
+
+bool Metal::sample(const Ray& ray_in, const Hit_Record& record, Bsdf_Sample& sample) const
+{
+	const Vec3 unit_direction = unit_vector(ray_in.direction());
+
+	if (is_specular()) {
+		sample.direction = reflect(unit_direction, record.normal);
+		sample.weight    = fresnel(dot(-unit_direction, record.normal));
+		sample.pdf       = 0.0f;
+		return true;
+	}
+
+	const Onb uvw(record.normal);
+	const Vec3 wo = uvw.to_local(-unit_direction);
+	if (wo.z <= 0.0f) return false;
+
+	const Vec3 h  = sample_visible_normal(wo);
+	const Vec3 wi = reflect(-wo, h);
+	if (wi.z <= 0.0f) return false;
+
+	// f * cos / pdf reduces to F * G2 / G1 for visible normal sampling
+	const float g2   = 1.0f / (1.0f + lambda(wo) + lambda(wi));
+	sample.direction = uvw.local(wi);
+	sample.weight    = fresnel(dot(wo, h)) * (g2 / g1(wo));
+	sample.pdf       = g1(wo) * ndf(h) / (4.0f * wo.z);
+	return true;
+}
+
+Color3 Metal::eval(const Ray& ray_in, const Hit_Record& record, const Vec3& direction) const
+{
+	if (is_specular()) return {0.0f, 0.0f, 0.0f};
+
+	const Onb uvw(record.normal);
+	const Vec3 wo = uvw.to_local(-unit_vector(ray_in.direction()));
+	const Vec3 wi = uvw.to_local(unit_vector(direction));
+	if (wo.z <= 0.0f || wi.z <= 0.0f) return {0.0f, 0.0f, 0.0f};
+
+	const Vec3 h   = unit_vector(wo + wi);
+	const float g2 = 1.0f / (1.0f + lambda(wo) + lambda(wi));
+
+	// F D G / (4 cos_o cos_i), times cos_i
+	return fresnel(dot(wo, h)) * (ndf(h) * g2 / (4.0f * wo.z));
+}
+
+float Metal::pdf(const Ray& ray_in, const Hit_Record& record, const Vec3& direction) const
+{
+	if (is_specular()) return 0.0f;
+
+	const Onb uvw(record.normal);
+	const Vec3 wo = uvw.to_local(-unit_vector(ray_in.direction()));
+	const Vec3 wi = uvw.to_local(unit_vector(direction));
+	if (wo.z <= 0.0f || wi.z <= 0.0f) return 0.0f;
+
+	const Vec3 h = unit_vector(wo + wi);
+	return g1(wo) * ndf(h) / (4.0f * wo.z);
+}
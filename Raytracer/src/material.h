@@ -7,15 +7,61 @@
 #include "hittable.h"
 #include "ray.h"
 #include "math/numeric.h"
+#include "math/onb.h"
 #include "math/vec3.h"
 
 struct Hit_Record;
 
+struct Bsdf_Sample {
+	Vec3 direction;
+	Color3 weight = Color3(0.0f, 0.0f, 0.0f); // BSDF * cos / pdf, the factor the incoming radiance is scaled by
+	float pdf     = 0.0f;                     // Solid angle density, zero for specular (delta) lobes
+};
+
 class Material {
 public:
 	virtual ~Material() = default;
 
-	virtual bool scatter(const Ray& ray_in, const Hit_Record& record, Color3& attenuation, Ray& scattered) const = 0;
+	// Picks a direction for light arriving at the hit, false if the path is absorbed
+	virtual bool sample(const Ray& ray_in, const Hit_Record& record, Bsdf_Sample& sample) const = 0;
+
+	// BSDF times cosine for light arriving from direction, only meaningful when not specular
+	virtual Color3 eval(const Ray& ray_in, const Hit_Record& record, const Vec3& direction) const
+	{
+		return {0.0f, 0.0f, 0.0f};
+	}
+
+	// Solid angle density sample() picks direction with, zero for specular (delta) lobes
+	virtual float pdf(const Ray& ray_in, const Hit_Record& record, const Vec3& direction) const
+	{
+		return 0.0f;
+	}
+
+	// Radiance leaving the surface on its own, black for anything that isn't a light
+	virtual Color3 emitted(const Ray& ray_in, const Hit_Record& record) const
+	{
+		return {0.0f, 0.0f, 0.0f};
+	}
+
+	// Specular materials can't be lit by explicit light samples
+	virtual bool is_specular() const { return true; }
+
+	// Overall reflectance color, written to the albedo feature buffer
+	virtual Color3 reflectance(const Hit_Record& record) const
+	{
+		return {1.0f, 1.0f, 1.0f};
+	}
+
+	// sample() in the attenuation / scattered ray form
+	bool scatter(const Ray& ray_in, const Hit_Record& record, Color3& attenuation, Ray& scattered) const
+	{
+		Bsdf_Sample bsdf;
+		if (!sample(ray_in, record, bsdf)) return false;
+
+		attenuation = bsdf.weight;
+		scattered   = Ray(record.p, bsdf.direction);
+		return true;
+	}
 };
 
 
@@ -23,62 +69,83 @@ class Lambertian final : public Material {
 public:
 	explicit Lambertian(const Color3& color) : albedo(color) {}
 
-	bool scatter(const Ray& ray_in, const Hit_Record& record, Color3& attenuation, Ray& scattered) const override
+	// Cosine-weighted hemisphere sampling, so the weight is just the albedo
+	bool sample(const Ray& ray_in, const Hit_Record& record, Bsdf_Sample& sample) const override
 	{
-		auto scatter_direction = record.normal + random_unit_vector();
+		const Onb uvw(record.normal);
+		sample.direction = uvw.local(random_cosine_direction());
+		sample.weight    = albedo;
+		sample.pdf       = fmaxf(dot(record.normal, sample.direction), 0.0f) / pi;
+		return sample.pdf > 0.0f;
+	}
 
-		if (scatter_direction.near_zero()) {
-			scatter_direction = record.normal;
-		}
+	Color3 eval(const Ray& ray_in, const Hit_Record& record, const Vec3& direction) const override
+	{
+		return albedo * pdf(ray_in, record, direction);
+	}
 
-		scattered   = Ray(record.p, scatter_direction);
-		attenuation = albedo;
-		return true;
+	float pdf(const Ray& ray_in, const Hit_Record& record, const Vec3& direction) const override
+	{
+		const float cosine = dot(record.normal, unit_vector(direction));
+		return cosine > 0.0f ? cosine / pi : 0.0f;
 	}
 
+	bool is_specular() const override { return false; }
+
+	Color3 reflectance(const Hit_Record& record) const override { return albedo; }
+
 	Color3 albedo;
 };
 
+// Conductor with a GGX microfacet distribution, sampled through its visible normals (Heitz 2018).
+// Fuzziness is the GGX roughness alpha, zero gives a perfect mirror.
 class Metal : public Material {
 public:
-	Metal(const Color3& color, const float fuzziness) : albedo(color), fuzz(fuzziness) {}
+	Metal(const Color3& color, const float fuzziness) : albedo(color), fuzz(clamp(fuzziness, 0.0f, 1.0f)) {}
 
-	bool scatter(const Ray& ray_in, const Hit_Record& record, Color3& attenuation, Ray& scattered) const override
-	{
-		const Vec3 reflected = reflect(unit_vector(ray_in.direction()), record.normal);
-		scattered            = Ray(record.p, reflected + fuzz * random_in_unit_sphere());
-		attenuation          = albedo;
-		return (dot(scattered.direction(), record.normal) > 0);
-	}
+	bool sample(const Ray& ray_in, const Hit_Record& record, Bsdf_Sample& sample) const override;
+	Color3 eval(const Ray& ray_in, const Hit_Record& record, const Vec3& direction) const override;
+	float pdf(const Ray& ray_in, const Hit_Record& record, const Vec3& direction) const override;
+
+	bool is_specular() const override { return fuzz < min_alpha; }
+
+	Color3 reflectance(const Hit_Record& record) const override { return albedo; }
 
 	Color3 albedo;
 	float fuzz;
+
+private:
+	static constexpr float min_alpha = 1e-3f; // Below this the lobe is treated as a delta
+
+	Color3 fresnel(float cos_theta) const;
+	float ndf(const Vec3& h) const;
+	float lambda(const Vec3& w) const;
+	float g1(const Vec3& w) const { return 1.0f / (1.0f + lambda(w)); }
+	Vec3 sample_visible_normal(const Vec3& wo) const;
 };
 
 class Dielectric : public Material {
 public:
 	explicit Dielectric(const float index_of_refraction) : ir(index_of_refraction) {}
 
-	bool scatter(const Ray& ray_in, const Hit_Record& record, Color3& attenuation, Ray& scattered) const override
+	bool sample(const Ray& ray_in, const Hit_Record& record, Bsdf_Sample& sample) const override
 	{
-		attenuation                  = Color3(1.0f, 1.0f, 1.0f);
 		const float refraction_ratio = record.front_face ? (1.0f / ir) : ir;
 		const Vec3 unit_direction    = unit_vector(ray_in.direction());
 		const float cos_theta        = fmin(dot(-unit_direction, record.normal), 1.0f);
 		const float sin_theta        = sqrtf(1.0f - cos_theta * cos_theta);
 
 		const bool cannot_refract = refraction_ratio * sin_theta > 1.0f;
-		Vec3 direction;
 
 		if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_float()) {
-			direction = reflect(unit_direction, record.normal);
+			sample.direction = reflect(unit_direction, record.normal);
 		}
 		else {
-			direction = refract(unit_direction, record.normal, refraction_ratio);
+			sample.direction = refract(unit_direction, record.normal, refraction_ratio);
 		}
 
-		scattered = Ray(record.p, direction);
-
+		sample.weight = Color3(1.0f, 1.0f, 1.0f);
+		sample.pdf    = 0.0f;
 		return true;
 	}
 
@@ -93,3 +160,20 @@ private:
 		return r0 + (1 - r0) * powf((1 - cosine), 5);
 	}
 };
+
+class Diffuse_Light : public Material {
+public:
+	explicit Diffuse_Light(const Color3& color) : emit(color) {}
+
+	bool sample(const Ray& ray_in, const Hit_Record& record, Bsdf_Sample& sample) const override
+	{
+		return false;
+	}
+
+	Color3 emitted(const Ray& ray_in, const Hit_Record& record) const override
+	{
+		return emit;
+	}
+
+	Color3 emit;
+};
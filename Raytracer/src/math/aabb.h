@@ -0,0 +1,65 @@
+﻿// /*
+//  * aabb.h
+//  */
+
+#pragma once
+
+#include "numeric.h"
+#include "vec3.h"
+
+// Axis-aligned bounding box, empty (inverted) until something is added to it
+class Aabb {
+public:
+	Aabb() : min(infinity, infinity, infinity), max(-infinity, -infinity, -infinity) {}
+	Aabb(const Point3& a, const Point3& b) : min(min_vec(a, b)), max(max_vec(a, b)) {}
+
+	void expand(const Point3& p)
+	{
+		min = min_vec(min, p);
+		max = max_vec(max, p);
+	}
+
+	void expand(const Aabb& box)
+	{
+		min = min_vec(min, box.min);
+		max = max_vec(max, box.max);
+	}
+
+	bool empty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+
+	Point3 center() const { return 0.5f * (min + max); }
+
+	Vec3 diagonal() const { return max - min; }
+
+	bool contains(const Point3& p) const
+	{
+		return p.x >= min.x && p.x <= max.x
+			&& p.y >= min.y && p.y <= max.y
+			&& p.z >= min.z && p.z <= max.z;
+	}
+
+	float surface_area() const
+	{
+		if (empty()) return 0.0f;
+		const Vec3 d = diagonal();
+		return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	// Index (0, 1, 2) of the widest axis
+	int largest_axis() const
+	{
+		const Vec3 d = diagonal();
+		if (d.x > d.y && d.x > d.z) return 0;
+		return d.y > d.z ? 1 : 2;
+	}
+
+	Point3 min;
+	Point3 max;
+};
+
+inline Aabb surrounding_box(const Aabb& a, const Aabb& b)
+{
+	Aabb box = a;
+	box.expand(b);
+	return box;
+}
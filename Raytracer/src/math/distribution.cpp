@@ -0,0 +1,72 @@
+﻿#include "distribution.h"
+
+#include <algorithm>
+
+
+Distribution_1D::Distribution_1D(std::vector<float> function) : func(std::move(function))
+{
+	const auto n = func.size();
+	cdf.resize(n + 1);
+	cdf[0] = 0.0f;
+
+	for (size_t i = 1; i <= n; i++) {
+		cdf[i] = cdf[i - 1] + fabs(func[i - 1]) / static_cast<float>(n);
+	}
+
+	func_int = cdf[n];
+
+	// A function that is zero everywhere is sampled uniformly
+	for (size_t i = 1; i <= n; i++) {
+		cdf[i] = func_int > 0.0f ? cdf[i] / func_int : static_cast<float>(i) / static_cast<float>(n);
+	}
+}
+
+float Distribution_1D::sample_continuous(const float u, float& pdf, int& offset) const
+{
+	// Last CDF entry not above u
+	const auto it = std::upper_bound(cdf.begin(), cdf.end(), u);
+	offset        = clamp(static_cast<int>(it - cdf.begin()) - 1, 0, count() - 1);
+
+	float du = u - cdf[offset];
+	if (cdf[offset + 1] - cdf[offset] > 0.0f) {
+		du /= cdf[offset + 1] - cdf[offset];
+	}
+
+	pdf = func_int > 0.0f ? func[offset] / func_int : 1.0f;
+	return (static_cast<float>(offset) + du) / static_cast<float>(count());
+}
+
+Distribution_2D::Distribution_2D(const std::vector<float>& function, const int width, const int height)
+{
+	conditional.reserve(height);
+	for (int y = 0; y < height; y++) {
+		conditional.emplace_back(std::vector<float>(function.begin() + y * width, function.begin() + (y + 1) * width));
+	}
+
+	std::vector<float> row_integrals(height);
+	for (int y = 0; y < height; y++) {
+		row_integrals[y] = conditional[y].func_int;
+	}
+	marginal = Distribution_1D(std::move(row_integrals));
+}
+
+float Distribution_2D::sample_continuous(const float u0, const float u1, float& u, float& v) const
+{
+	float pdf_v, pdf_u;
+	int row, column;
+
+	v = marginal.sample_continuous(u1, pdf_v, row);
+	u = conditional[row].sample_continuous(u0, pdf_u, column);
+	return pdf_u * pdf_v;
+}
+
+float Distribution_2D::pdf(const float u, const float v) const
+{
+	const int width  = conditional[0].count();
+	const int height = marginal.count();
+	const int column = clamp(static_cast<int>(u * static_cast<float>(width)), 0, width - 1);
+	const int row    = clamp(static_cast<int>(v * static_cast<float>(height)), 0, height - 1);
+
+	if (marginal.func_int <= 0.0f) return 1.0f;
+	return conditional[row].func[column] / marginal.func_int;
+}
@@ -0,0 +1,40 @@
+﻿// /*
+//  * distribution.h
+//  */
+
+#pragma once
+
+#include <vector>
+
+#include "numeric.h"
+
+// Piecewise-constant 1D distribution over [0, 1), sampled by inverting its CDF
+class Distribution_1D {
+public:
+	Distribution_1D() = default;
+	explicit Distribution_1D(std::vector<float> function);
+
+	// Maps u in [0, 1) to a value distributed proportionally to the function, with its density and bucket
+	float sample_continuous(float u, float& pdf, int& offset) const;
+
+	int count() const { return static_cast<int>(func.size()); }
+
+	std::vector<float> func;
+	std::vector<float> cdf;
+	float func_int = 0.0f; // Integral of func over [0, 1)
+};
+
+// Piecewise-constant 2D distribution over [0, 1)^2: a marginal over rows and a conditional per row
+class Distribution_2D {
+public:
+	Distribution_2D() = default;
+	Distribution_2D(const std::vector<float>& function, int width, int height);
+
+	// Maps (u0, u1) to (u, v) distributed proportionally to the function, returns the density over [0, 1)^2
+	float sample_continuous(float u0, float u1, float& u, float& v) const;
+
+	float pdf(float u, float v) const;
+
+	std::vector<Distribution_1D> conditional;
+	Distribution_1D marginal;
+};
@@ -44,12 +44,79 @@ inline float clamp(const float x, const float min, const float max)
 	return x;
 }
 
+inline int clamp(const int x, const int min, const int max)
+{
+	if (x < min) return min;
+	if (x > max) return max;
+	return x;
+}
+
+// Binary formats written by the renderer store little-endian values
+inline bool host_is_little_endian()
+{
+	const uint16_t probe = 1;
+	return *reinterpret_cast<const uint8_t*>(&probe) == 1;
+}
+
+// Multiple importance sampling weight for a sample drawn with pdf_a when pdf_b could also have produced it (Veach's power heuristic, beta = 2)
+inline float power_heuristic(const float pdf_a, const float pdf_b)
+{
+	const float a2 = pdf_a * pdf_a;
+	const float b2 = pdf_b * pdf_b;
+	return a2 > 0.0f ? a2 / (a2 + b2) : 0.0f;
+}
+
 // Random Utilities
 
+// PCG32 generator (O'Neill 2014): small state, fast, and each thread gets its own so there is no contention
+struct Pcg32 {
+	uint64_t state = 0x853c49e6748fea9bULL;
+	uint64_t inc   = 0xda3e39cb94b95bdbULL;
+
+	uint32_t next()
+	{
+		const uint64_t old = state;
+		state              = old * 6364136223846793005ULL + inc;
+		const auto shifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+		const auto rot     = static_cast<uint32_t>(old >> 59u);
+		return (shifted >> rot) | (shifted << ((~rot + 1u) & 31u));
+	}
+
+	void seed(const uint64_t initial_state, const uint64_t sequence = 1)
+	{
+		state = 0;
+		inc   = (sequence << 1u) | 1u;
+		next();
+		state += initial_state;
+		next();
+	}
+};
+
+inline Pcg32& thread_rng()
+{
+	thread_local Pcg32 rng;
+	return rng;
+}
+
+// Mixes two values into a well distributed 64 bit seed (splitmix64 finalizer)
+inline uint64_t hash_seed(const uint64_t a, const uint64_t b)
+{
+	uint64_t z = a * 0x9e3779b97f4a7c15ULL + b + 0x632be59bd9b4e019ULL;
+	z          = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z          = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+// Restarts the calling thread's random sequence, e.g. per tile so images don't depend on scheduling
+inline void seed_random(const uint64_t seed)
+{
+	thread_rng().seed(seed);
+}
+
 // Returns a random real in [0, 1)
 inline float random_float()
 {
-	return static_cast<float>(rand()) / (RAND_MAX + 1.0f);
+	return static_cast<float>(thread_rng().next() >> 8) * (1.0f / 16777216.0f);
 }
 
 
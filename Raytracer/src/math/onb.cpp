@@ -0,0 +1 @@
+﻿#include "onb.h"
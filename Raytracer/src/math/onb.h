@@ -0,0 +1,47 @@
+﻿// /*
+//  * onb.h
+//  */
+
+#pragma once
+
+#include "numeric.h"
+#include "vec3.h"
+
+// Orthonormal basis around a single direction (w), used to move sampled directions between local and world space
+class Onb {
+public:
+	explicit Onb(const Vec3& normal) { build_from_w(normal); }
+
+	// Local (u, v, w) coordinates to world space
+	Vec3 local(const float a, const float b, const float c) const
+	{
+		return a * u + b * v + c * w;
+	}
+
+	Vec3 local(const Vec3& a) const
+	{
+		return local(a.x, a.y, a.z);
+	}
+
+	// World space to local (u, v, w) coordinates
+	Vec3 to_local(const Vec3& a) const
+	{
+		return {dot(a, u), dot(a, v), dot(a, w)};
+	}
+
+	Vec3 u, v, w;
+
+private:
+	void build_from_w(const Vec3& normal)
+	{
+		// Branchless basis construction (Duff et al. 2017), normal must be unit length
+		w = normal;
+
+		const float sign = std::copysign(1.0f, w.z);
+		const float a    = -1.0f / (sign + w.z);
+		const float b    = w.x * w.y * a;
+
+		u = Vec3(1.0f + sign * w.x * w.x * a, sign * b, -sign * w.x);
+		v = Vec3(b, sign + w.y * w.y * a, -w.y);
+	}
+};
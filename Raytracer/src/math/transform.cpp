@@ -0,0 +1,104 @@
+﻿#include "transform.h"
+
+
+Transform Transform::translate(const Vec3& offset)
+{
+	Transform transform;
+	transform.m[0][3] = offset.x;
+	transform.m[1][3] = offset.y;
+	transform.m[2][3] = offset.z;
+	return transform;
+}
+
+Transform Transform::scale(const Vec3& factors)
+{
+	Transform transform;
+	transform.m[0][0] = factors.x;
+	transform.m[1][1] = factors.y;
+	transform.m[2][2] = factors.z;
+	return transform;
+}
+
+Transform Transform::rotate(const Vec3& axis, const float degrees)
+{
+	// Rodrigues' rotation formula
+	const Vec3 a        = unit_vector(axis);
+	const float radians = degrees_to_radians(degrees);
+	const float s       = sinf(radians);
+	const float c       = cosf(radians);
+	const float k       = 1.0f - c;
+
+	Transform transform;
+	transform.m[0][0] = a.x * a.x * k + c;
+	transform.m[0][1] = a.x * a.y * k - a.z * s;
+	transform.m[0][2] = a.x * a.z * k + a.y * s;
+	transform.m[1][0] = a.y * a.x * k + a.z * s;
+	transform.m[1][1] = a.y * a.y * k + c;
+	transform.m[1][2] = a.y * a.z * k - a.x * s;
+	transform.m[2][0] = a.z * a.x * k - a.y * s;
+	transform.m[2][1] = a.z * a.y * k + a.x * s;
+	transform.m[2][2] = a.z * a.z * k + c;
+	return transform;
+}
+
+Transform Transform::operator*(const Transform& other) const
+{
+	Transform product;
+	for (int row = 0; row < 3; row++) {
+		for (int column = 0; column < 4; column++) {
+			product.m[row][column] = m[row][0] * other.m[0][column] + m[row][1] * other.m[1][column] + m[row][2] * other.m[2][column];
+		}
+		product.m[row][3] += m[row][3];
+	}
+	return product;
+}
+
+float Transform::determinant() const
+{
+	return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+		 - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+		 + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+}
+
+Transform Transform::inverse() const
+{
+	// Adjugate over the determinant for the linear part, the translation is undone by it
+	const float inv_det = 1.0f / determinant();
+
+	Transform inverse;
+	inverse.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * inv_det;
+	inverse.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+	inverse.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+	inverse.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * inv_det;
+	inverse.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+	inverse.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+	inverse.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * inv_det;
+	inverse.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+	inverse.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+
+	const Vec3 offset = inverse.vector(Vec3(m[0][3], m[1][3], m[2][3]));
+	inverse.m[0][3]   = -offset.x;
+	inverse.m[1][3]   = -offset.y;
+	inverse.m[2][3]   = -offset.z;
+	return inverse;
+}
+
+Aabb Transform::bounds(const Aabb& box) const
+{
+	if (box.empty()) return box;
+
+	Aabb result;
+	for (int row = 0; row < 3; row++) {
+		float low  = m[row][3];
+		float high = m[row][3];
+		for (int column = 0; column < 3; column++) {
+			const float a = m[row][column] * box.min[column];
+			const float b = m[row][column] * box.max[column];
+			low += fminf(a, b);
+			high += fmaxf(a, b);
+		}
+		result.min[row] = low;
+		result.max[row] = high;
+	}
+	return result;
+}
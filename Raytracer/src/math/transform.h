@@ -0,0 +1,63 @@
+﻿// /*
+//  * transform.h
+//  */
+
+#pragma once
+
+#include "aabb.h"
+#include "numeric.h"
+#include "vec3.h"
+
+// Affine transform, a 3x3 linear part and a translation in the last column: p' = m * p + t. 48 bytes and
+// trivially copyable.
+class Transform {
+public:
+	Transform()
+	{
+		for (int row = 0; row < 3; row++) {
+			for (int column = 0; column < 4; column++) m[row][column] = row == column ? 1.0f : 0.0f;
+		}
+	}
+
+	static Transform translate(const Vec3& offset);
+	static Transform scale(const Vec3& factors);
+
+	// Counter-clockwise looking down the axis, which needn't be unit length
+	static Transform rotate(const Vec3& axis, float degrees);
+
+	// Applies other first, then this
+	Transform operator*(const Transform& other) const;
+
+	float determinant() const;
+
+	// Meaningless for a singular transform, check determinant() first
+	Transform inverse() const;
+
+	Point3 point(const Point3& p) const
+	{
+		return {m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+				m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+				m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]};
+	}
+
+	Vec3 vector(const Vec3& v) const
+	{
+		return {m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+				m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+				m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z};
+	}
+
+	// Normals take the inverse transpose, so call this on the inverse of the transform that moves the surface.
+	// The result isn't normalized.
+	Vec3 normal(const Vec3& n) const
+	{
+		return {m[0][0] * n.x + m[1][0] * n.y + m[2][0] * n.z,
+				m[0][1] * n.x + m[1][1] * n.y + m[2][1] * n.z,
+				m[0][2] * n.x + m[1][2] * n.y + m[2][2] * n.z};
+	}
+
+	// Box around the transformed box, from the extents each column adds (Arvo, Graphics Gems 1990)
+	Aabb bounds(const Aabb& box) const;
+
+	float m[3][4];
+};
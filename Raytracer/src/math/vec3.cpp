@@ -65,6 +65,17 @@ Vec3 random_in_hemisphere(const Vec3& normal)
 	return -in_unit_sphere;
 }
 
+Vec3 random_cosine_direction()
+{
+	// Uniform disk sample projected up onto the hemisphere (Malley's method)
+	const float r1  = random_float();
+	const float r2  = random_float();
+	const float phi = 2.0f * pi * r1;
+	const float r   = sqrtf(r2);
+
+	return {cosf(phi) * r, sinf(phi) * r, sqrtf(1.0f - r2)};
+}
+
 // Convert separate R, G, B values to rgb_t struct
 rgb_t rgb_to_rgb_t(const unsigned char r, const unsigned char g, const unsigned char b)
 {
@@ -168,6 +168,23 @@ inline Vec3 get_normal(Vec3 v)
 	return unit_vector(v);
 }
 
+// Component-wise minimum and maximum
+inline Vec3 min_vec(const Vec3& u, const Vec3& v)
+{
+	return {fminf(u.x, v.x), fminf(u.y, v.y), fminf(u.z, v.z)};
+}
+
+inline Vec3 max_vec(const Vec3& u, const Vec3& v)
+{
+	return {fmaxf(u.x, v.x), fmaxf(u.y, v.y), fmaxf(u.z, v.z)};
+}
+
+// Relative luminance of a linear (Rec. 709) color
+inline float luminance(const Color3& c)
+{
+	return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+}
+
 Vec3 random_in_unit_disk();
 
 Vec3 reflect(const Vec3& vec, const Vec3& normal);
@@ -180,6 +197,9 @@ Vec3 random_unit_vector();
 
 Vec3 random_in_hemisphere(const Vec3& normal);
 
+// Cosine-weighted direction in the hemisphere around +z, density cos(theta) / pi
+Vec3 random_cosine_direction();
+
 rgb_t get_color(Color3 pixel_color, int samples_per_pixel);
 
 // Convert separate R, G, B values to rgb_t struct
@@ -0,0 +1,1112 @@
+﻿#include "mesh_file.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "mapped_file.h"
+#include "parallel.h"
+#include "trace.h"
+#include "math/numeric.h"
+
+
+static constexpr ptrdiff_t chunk_bytes = 4 << 20;    // Text handed to one parse task
+static constexpr size_t block_count    = 1 << 16;    // Vertices or faces per task when copying binary data
+static constexpr uint32_t no_index     = 0xffffffffu;
+
+static_assert(sizeof(Point3) == 3 * sizeof(float), "positions are copied as packed floats");
+
+static bool has_extension(const std::string& path, const char* extension)
+{
+	const auto n = strlen(extension);
+	if (path.size() < n) return false;
+
+	for (size_t i = 0; i < n; i++) {
+		if (tolower(path[path.size() - n + i]) != extension[i]) return false;
+	}
+	return true;
+}
+
+static int line_number(const char* begin, const char* at)
+{
+	return 1 + static_cast<int>(std::count(begin, at, '\n'));
+}
+
+// Text
+
+static bool is_blank(const char c) { return c == ' ' || c == '\t' || c == '\r'; }
+static bool is_digit(const char c) { return c >= '0' && c <= '9'; }
+
+static void skip_line(const char*& cursor, const char* end)
+{
+	const void* newline = memchr(cursor, '\n', static_cast<size_t>(end - cursor));
+	cursor              = newline ? static_cast<const char*>(newline) + 1 : end;
+}
+
+static bool at_token_end(const char* cursor, const char* end)
+{
+	return cursor >= end || is_blank(*cursor) || *cursor == '\n' || *cursor == '#';
+}
+
+// Skips blanks, true when another token follows on the line
+static bool next_token(const char*& cursor, const char* end)
+{
+	while (cursor < end && is_blank(*cursor)) cursor++;
+	return cursor < end && *cursor != '\n' && *cursor != '#';
+}
+
+// Decimal with optional fraction and exponent. The first 19 significant digits are kept and scaled once, which
+// rounds far below float precision, and the cursor never goes past end, so mapped text needs no terminator.
+static bool parse_float(const char*& cursor, const char* end, float& value)
+{
+	static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+									1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+	const char* p       = cursor;
+	const bool negative = p < end && *p == '-';
+	if (p < end && (*p == '-' || *p == '+')) p++;
+
+	uint64_t mantissa = 0;
+	int significant   = 0;
+	int exponent      = 0;
+	bool digits       = false;
+
+	for (; p < end && is_digit(*p); p++) {
+		digits = true;
+		if (significant < 19) {
+			mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+			significant += mantissa != 0 ? 1 : 0;
+		}
+		else {
+			exponent++;
+		}
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && is_digit(*p); p++) {
+			digits = true;
+			if (significant < 19) {
+				mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+				significant += mantissa != 0 ? 1 : 0;
+				exponent--;
+			}
+		}
+	}
+	if (!digits) return false;
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* q                = p + 1;
+		const bool negative_exponent = q < end && *q == '-';
+		if (q < end && (*q == '-' || *q == '+')) q++;
+
+		if (q < end && is_digit(*q)) {
+			int e = 0;
+			for (; q < end && is_digit(*q); q++) e = std::min(e * 10 + (*q - '0'), 10000);
+			exponent += negative_exponent ? -e : e;
+			p = q;
+		}
+	}
+
+	double result = static_cast<double>(mantissa);
+	if (mantissa != 0 && exponent != 0) {
+		if (exponent > 0 && exponent <= 22) result *= powers[exponent];
+		else if (exponent < 0 && exponent >= -22) result /= powers[-exponent];
+		else result *= std::pow(10.0, exponent);
+	}
+
+	value  = static_cast<float>(negative ? -result : result);
+	cursor = p;
+	return true;
+}
+
+static bool parse_int(const char*& cursor, const char* end, int64_t& value)
+{
+	const char* p       = cursor;
+	const bool negative = p < end && *p == '-';
+	if (p < end && (*p == '-' || *p == '+')) p++;
+	if (p >= end || !is_digit(*p)) return false;
+
+	int64_t result = 0;
+	for (; p < end && is_digit(*p); p++) {
+		result = std::min<int64_t>(result * 10 + (*p - '0'), INT64_C(1) << 40);
+	}
+
+	value  = negative ? -result : result;
+	cursor = p;
+	return true;
+}
+
+// A whole blank-separated number
+static bool read_float(const char*& cursor, const char* end, float& value)
+{
+	return next_token(cursor, end) && parse_float(cursor, end, value) && at_token_end(cursor, end);
+}
+
+static bool read_int(const char*& cursor, const char* end, int64_t& value)
+{
+	return next_token(cursor, end) && parse_int(cursor, end, value) && at_token_end(cursor, end);
+}
+
+// A range of whole lines, and what parsing it found
+struct Text_Chunk {
+	const char* begin;
+	const char* end;
+
+	const char* error_at = nullptr; // Line of the first error
+	const char* error    = nullptr;
+
+	bool fail(const char* line, const char* message)
+	{
+		error_at = line;
+		error    = message;
+		return false;
+	}
+};
+
+// Pieces of about chunk_bytes, each ending after a newline
+static std::vector<Text_Chunk> split_lines(const char* begin, const char* end)
+{
+	std::vector<Text_Chunk> chunks;
+	const char* cursor = begin;
+
+	while (cursor < end) {
+		const char* split = end - cursor > chunk_bytes ? cursor + chunk_bytes : end;
+		if (split < end) skip_line(split, end);
+		chunks.push_back({cursor, split});
+		cursor = split;
+	}
+	return chunks;
+}
+
+// Reports the first chunk's error, chunks are in file order
+static bool check_chunks(const std::vector<Text_Chunk>& chunks, const char* file_begin, const char* function, const std::string& path)
+{
+	for (const auto& chunk : chunks) {
+		if (!chunk.error) continue;
+		std::cerr << function << " - Error: " << path << ':' << line_number(file_begin, chunk.error_at) << ": " << chunk.error << '\n';
+		return false;
+	}
+	return true;
+}
+
+// OBJ
+
+enum class Obj_Line {
+	Other,
+	Position,
+	Uv,
+	Normal,
+	Face,
+};
+
+struct Obj_Corner {
+	uint32_t position;
+	uint32_t uv;     // no_index when the corner has none
+	uint32_t normal;
+};
+
+// Element counts of a chunk, then the index of its first element of each kind once they're summed
+struct Obj_Counts {
+	size_t positions = 0;
+	size_t uvs       = 0;
+	size_t normals   = 0;
+	size_t triangles = 0;
+};
+
+// Reads the keyword starting a line
+static Obj_Line obj_keyword(const char*& cursor, const char* end)
+{
+	if (!next_token(cursor, end)) return Obj_Line::Other;
+
+	const char* start = cursor;
+	while (!at_token_end(cursor, end)) cursor++;
+
+	const ptrdiff_t length = cursor - start;
+	if (length == 1 && start[0] == 'v') return Obj_Line::Position;
+	if (length == 1 && start[0] == 'f') return Obj_Line::Face;
+	if (length == 2 && start[0] == 'v' && start[1] == 't') return Obj_Line::Uv;
+	if (length == 2 && start[0] == 'v' && start[1] == 'n') return Obj_Line::Normal;
+	return Obj_Line::Other;
+}
+
+// OBJ indices count from one, negative ones back from the last element so far
+static bool resolve_index(const int64_t index, const size_t count, uint32_t& resolved)
+{
+	const int64_t zero_based = index > 0 ? index - 1 : static_cast<int64_t>(count) + index;
+	if (index == 0 || zero_based < 0 || zero_based >= no_index) return false;
+
+	resolved = static_cast<uint32_t>(zero_based);
+	return true;
+}
+
+// v, v/t, v//n or v/t/n
+static bool parse_corner(const char*& cursor, const char* end, const Obj_Counts& seen, Obj_Corner& corner)
+{
+	int64_t index;
+	corner.uv     = no_index;
+	corner.normal = no_index;
+
+	if (!parse_int(cursor, end, index) || !resolve_index(index, seen.positions, corner.position)) return false;
+	if (cursor < end && *cursor == '/') {
+		cursor++;
+		if (cursor < end && *cursor != '/' && (!parse_int(cursor, end, index) || !resolve_index(index, seen.uvs, corner.uv))) return false;
+		if (cursor < end && *cursor == '/') {
+			cursor++;
+			if (!parse_int(cursor, end, index) || !resolve_index(index, seen.normals, corner.normal)) return false;
+		}
+	}
+	return at_token_end(cursor, end);
+}
+
+static Obj_Counts count_obj(const Text_Chunk& chunk)
+{
+	Obj_Counts counts;
+	const char* cursor = chunk.begin;
+
+	while (cursor < chunk.end) {
+		switch (obj_keyword(cursor, chunk.end)) {
+			case Obj_Line::Position: counts.positions++; break;
+			case Obj_Line::Uv: counts.uvs++; break;
+			case Obj_Line::Normal: counts.normals++; break;
+			case Obj_Line::Face: {
+				size_t corners = 0;
+				while (next_token(cursor, chunk.end)) {
+					corners++;
+					while (!at_token_end(cursor, chunk.end)) cursor++;
+				}
+				counts.triangles += corners > 2 ? corners - 2 : 0;
+				break;
+			}
+			case Obj_Line::Other: break;
+		}
+		skip_line(cursor, chunk.end);
+	}
+	return counts;
+}
+
+// Fills the chunk's slots of the arrays, seen starts at the chunk's first index of each kind
+static bool parse_obj(Text_Chunk& chunk, Obj_Counts seen, std::vector<Point3>& positions, std::vector<float>& uvs,
+					  std::vector<Vec3>& normals, std::vector<Obj_Corner>& corners)
+{
+	size_t corner      = seen.triangles * 3;
+	const char* end    = chunk.end;
+	const char* cursor = chunk.begin;
+
+	while (cursor < end) {
+		const char* line = cursor;
+
+		switch (obj_keyword(cursor, end)) {
+			case Obj_Line::Position: {
+				Point3& p = positions[seen.positions++];
+				if (!read_float(cursor, end, p.x) || !read_float(cursor, end, p.y) || !read_float(cursor, end, p.z)) {
+					return chunk.fail(line, "expected a number");
+				}
+				break;
+			}
+			case Obj_Line::Uv: {
+				float* uv = &uvs[2 * seen.uvs++];
+				uv[1]     = 0.0f;
+				if (!read_float(cursor, end, uv[0]) || (next_token(cursor, end) && !read_float(cursor, end, uv[1]))) {
+					return chunk.fail(line, "expected a number");
+				}
+				break;
+			}
+			case Obj_Line::Normal: {
+				Vec3& n = normals[seen.normals++];
+				if (!read_float(cursor, end, n.x) || !read_float(cursor, end, n.y) || !read_float(cursor, end, n.z)) {
+					return chunk.fail(line, "expected a number");
+				}
+				break;
+			}
+			case Obj_Line::Face: {
+				// Fanned around the first corner
+				Obj_Corner first_corner = {};
+				Obj_Corner previous     = {};
+				Obj_Corner current;
+				int count = 0;
+
+				while (next_token(cursor, end)) {
+					if (!parse_corner(cursor, end, seen, current)) return chunk.fail(line, "invalid face corner");
+
+					if (count == 0) first_corner = current;
+					if (count >= 2) {
+						corners[corner++] = first_corner;
+						corners[corner++] = previous;
+						corners[corner++] = current;
+					}
+					previous = current;
+					count++;
+				}
+				if (count < 3) return chunk.fail(line, "faces need at least three corners");
+				break;
+			}
+			case Obj_Line::Other: break;
+		}
+		skip_line(cursor, end);
+	}
+	return true;
+}
+
+// Corner index checks and what kind of vertices the corners need, per block of corners
+struct Obj_Corner_Summary {
+	bool valid   = true;
+	bool uvs     = false; // Some corner has a uv
+	bool normals = false;
+	bool shared  = true;  // Every uv and normal index equals the position index, so the arrays line up already
+};
+
+// One vertex per distinct position/uv/normal triple
+static bool build_obj_mesh(std::vector<Point3>& positions, std::vector<float>& uvs, std::vector<Vec3>& normals,
+						   const std::vector<Obj_Corner>& corners, Mesh_Data& mesh, const unsigned thread_count, const std::string& path)
+{
+	const int blocks = static_cast<int>((corners.size() + block_count - 1) / block_count);
+	std::vector<Obj_Corner_Summary> summaries(static_cast<size_t>(blocks));
+
+	parallel_for(blocks, [&](const int block) {
+		Obj_Corner_Summary& summary = summaries[static_cast<size_t>(block)];
+		const size_t last           = std::min(corners.size(), (static_cast<size_t>(block) + 1) * block_count);
+
+		for (size_t i = static_cast<size_t>(block) * block_count; i < last; i++) {
+			const Obj_Corner& c = corners[i];
+			summary.valid       = summary.valid && c.position < positions.size() && (c.uv == no_index || c.uv < uvs.size() / 2) &&
+							(c.normal == no_index || c.normal < normals.size());
+			summary.uvs         = summary.uvs || c.uv != no_index;
+			summary.normals     = summary.normals || c.normal != no_index;
+			summary.shared      = summary.shared && (c.uv == no_index || c.uv == c.position) && (c.normal == no_index || c.normal == c.position);
+		}
+	}, thread_count);
+
+	Obj_Corner_Summary total;
+	for (const auto& summary : summaries) {
+		total.valid   = total.valid && summary.valid;
+		total.uvs     = total.uvs || summary.uvs;
+		total.normals = total.normals || summary.normals;
+		total.shared  = total.shared && summary.shared;
+	}
+	if (!total.valid) {
+		std::cerr << "load_obj() - Error: " << path << " has a face referring to a vertex that doesn't exist\n";
+		return false;
+	}
+
+	mesh.indices.resize(corners.size());
+	total.shared = total.shared && (!total.uvs || uvs.size() == 2 * positions.size()) && (!total.normals || normals.size() == positions.size());
+
+	if (total.shared) {
+		parallel_for(blocks, [&](const int block) {
+			const size_t last = std::min(corners.size(), (static_cast<size_t>(block) + 1) * block_count);
+			for (size_t i = static_cast<size_t>(block) * block_count; i < last; i++) {
+				mesh.indices[i] = corners[i].position;
+			}
+		}, thread_count);
+
+		mesh.positions = std::move(positions);
+		if (total.uvs) mesh.uvs = std::move(uvs);
+		if (total.normals) mesh.normals = std::move(normals);
+		return true;
+	}
+
+	// Each position keeps a list of the vertices made from it, almost always one or two long
+	std::vector<uint32_t> first_variant(positions.size(), no_index);
+	std::vector<uint32_t> next_variant;
+	std::vector<Obj_Corner> vertices;
+	next_variant.reserve(positions.size());
+	vertices.reserve(positions.size());
+
+	for (size_t i = 0; i < corners.size(); i++) {
+		const Obj_Corner& c = corners[i];
+
+		uint32_t vertex = first_variant[c.position];
+		while (vertex != no_index && (vertices[vertex].uv != c.uv || vertices[vertex].normal != c.normal)) {
+			vertex = next_variant[vertex];
+		}
+
+		if (vertex == no_index) {
+			if (vertices.size() >= no_index) {
+				std::cerr << "load_obj() - Error: " << path << " has more vertices than 32-bit indices can address\n";
+				return false;
+			}
+			vertex = static_cast<uint32_t>(vertices.size());
+			vertices.push_back(c);
+			next_variant.push_back(first_variant[c.position]);
+			first_variant[c.position] = vertex;
+		}
+		mesh.indices[i] = vertex;
+	}
+
+	// Corners without a uv or normal get zeros
+	mesh.positions.resize(vertices.size());
+	if (total.uvs) mesh.uvs.resize(2 * vertices.size());
+	if (total.normals) mesh.normals.resize(vertices.size());
+
+	const int vertex_blocks = static_cast<int>((vertices.size() + block_count - 1) / block_count);
+	parallel_for(vertex_blocks, [&](const int block) {
+		const size_t last = std::min(vertices.size(), (static_cast<size_t>(block) + 1) * block_count);
+		for (size_t v = static_cast<size_t>(block) * block_count; v < last; v++) {
+			const Obj_Corner& c = vertices[v];
+			mesh.positions[v]   = positions[c.position];
+			if (total.uvs && c.uv != no_index) {
+				mesh.uvs[2 * v]     = uvs[2 * c.uv];
+				mesh.uvs[2 * v + 1] = uvs[2 * c.uv + 1];
+			}
+			if (total.normals && c.normal != no_index) mesh.normals[v] = normals[c.normal];
+		}
+	}, thread_count);
+
+	return true;
+}
+
+bool load_obj(const std::string& path, Mesh_Data& mesh, const unsigned thread_count)
+{
+	Mapped_File file;
+	if (!file.open_read(path)) return false;
+
+	const char* begin = reinterpret_cast<const char*>(file.data());
+	const char* end   = begin + file.size();
+	auto chunks       = split_lines(begin, end);
+	const int count   = static_cast<int>(chunks.size());
+
+	// Count every chunk's elements, so the second pass knows where its output goes and what negative indices mean
+	std::vector<Obj_Counts> firsts(chunks.size());
+	parallel_for(count, [&](const int i) { firsts[static_cast<size_t>(i)] = count_obj(chunks[static_cast<size_t>(i)]); }, thread_count);
+
+	Obj_Counts total;
+	for (auto& first : firsts) {
+		const Obj_Counts counts = first;
+		first                   = total;
+		total.positions += counts.positions;
+		total.uvs += counts.uvs;
+		total.normals += counts.normals;
+		total.triangles += counts.triangles;
+	}
+
+	std::vector<Point3> positions(total.positions);
+	std::vector<float> uvs(2 * total.uvs);
+	std::vector<Vec3> normals(total.normals);
+	std::vector<Obj_Corner> corners(3 * total.triangles);
+
+	parallel_for(count, [&](const int i) {
+		parse_obj(chunks[static_cast<size_t>(i)], firsts[static_cast<size_t>(i)], positions, uvs, normals, corners);
+	}, thread_count);
+
+	if (!check_chunks(chunks, begin, "load_obj()", path)) return false;
+
+	mesh = Mesh_Data();
+	return build_obj_mesh(positions, uvs, normals, corners, mesh, thread_count, path);
+}
+
+// PLY
+
+enum class Ply_Format {
+	Ascii,
+	Binary_Little_Endian,
+	Binary_Big_Endian,
+};
+
+enum class Ply_Type {
+	None,
+	Int8,
+	Uint8,
+	Int16,
+	Uint16,
+	Int32,
+	Uint32,
+	Float32,
+	Float64,
+};
+
+struct Ply_Property {
+	std::string name;
+	Ply_Type type       = Ply_Type::None; // Of the values, or of a list's entries
+	Ply_Type count_type = Ply_Type::None; // A list's length, None for single values
+	size_t offset       = 0;              // In a record of single values
+};
+
+struct Ply_Element {
+	std::string name;
+	uint64_t count = 0;
+	std::vector<Ply_Property> properties;
+	size_t stride = 0; // Bytes per record, zero when a list makes them vary
+};
+
+struct Ply_Header {
+	Ply_Format format = Ply_Format::Ascii;
+	std::vector<Ply_Element> elements;
+	size_t data_offset = 0;
+};
+
+// Vertex properties the mesh takes, in Mesh_Data order
+enum Ply_Field { Field_X, Field_Y, Field_Z, Field_Nx, Field_Ny, Field_Nz, Field_U, Field_V, Field_Count };
+
+static const char* const field_names[Field_Count][3] = {
+	{"x"}, {"y"}, {"z"}, {"nx"}, {"ny"}, {"nz"}, {"u", "s", "texture_u"}, {"v", "t", "texture_v"},
+};
+
+static Ply_Type ply_type(const std::string& name)
+{
+	if (name == "char" || name == "int8") return Ply_Type::Int8;
+	if (name == "uchar" || name == "uint8") return Ply_Type::Uint8;
+	if (name == "short" || name == "int16") return Ply_Type::Int16;
+	if (name == "ushort" || name == "uint16") return Ply_Type::Uint16;
+	if (name == "int" || name == "int32") return Ply_Type::Int32;
+	if (name == "uint" || name == "uint32") return Ply_Type::Uint32;
+	if (name == "float" || name == "float32") return Ply_Type::Float32;
+	if (name == "double" || name == "float64") return Ply_Type::Float64;
+	return Ply_Type::None;
+}
+
+static size_t ply_type_size(const Ply_Type type)
+{
+	switch (type) {
+		case Ply_Type::Int8:
+		case Ply_Type::Uint8: return 1;
+		case Ply_Type::Int16:
+		case Ply_Type::Uint16: return 2;
+		case Ply_Type::Int32:
+		case Ply_Type::Uint32:
+		case Ply_Type::Float32: return 4;
+		case Ply_Type::Float64: return 8;
+		default: return 0;
+	}
+}
+
+// One binary value, swapping bytes for files in the other byte order
+static double ply_value(const uint8_t* data, const Ply_Type type, const bool swap)
+{
+	uint8_t bytes[8];
+	const size_t size = ply_type_size(type);
+	for (size_t i = 0; i < size; i++) bytes[i] = data[swap ? size - 1 - i : i];
+
+	switch (type) {
+		case Ply_Type::Int8: return static_cast<int8_t>(bytes[0]);
+		case Ply_Type::Uint8: return bytes[0];
+		case Ply_Type::Int16: { int16_t v; memcpy(&v, bytes, sizeof(v)); return v; }
+		case Ply_Type::Uint16: { uint16_t v; memcpy(&v, bytes, sizeof(v)); return v; }
+		case Ply_Type::Int32: { int32_t v; memcpy(&v, bytes, sizeof(v)); return v; }
+		case Ply_Type::Uint32: { uint32_t v; memcpy(&v, bytes, sizeof(v)); return v; }
+		case Ply_Type::Float32: { float v; memcpy(&v, bytes, sizeof(v)); return v; }
+		case Ply_Type::Float64: { double v; memcpy(&v, bytes, sizeof(v)); return v; }
+		default: return 0.0;
+	}
+}
+
+static bool ply_error(const std::string& path, const std::string& message)
+{
+	std::cerr << "load_ply() - Error: " << path << ": " << message << '\n';
+	return false;
+}
+
+static bool parse_ply_header(const char* begin, const char* end, Ply_Header& header, const std::string& path)
+{
+	const char* cursor = begin;
+	bool has_format    = false;
+	std::vector<std::string> words;
+
+	for (int line = 1; cursor < end; line++) {
+		// Split the line into words
+		const char* line_end = cursor;
+		skip_line(line_end, end);
+		words.clear();
+		while (next_token(cursor, line_end)) {
+			const char* start = cursor;
+			while (cursor < line_end && !is_blank(*cursor) && *cursor != '\n') cursor++;
+			words.emplace_back(start, cursor);
+		}
+		cursor = line_end;
+
+		const std::string at = "line " + std::to_string(line) + ": ";
+		if (line == 1) {
+			if (words.size() != 1 || words[0] != "ply") return ply_error(path, "not a PLY file");
+			continue;
+		}
+		if (words.empty() || words[0] == "comment" || words[0] == "obj_info") continue;
+
+		if (words[0] == "format" && words.size() == 3) {
+			if (words[1] == "ascii") header.format = Ply_Format::Ascii;
+			else if (words[1] == "binary_little_endian") header.format = Ply_Format::Binary_Little_Endian;
+			else if (words[1] == "binary_big_endian") header.format = Ply_Format::Binary_Big_Endian;
+			else return ply_error(path, at + "unknown format '" + words[1] + "'");
+			has_format = true;
+		}
+		else if (words[0] == "element" && words.size() == 3) {
+			Ply_Element element;
+			element.name  = words[1];
+			element.count = strtoull(words[2].c_str(), nullptr, 10);
+			header.elements.push_back(element);
+		}
+		else if (words[0] == "property" && !header.elements.empty() && (words.size() == 3 || (words.size() == 5 && words[1] == "list"))) {
+			Ply_Element& element = header.elements.back();
+			Ply_Property property;
+			property.name   = words.back();
+			property.type   = ply_type(words[words.size() - 2]);
+			property.offset = element.stride;
+			if (words.size() == 5) property.count_type = ply_type(words[2]);
+
+			if (property.type == Ply_Type::None || (words.size() == 5 && property.count_type == Ply_Type::None)) {
+				return ply_error(path, at + "unknown property type");
+			}
+			element.stride = property.count_type == Ply_Type::None && (element.properties.empty() || element.stride > 0)
+				? element.stride + ply_type_size(property.type) : 0;
+			element.properties.push_back(property);
+		}
+		else if (words[0] == "end_header") {
+			if (!has_format) return ply_error(path, "the header has no format line");
+			header.data_offset = static_cast<size_t>(cursor - begin);
+			return true;
+		}
+		else {
+			return ply_error(path, at + "unexpected '" + words[0] + "' in the header");
+		}
+	}
+	return ply_error(path, "the header has no end_header line");
+}
+
+// Where the vertex element keeps each Ply_Field, -1 when it doesn't
+struct Ply_Vertex_Layout {
+	int fields[Field_Count];
+	bool normals;
+	bool uvs;
+};
+
+static bool ply_vertex_layout(const Ply_Element& vertex, Ply_Vertex_Layout& layout, const std::string& path)
+{
+	for (int field = 0; field < Field_Count; field++) {
+		layout.fields[field] = -1;
+		for (size_t p = 0; p < vertex.properties.size(); p++) {
+			for (const char* name : field_names[field]) {
+				if (name && vertex.properties[p].name == name && layout.fields[field] < 0) layout.fields[field] = static_cast<int>(p);
+			}
+		}
+	}
+	for (const auto& property : vertex.properties) {
+		if (property.count_type != Ply_Type::None) return ply_error(path, "list properties on vertices aren't supported");
+	}
+	if (layout.fields[Field_X] < 0 || layout.fields[Field_Y] < 0 || layout.fields[Field_Z] < 0) {
+		return ply_error(path, "vertices need x, y and z");
+	}
+
+	layout.normals = layout.fields[Field_Nx] >= 0 && layout.fields[Field_Ny] >= 0 && layout.fields[Field_Nz] >= 0;
+	layout.uvs     = layout.fields[Field_U] >= 0 && layout.fields[Field_V] >= 0;
+	return true;
+}
+
+static int ply_index_property(const Ply_Element& face)
+{
+	for (size_t p = 0; p < face.properties.size(); p++) {
+		const Ply_Property& property = face.properties[p];
+		if ((property.name == "vertex_indices" || property.name == "vertex_index") && property.count_type != Ply_Type::None) {
+			return static_cast<int>(p);
+		}
+	}
+	return -1;
+}
+
+static void resize_vertices(Mesh_Data& mesh, const Ply_Vertex_Layout& layout, const size_t count)
+{
+	mesh.positions.resize(count);
+	if (layout.normals) mesh.normals.resize(count);
+	if (layout.uvs) mesh.uvs.resize(2 * count);
+}
+
+static void store_field(Mesh_Data& mesh, const size_t vertex, const int field, const float value)
+{
+	if (field <= Field_Z) mesh.positions[vertex].e[field] = value;
+	else if (field <= Field_Nz) mesh.normals[vertex].e[field - Field_Nx] = value;
+	else mesh.uvs[2 * vertex + static_cast<size_t>(field - Field_U)] = value;
+}
+
+// Fixed-size vertex records, copied in blocks on all threads
+static void copy_binary_vertices(const uint8_t* data, const Ply_Element& vertex, const Ply_Vertex_Layout& layout, const bool swap,
+								 Mesh_Data& mesh, const unsigned thread_count)
+{
+	const size_t count = static_cast<size_t>(vertex.count);
+	resize_vertices(mesh, layout, count);
+
+	// Nothing but float x y z: the records are the position array
+	const auto is_float = [&](const int field) { return vertex.properties[static_cast<size_t>(layout.fields[field])].type == Ply_Type::Float32; };
+	if (!swap && vertex.stride == sizeof(Point3) && !layout.normals && !layout.uvs && is_float(Field_X) && is_float(Field_Y) &&
+		is_float(Field_Z) && layout.fields[Field_X] == 0 && layout.fields[Field_Y] == 1 && layout.fields[Field_Z] == 2) {
+		memcpy(mesh.positions.data(), data, count * sizeof(Point3));
+		return;
+	}
+
+	const int blocks = static_cast<int>((count + block_count - 1) / block_count);
+	parallel_for(blocks, [&](const int block) {
+		const size_t last = std::min(count, (static_cast<size_t>(block) + 1) * block_count);
+
+		for (int field = 0; field < Field_Count; field++) {
+			const int index = layout.fields[field];
+			if (index < 0 || (field >= Field_Nx && field <= Field_Nz && !layout.normals) || (field >= Field_U && !layout.uvs)) continue;
+
+			const Ply_Property& property = vertex.properties[static_cast<size_t>(index)];
+			const uint8_t* record        = data + static_cast<size_t>(block) * block_count * vertex.stride + property.offset;
+
+			if (!swap && property.type == Ply_Type::Float32) {
+				for (size_t v = static_cast<size_t>(block) * block_count; v < last; v++, record += vertex.stride) {
+					float value;
+					memcpy(&value, record, sizeof(value));
+					store_field(mesh, v, field, value);
+				}
+			}
+			else {
+				for (size_t v = static_cast<size_t>(block) * block_count; v < last; v++, record += vertex.stride) {
+					store_field(mesh, v, field, static_cast<float>(ply_value(record, property.type, swap)));
+				}
+			}
+		}
+	}, thread_count);
+}
+
+// Faces whose records are a one-byte count of 3 and three 32-bit indices in the host's order, which is all an
+// all-triangle mesh has. False as soon as a face doesn't fit, the caller then reads them one by one
+static bool copy_binary_triangles(const uint8_t* data, const uint8_t* end, const Ply_Element& face, const bool swap,
+								  Mesh_Data& mesh, const unsigned thread_count)
+{
+	const Ply_Property& list   = face.properties[0];
+	constexpr size_t record    = 1 + 3 * sizeof(uint32_t);
+	const size_t count         = static_cast<size_t>(face.count);
+	if (swap || face.properties.size() != 1 || ply_type_size(list.count_type) != 1 || ply_type_size(list.type) != 4 ||
+		static_cast<uint64_t>(end - data) < count * record) {
+		return false;
+	}
+
+	mesh.indices.resize(3 * count);
+	const int blocks = static_cast<int>((count + block_count - 1) / block_count);
+	std::vector<char> fits(static_cast<size_t>(blocks), 1);
+
+	parallel_for(blocks, [&](const int block) {
+		const size_t last = std::min(count, (static_cast<size_t>(block) + 1) * block_count);
+		for (size_t f = static_cast<size_t>(block) * block_count; f < last; f++) {
+			const uint8_t* face_data = data + f * record;
+			if (face_data[0] != 3) {
+				fits[static_cast<size_t>(block)] = 0;
+				return;
+			}
+			memcpy(&mesh.indices[3 * f], face_data + 1, 3 * sizeof(uint32_t));
+		}
+	}, thread_count);
+
+	return std::find(fits.begin(), fits.end(), 0) == fits.end();
+}
+
+// Walks records of any layout, fanning the index lists of faces into triangles when indices is given
+static bool read_binary_element(const uint8_t*& cursor, const uint8_t* end, const Ply_Element& element, const int index_property,
+								const bool swap, std::vector<uint32_t>* indices)
+{
+	std::vector<uint32_t> polygon;
+
+	for (uint64_t r = 0; r < element.count; r++) {
+		for (size_t p = 0; p < element.properties.size(); p++) {
+			const Ply_Property& property = element.properties[p];
+			const size_t size            = ply_type_size(property.type);
+
+			if (property.count_type == Ply_Type::None) {
+				if (static_cast<size_t>(end - cursor) < size) return false;
+				cursor += size;
+				continue;
+			}
+
+			const size_t count_size = ply_type_size(property.count_type);
+			if (static_cast<size_t>(end - cursor) < count_size) return false;
+			const double length = ply_value(cursor, property.count_type, swap);
+			cursor += count_size;
+
+			const size_t count = length > 0.0 ? static_cast<size_t>(length) : 0;
+			if (static_cast<size_t>(end - cursor) / size < count) return false;
+
+			if (indices && static_cast<int>(p) == index_property) {
+				polygon.resize(count);
+				for (size_t i = 0; i < count; i++) {
+					polygon[i] = static_cast<uint32_t>(static_cast<int64_t>(ply_value(cursor + i * size, property.type, swap)));
+				}
+				for (size_t i = 2; i < count; i++) {
+					indices->push_back(polygon[0]);
+					indices->push_back(polygon[i - 1]);
+					indices->push_back(polygon[i]);
+				}
+			}
+			cursor += count * size;
+		}
+	}
+	return true;
+}
+
+static bool load_ply_binary(const uint8_t* begin, const uint8_t* end, const Ply_Header& header, Mesh_Data& mesh,
+							const unsigned thread_count, const std::string& path)
+{
+	const bool file_little_endian = header.format == Ply_Format::Binary_Little_Endian;
+	const bool swap               = file_little_endian != host_is_little_endian();
+	const uint8_t* cursor         = begin + header.data_offset;
+
+	for (const auto& element : header.elements) {
+		if (element.name == "vertex") {
+			Ply_Vertex_Layout layout;
+			if (!ply_vertex_layout(element, layout, path)) return false;
+			if (static_cast<uint64_t>(end - cursor) / element.stride < element.count) return ply_error(path, "the vertices are truncated");
+
+			copy_binary_vertices(cursor, element, layout, swap, mesh, thread_count);
+			cursor += element.count * element.stride;
+		}
+		else if (element.name == "face") {
+			const int index_property = ply_index_property(element);
+			if (index_property < 0) return ply_error(path, "faces have no vertex_indices list");
+
+			const uint8_t* faces = cursor;
+			if (copy_binary_triangles(faces, end, element, swap, mesh, thread_count)) {
+				cursor += element.count * (1 + 3 * sizeof(uint32_t));
+				continue;
+			}
+
+			cursor = faces;
+			mesh.indices.clear();
+			mesh.indices.reserve(3 * static_cast<size_t>(element.count));
+			if (!read_binary_element(cursor, end, element, index_property, swap, &mesh.indices)) return ply_error(path, "the faces are truncated");
+		}
+		else if (element.stride > 0) {
+			if (static_cast<uint64_t>(end - cursor) / element.stride < element.count) return ply_error(path, "'" + element.name + "' is truncated");
+			cursor += element.count * element.stride;
+		}
+		else if (!read_binary_element(cursor, end, element, -1, swap, nullptr)) {
+			return ply_error(path, "'" + element.name + "' is truncated");
+		}
+	}
+	return true;
+}
+
+// Faces of one chunk of an ASCII file, gathered once every chunk is done
+struct Ply_Text_Faces {
+	size_t first_line = 0;
+	std::vector<uint32_t> indices;
+};
+
+static bool parse_ply_text(Text_Chunk& chunk, Ply_Text_Faces& faces, const Ply_Header& header, const std::vector<uint64_t>& element_lines,
+						   const Ply_Vertex_Layout& layout, const int index_property, Mesh_Data& mesh)
+{
+	const char* end    = chunk.end;
+	const char* cursor = chunk.begin;
+	uint64_t line      = faces.first_line;
+	size_t element     = 0;
+	std::vector<int64_t> polygon;
+
+	for (; cursor < end; line++) {
+		const char* line_start = cursor;
+		while (element < header.elements.size() && line >= element_lines[element + 1]) element++;
+		if (element == header.elements.size()) break;
+
+		const Ply_Element& current = header.elements[element];
+		const uint64_t record      = line - element_lines[element];
+
+		if (current.name == "vertex") {
+			for (size_t p = 0; p < current.properties.size(); p++) {
+				float value;
+				if (!read_float(cursor, end, value)) return chunk.fail(line_start, "expected a number");
+
+				for (int field = 0; field < Field_Count; field++) {
+					if (layout.fields[field] != static_cast<int>(p)) continue;
+					if ((field >= Field_Nx && field <= Field_Nz && !layout.normals) || (field >= Field_U && !layout.uvs)) continue;
+					store_field(mesh, static_cast<size_t>(record), field, value);
+				}
+			}
+		}
+		else if (current.name == "face") {
+			for (size_t p = 0; p < current.properties.size(); p++) {
+				const Ply_Property& property = current.properties[p];
+				int64_t count                = 1;
+				float value;
+
+				if (property.count_type != Ply_Type::None && !read_int(cursor, end, count)) return chunk.fail(line_start, "expected a list length");
+				if (static_cast<int>(p) == index_property) {
+					polygon.resize(static_cast<size_t>(std::max<int64_t>(count, 0)));
+					for (auto& index : polygon) {
+						if (!read_int(cursor, end, index)) return chunk.fail(line_start, "expected a vertex index");
+					}
+					for (size_t i = 2; i < polygon.size(); i++) {
+						faces.indices.push_back(static_cast<uint32_t>(polygon[0]));
+						faces.indices.push_back(static_cast<uint32_t>(polygon[i - 1]));
+						faces.indices.push_back(static_cast<uint32_t>(polygon[i]));
+					}
+				}
+				else {
+					for (int64_t i = 0; i < count; i++) {
+						if (!read_float(cursor, end, value)) return chunk.fail(line_start, "expected a number");
+					}
+				}
+			}
+		}
+		skip_line(cursor, end);
+	}
+	return true;
+}
+
+static bool load_ply_text(const char* begin, const char* end, const Ply_Header& header, Mesh_Data& mesh, const unsigned thread_count,
+						  const std::string& path)
+{
+	const Ply_Element* vertex = nullptr;
+	int index_property        = -1;
+	std::vector<uint64_t> element_lines(1, 0); // First line of each element, counted from the end of the header
+
+	for (const auto& element : header.elements) {
+		if (element.name == "vertex") vertex = &element;
+		if (element.name == "face") index_property = ply_index_property(element);
+		element_lines.push_back(element_lines.back() + element.count);
+	}
+
+	Ply_Vertex_Layout layout;
+	if (!ply_vertex_layout(*vertex, layout, path)) return false;
+	if (index_property < 0) return ply_error(path, "faces have no vertex_indices list");
+	resize_vertices(mesh, layout, static_cast<size_t>(vertex->count));
+
+	// Every line is one record, so a chunk's records follow from the lines before it
+	auto chunks     = split_lines(begin + header.data_offset, end);
+	const int count = static_cast<int>(chunks.size());
+	std::vector<Ply_Text_Faces> faces(chunks.size());
+
+	parallel_for(count, [&](const int i) {
+		const Text_Chunk& chunk = chunks[static_cast<size_t>(i)];
+		faces[static_cast<size_t>(i)].first_line =
+			static_cast<size_t>(std::count(chunk.begin, chunk.end, '\n')) + (chunk.end[-1] != '\n' ? 1 : 0);
+	}, thread_count);
+
+	size_t line = 0;
+	for (auto& chunk_faces : faces) {
+		const size_t lines     = chunk_faces.first_line;
+		chunk_faces.first_line = line;
+		line += lines;
+	}
+	if (line < element_lines.back()) return ply_error(path, "the file ends before its last element");
+
+	parallel_for(count, [&](const int i) {
+		parse_ply_text(chunks[static_cast<size_t>(i)], faces[static_cast<size_t>(i)], header, element_lines, layout, index_property, mesh);
+	}, thread_count);
+
+	if (!check_chunks(chunks, begin, "load_ply()", path)) return false;
+
+	size_t index_count = 0;
+	for (const auto& chunk_faces : faces) index_count += chunk_faces.indices.size();
+	mesh.indices.resize(index_count);
+
+	std::vector<size_t> firsts(faces.size(), 0);
+	for (size_t i = 1; i < faces.size(); i++) firsts[i] = firsts[i - 1] + faces[i - 1].indices.size();
+
+	parallel_for(count, [&](const int i) {
+		const auto& chunk_indices = faces[static_cast<size_t>(i)].indices;
+		std::copy(chunk_indices.begin(), chunk_indices.end(), mesh.indices.begin() + static_cast<ptrdiff_t>(firsts[static_cast<size_t>(i)]));
+	}, thread_count);
+
+	return true;
+}
+
+bool load_ply(const std::string& path, Mesh_Data& mesh, const unsigned thread_count)
+{
+	Mapped_File file;
+	if (!file.open_read(path)) return false;
+
+	const char* begin = reinterpret_cast<const char*>(file.data());
+	const char* end   = begin + file.size();
+
+	Ply_Header header;
+	if (!parse_ply_header(begin, end, header, path)) return false;
+
+	bool has_vertices = false;
+	bool has_faces    = false;
+	for (const auto& element : header.elements) {
+		has_vertices = has_vertices || element.name == "vertex";
+		has_faces    = has_faces || element.name == "face";
+	}
+	if (!has_vertices || !has_faces) return ply_error(path, "a mesh needs vertex and face elements");
+
+	mesh = Mesh_Data();
+	if (header.format == Ply_Format::Ascii) return load_ply_text(begin, end, header, mesh, thread_count, path);
+	return load_ply_binary(file.data(), file.data() + file.size(), header, mesh, thread_count, path);
+}
+
+bool load_mesh(const std::string& path, Mesh_Data& mesh, Mesh_Load_Info* info, const unsigned thread_count)
+{
+	Trace_Span span("load mesh", "scene");
+	const auto start = std::chrono::steady_clock::now();
+
+	bool loaded;
+	if (has_extension(path, ".obj")) {
+		loaded = load_obj(path, mesh, thread_count);
+	}
+	else if (has_extension(path, ".ply")) {
+		loaded = load_ply(path, mesh, thread_count);
+	}
+	else {
+		std::cerr << "load_mesh() - Error: " << path << " is neither an .obj nor a .ply file\n";
+		return false;
+	}
+	if (!loaded) return false;
+
+	Mesh_Load_Info load;
+	load.path      = path;
+	load.bytes     = static_cast<uint64_t>(std::ifstream(path, std::ios::binary | std::ios::ate).tellg());
+	load.vertices  = mesh.positions.size();
+	load.triangles = mesh.triangle_count();
+	load.seconds   = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	span.set_args("\"bytes\": " + std::to_string(load.bytes) + ", \"triangles\": " + std::to_string(load.triangles) +
+				  ", \"mb_per_s\": " + std::to_string(load.megabytes_per_second()));
+	if (info) *info = load;
+	return true;
+}
+
+bool save_ply(const std::string& path, const Mesh_Data& mesh)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << "save_ply() - Error: Could not open " << path << " for writing\n";
+		return false;
+	}
+
+	const bool normals = !mesh.normals.empty();
+	const bool uvs     = !mesh.uvs.empty();
+
+	file << "ply\nformat " << (host_is_little_endian() ? "binary_little_endian" : "binary_big_endian") << " 1.0\n"
+		 << "element vertex " << mesh.positions.size() << "\nproperty float x\nproperty float y\nproperty float z\n"
+		 << (normals ? "property float nx\nproperty float ny\nproperty float nz\n" : "")
+		 << (uvs ? "property float u\nproperty float v\n" : "")
+		 << "element face " << mesh.triangle_count() << "\nproperty list uchar uint vertex_indices\nend_header\n";
+
+	// Interleaved a block at a time, positions alone are already in file layout
+	const size_t floats = 3 + (normals ? 3 : 0) + (uvs ? 2 : 0);
+	if (floats == 3) {
+		file.write(reinterpret_cast<const char*>(mesh.positions.data()), static_cast<std::streamsize>(mesh.positions.size() * sizeof(Point3)));
+	}
+	else {
+		std::vector<float> vertices;
+		for (size_t first = 0; first < mesh.positions.size(); first += block_count) {
+			const size_t last = std::min(mesh.positions.size(), first + block_count);
+			vertices.clear();
+			for (size_t v = first; v < last; v++) {
+				vertices.insert(vertices.end(), mesh.positions[v].e, mesh.positions[v].e + 3);
+				if (normals) vertices.insert(vertices.end(), mesh.normals[v].e, mesh.normals[v].e + 3);
+				if (uvs) vertices.insert(vertices.end(), &mesh.uvs[2 * v], &mesh.uvs[2 * v] + 2);
+			}
+			file.write(reinterpret_cast<const char*>(vertices.data()), static_cast<std::streamsize>(vertices.size() * sizeof(float)));
+		}
+	}
+
+	std::vector<uint8_t> faces;
+	for (size_t first = 0; first < mesh.triangle_count(); first += block_count) {
+		const size_t last = std::min(mesh.triangle_count(), first + block_count);
+		faces.resize((last - first) * (1 + 3 * sizeof(uint32_t)));
+
+		uint8_t* out = faces.data();
+		for (size_t t = first; t < last; t++) {
+			*out++ = 3;
+			memcpy(out, &mesh.indices[3 * t], 3 * sizeof(uint32_t));
+			out += 3 * sizeof(uint32_t);
+		}
+		file.write(reinterpret_cast<const char*>(faces.data()), static_cast<std::streamsize>(faces.size()));
+	}
+
+	if (!file) {
+		std::cerr << "save_ply() - Error: Could not write " << path << '\n';
+		return false;
+	}
+	return true;
+}
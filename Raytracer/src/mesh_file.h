@@ -0,0 +1,41 @@
+﻿// /*
+//  * mesh_file.h
+//  */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "triangle_mesh.h"
+
+// Triangle mesh files. The loaders map the file, split it into chunks that are parsed on all hardware threads with
+// a number parser of their own (no iostreams, no strtof()), and write straight into the buffers of a Mesh_Data:
+//
+//   .obj  v, vt and vn lines and f lines in the v, v/t, v//n and v/t/n forms, negative indices counting back from
+//         the last vertex. Polygons are fanned into triangles, groups, materials and everything else are skipped.
+//         Corners pairing a position with different uvs or normals become separate vertices.
+//   .ply  ASCII or binary in either byte order, x y z and optionally nx ny nz and u v (or s t) vertex properties
+//         and a vertex_indices list per face. Binary vertices and all-triangle faces are copied into place without
+//         parsing anything, which is what save_ply() writes.
+
+// What a load read and how long it took
+struct Mesh_Load_Info {
+	std::string path;
+	uint64_t bytes   = 0;
+	size_t vertices  = 0;
+	size_t triangles = 0;
+	double seconds   = 0.0;
+
+	double megabytes_per_second() const { return seconds > 0.0 ? static_cast<double>(bytes) / 1e6 / seconds : 0.0; }
+};
+
+// Errors (with line numbers for text) are reported on stderr, a thread_count of zero uses every hardware thread
+bool load_obj(const std::string& path, Mesh_Data& mesh, unsigned thread_count = 0);
+bool load_ply(const std::string& path, Mesh_Data& mesh, unsigned thread_count = 0);
+
+// Picks the loader by extension and times it
+bool load_mesh(const std::string& path, Mesh_Data& mesh, Mesh_Load_Info* info = nullptr, unsigned thread_count = 0);
+
+// Binary PLY in the host's byte order, float vertex properties and uint indices
+bool save_ply(const std::string& path, const Mesh_Data& mesh);
@@ -0,0 +1,235 @@
+﻿#include "options.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+
+
+static const char* const known_formats[] = {"bmp", "pfm", "exr"};
+
+static const char* const value_options[] = {
+	"-w", "--width", "-H", "--height", "-s", "--spp", "-d", "--depth", "-t", "--threads", "--tile", "--seed",
+	"--fov", "--aperture", "--focus", "-o", "--output", "-f", "--format", "--tonemap", "--exposure", "--convert",
+	"--heatmap", "--trace", "--sampler", "--roulette", "--adaptive"
+};
+
+static bool is_format(const std::string& name)
+{
+	for (const char* format : known_formats) {
+		if (name == format) return true;
+	}
+	return false;
+}
+
+static bool parse_int(const char* option, const char* text, int& value, const int min)
+{
+	char* end;
+	const long parsed = std::strtol(text, &end, 10);
+	if (end == text || *end != '\0' || parsed < min || parsed > 1 << 30) {
+		std::cerr << "parse_options() - Error: " << option << " expects a whole number of at least " << min << ", got '" << text << "'\n";
+		return false;
+	}
+	value = static_cast<int>(parsed);
+	return true;
+}
+
+static bool parse_float(const char* option, const char* text, float& value)
+{
+	char* end;
+	value = std::strtof(text, &end);
+	if (end == text || *end != '\0' || value < 0.0f) {
+		std::cerr << "parse_options() - Error: " << option << " expects a non-negative number, got '" << text << "'\n";
+		return false;
+	}
+	return true;
+}
+
+static bool parse_formats(const std::string& list, std::vector<std::string>& formats)
+{
+	formats.clear();
+
+	size_t begin = 0;
+	while (begin <= list.size()) {
+		const size_t end         = std::min(list.find(',', begin), list.size());
+		const std::string format = list.substr(begin, end - begin);
+
+		if (!is_format(format)) {
+			std::cerr << "parse_options() - Error: unknown output format '" << format << "'\n";
+			return false;
+		}
+		formats.push_back(format);
+		begin = end + 1;
+	}
+	return true;
+}
+
+static bool parse_tone_operator(const std::string& name, Tone_Operator& op)
+{
+	for (const auto candidate : {Tone_Operator::Gamma_2, Tone_Operator::Srgb, Tone_Operator::Reinhard, Tone_Operator::Aces}) {
+		if (name == tone_operator_name(candidate)) {
+			op = candidate;
+			return true;
+		}
+	}
+	std::cerr << "parse_options() - Error: unknown tone operator '" << name << "'\n";
+	return false;
+}
+
+static bool parse_sampler(const std::string& name, Pixel_Sampler& sampler)
+{
+	for (const auto candidate : {Pixel_Sampler::Random, Pixel_Sampler::Stratified}) {
+		if (name == pixel_sampler_name(candidate)) {
+			sampler = candidate;
+			return true;
+		}
+	}
+	std::cerr << "parse_options() - Error: unknown sampler '" << name << "'\n";
+	return false;
+}
+
+static bool parse_heatmap(const std::string& name, Aov& aov)
+{
+	if (name == "time") aov = Aov::Render_Time;
+	else if (name == "tests") aov = Aov::Traversal_Cost;
+	else {
+		std::cerr << "parse_options() - Error: --heatmap expects time or tests, got '" << name << "'\n";
+		return false;
+	}
+	return true;
+}
+
+bool parse_options(const int argc, const char* const argv[], Options& options)
+{
+	bool formats_given = false;
+
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+
+		// Flags
+		if (arg == "-h" || arg == "--help") {
+			options.help = true;
+			continue;
+		}
+		if (arg == "--denoise") {
+			options.denoise = true;
+			continue;
+		}
+		if (arg == "--aovs") {
+			options.aovs = true;
+			continue;
+		}
+		if (arg == "--stats") {
+			options.stats = true;
+			continue;
+		}
+		if (arg.empty() || arg[0] != '-') {
+			if (!options.scene.empty()) {
+				std::cerr << "parse_options() - Error: more than one scene given ('" << options.scene << "' and '" << arg << "')\n";
+				return false;
+			}
+			options.scene = arg;
+			continue;
+		}
+
+		// Everything else takes a value
+		if (std::find(std::begin(value_options), std::end(value_options), arg) == std::end(value_options)) {
+			std::cerr << "parse_options() - Error: unknown option " << arg << '\n';
+			return false;
+		}
+		if (i + 1 >= argc) {
+			std::cerr << "parse_options() - Error: " << arg << " expects a value\n";
+			return false;
+		}
+		const char* value = argv[++i];
+		bool ok           = true;
+
+		if (arg == "-w" || arg == "--width") ok = parse_int(arg.c_str(), value, options.width, 1);
+		else if (arg == "-H" || arg == "--height") ok = parse_int(arg.c_str(), value, options.height, 1);
+		else if (arg == "-s" || arg == "--spp") ok = parse_int(arg.c_str(), value, options.samples_per_pixel, 1);
+		else if (arg == "-d" || arg == "--depth") ok = parse_int(arg.c_str(), value, options.max_depth, 1);
+		else if (arg == "-t" || arg == "--threads") ok = parse_int(arg.c_str(), value, options.thread_count, 0);
+		else if (arg == "--tile") ok = parse_int(arg.c_str(), value, options.tile_size, 1);
+		else if (arg == "--roulette") ok = parse_int(arg.c_str(), value, options.roulette_depth, 1);
+		else if (arg == "--adaptive") ok = parse_float(arg.c_str(), value, options.adaptive_error);
+		else if (arg == "--sampler") ok = options.sampler_given = parse_sampler(value, options.sampler);
+		else if (arg == "--fov") {
+			ok = parse_float(arg.c_str(), value, options.fov);
+			if (ok && !(options.fov > 0.0f && options.fov < 180.0f)) {
+				std::cerr << "parse_options() - Error: --fov expects an angle between 0 and 180 degrees, got '" << value << "'\n";
+				return false;
+			}
+		}
+		else if (arg == "--aperture") ok = parse_float(arg.c_str(), value, options.aperture);
+		else if (arg == "--focus") ok = parse_float(arg.c_str(), value, options.focus_dist);
+		else if (arg == "--exposure") ok = parse_float(arg.c_str(), value, options.exposure);
+		else if (arg == "--tonemap") ok = options.tone_given = parse_tone_operator(value, options.tone_operator);
+		else if (arg == "--heatmap") ok = parse_heatmap(value, options.heatmap);
+		else if (arg == "--convert") options.convert = value;
+		else if (arg == "--trace") options.trace = value;
+		else if (arg == "--seed") {
+			char* end;
+			options.seed = std::strtoull(value, &end, 10);
+			if (end == value || *end != '\0') {
+				std::cerr << "parse_options() - Error: --seed expects a whole number, got '" << value << "'\n";
+				return false;
+			}
+			options.seed_given = true;
+		}
+		else if (arg == "-f" || arg == "--format") {
+			ok            = parse_formats(value, options.formats);
+			formats_given = true;
+		}
+		else if (arg == "-o" || arg == "--output") {
+			options.output = value;
+		}
+
+		if (!ok) return false;
+	}
+
+	// output.exr means the EXR alone unless --format says otherwise
+	const size_t dot = options.output.find_last_of('.');
+	if (dot != std::string::npos && options.output.find_first_of("/\\", dot) == std::string::npos &&
+		is_format(options.output.substr(dot + 1))) {
+		if (!formats_given) options.formats = {options.output.substr(dot + 1)};
+		options.output.erase(dot);
+	}
+	if (options.formats.empty()) {
+		options.formats.assign(std::begin(known_formats), std::end(known_formats));
+	}
+
+	return true;
+}
+
+void print_usage(const char* program)
+{
+	std::cerr << "Usage: " << program << " [options] [scene]\n"
+		"\n"
+		"Renders a scene file (text, binary or .rtsc cache), or the built-in scene when none is given.\n"
+		"Settings from the command line override the scene file's, which override the built-in defaults.\n"
+		"\n"
+		"  -w, --width N        Image width in pixels\n"
+		"  -H, --height N       Image height in pixels, keeps the aspect ratio when only the width is given\n"
+		"  -s, --spp N          Samples per pixel\n"
+		"  -d, --depth N        Maximum path depth\n"
+		"  -t, --threads N      Render threads, 0 for every hardware thread\n"
+		"      --tile N         Tile size in pixels\n"
+		"      --seed N         Random seed, renders are deterministic for a given seed\n"
+		"      --sampler NAME   Pixel sample positions: random (default) or stratified\n"
+		"      --roulette N     Russian roulette may end paths after N bounces\n"
+		"      --adaptive E     Pixels stop sampling once their relative error is below E, --spp is the most they take\n"
+		"      --fov DEGREES    Vertical field of view\n"
+		"      --aperture A     Lens aperture, 0 for a pinhole\n"
+		"      --focus D        Focus distance\n"
+		"  -o, --output PATH    Output base name (default output), an extension selects that format\n"
+		"  -f, --format LIST    Comma separated formats out of bmp, pfm, exr (default all three)\n"
+		"      --tonemap OP     8-bit resolve: gamma2 (default), srgb, reinhard or aces\n"
+		"      --exposure X     Linear exposure scale before tone mapping\n"
+		"      --denoise        Denoise the beauty image\n"
+		"      --aovs           Write every AOV as <output>.<name>.pfm\n"
+		"      --stats          Print ray statistics after the render\n"
+		"      --heatmap COST   Write <output>.heatmap.bmp, per-pixel render time (time) or intersection tests (tests)\n"
+		"      --trace PATH     Write a timeline of scene build, tiles and file writes as Chrome trace-event JSON\n"
+		"      --convert PATH   Write the scene in binary form (a scene cache for .rtsc) instead of rendering\n"
+		"  -h, --help           Show this message\n";
+}
@@ -0,0 +1,56 @@
+﻿// /*
+//  * options.h
+//  */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "aov.h"
+#include "renderer.h"
+#include "tonemap.h"
+
+// Command line of the Raytracer executable. Numbers left at zero (or negative for the camera) weren't given,
+// the scene file's value or the built-in default is used instead.
+struct Options {
+	std::string scene;   // Built-in scene when empty
+	std::string convert; // Write the scene here (binary, or a cache for .rtsc) instead of rendering it
+	std::string trace;   // Chrome trace-event JSON of the render phases, none when empty
+	std::string output = "output";
+	std::vector<std::string> formats; // Any of bmp, pfm, exr
+
+	int width             = 0;
+	int height            = 0;
+	int samples_per_pixel = 0;
+	int max_depth         = 0;
+	int tile_size         = 0;
+	int thread_count      = 0;
+	int roulette_depth    = 0;
+	uint64_t seed         = 0; // Only used when seed_given, zero is a seed like any other
+	float adaptive_error  = 0.0f;
+
+	float fov        = -1.0f;
+	float aperture   = -1.0f;
+	float focus_dist = -1.0f;
+
+	bool denoise                = false;
+	bool aovs                   = false;
+	bool stats                  = false;
+	Aov heatmap                 = Aov::Count; // Render_Time or Traversal_Cost for a heatmap of that cost
+	bool seed_given             = false;
+	bool sampler_given          = false;
+	Pixel_Sampler sampler       = Pixel_Sampler::Random;
+	bool tone_given             = false;
+	Tone_Operator tone_operator = Tone_Operator::Gamma_2;
+	float exposure              = -1.0f;
+
+	bool help = false;
+};
+
+// Parses argv, errors are reported on stderr. Output paths ending in a known format pick that format, the
+// extension is dropped from the base name the outputs are written under.
+bool parse_options(int argc, const char* const argv[], Options& options);
+
+void print_usage(const char* program);
@@ -0,0 +1 @@
+﻿#include "parallel.h"
@@ -0,0 +1,43 @@
+﻿// /*
+//  * parallel.h
+//  */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Threads to use when the caller doesn't say, at least one
+inline unsigned default_thread_count()
+{
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Calls body(i) for every i in [0, count), handing indices out to thread_count threads (the caller included) as they finish
+template <typename Body>
+void parallel_for(const int count, Body body, unsigned thread_count = 0)
+{
+	if (thread_count == 0) thread_count = default_thread_count();
+	thread_count = std::min(thread_count, static_cast<unsigned>(std::max(count, 1)));
+
+	std::atomic<int> next(0);
+	auto worker = [&]() {
+		for (int i = next++; i < count; i = next++) {
+			body(i);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(thread_count - 1);
+	for (unsigned t = 1; t < thread_count; t++) {
+		threads.emplace_back(worker);
+	}
+
+	worker();
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
@@ -0,0 +1,100 @@
+﻿#include "ray_stats.h"
+
+#include <iomanip>
+#include <ostream>
+#include <string>
+
+#if RAYTRACER_STATS
+thread_local Ray_Stats ray_stats;
+#endif
+
+
+uint64_t Ray_Stats::rays() const
+{
+	uint64_t total = shadow_rays;
+	for (const uint64_t count : rays_by_depth) total += count;
+	return total;
+}
+
+Ray_Stats& Ray_Stats::operator+=(const Ray_Stats& other)
+{
+	for (int i = 0; i < ray_stats_depth_bins; i++) rays_by_depth[i] += other.rays_by_depth[i];
+	shadow_rays      += other.shadow_rays;
+	primitive_tests  += other.primitive_tests;
+	box_tests        += other.box_tests;
+	material_samples += other.material_samples;
+	material_evals   += other.material_evals;
+	paths_missed     += other.paths_missed;
+	paths_absorbed   += other.paths_absorbed;
+	paths_depth_cap  += other.paths_depth_cap;
+	return *this;
+}
+
+Ray_Stats& Ray_Stats::operator-=(const Ray_Stats& other)
+{
+	for (int i = 0; i < ray_stats_depth_bins; i++) rays_by_depth[i] -= other.rays_by_depth[i];
+	shadow_rays      -= other.shadow_rays;
+	primitive_tests  -= other.primitive_tests;
+	box_tests        -= other.box_tests;
+	material_samples -= other.material_samples;
+	material_evals   -= other.material_evals;
+	paths_missed     -= other.paths_missed;
+	paths_absorbed   -= other.paths_absorbed;
+	paths_depth_cap  -= other.paths_depth_cap;
+	return *this;
+}
+
+static double per_ray(const uint64_t count, const uint64_t rays)
+{
+	return rays > 0 ? static_cast<double>(count) / static_cast<double>(rays) : 0.0;
+}
+
+void print_ray_stats(std::ostream& out, const Ray_Stats& stats)
+{
+#if !RAYTRACER_STATS
+	(void)stats;
+	out << "Ray statistics: not compiled in (RAYTRACER_STATS=0)\n";
+#else
+	const uint64_t rays  = stats.rays();
+	const auto flags     = out.flags();
+	const auto precision = out.precision();
+
+	out << "Ray statistics\n";
+	out << "  Rays              " << std::setw(14) << rays << '\n';
+	for (int i = 0; i < ray_stats_depth_bins; i++) {
+		if (stats.rays_by_depth[i] == 0) continue;
+		out << "    depth " << std::left << std::setw(10) << (i == ray_stats_depth_bins - 1 ? std::to_string(i) + "+" : std::to_string(i))
+			<< std::right << std::setw(14) << stats.rays_by_depth[i] << '\n';
+	}
+	out << "    shadow          " << std::setw(14) << stats.shadow_rays << '\n';
+
+	out << std::fixed << std::setprecision(2);
+	out << "  Sphere tests      " << std::setw(14) << stats.primitive_tests << std::setw(10) << per_ray(stats.primitive_tests, rays) << " per ray\n";
+	out << "  Box tests         " << std::setw(14) << stats.box_tests << std::setw(10) << per_ray(stats.box_tests, rays) << " per ray\n";
+	out << "  Material samples  " << std::setw(14) << stats.material_samples << '\n';
+	out << "  Material evals    " << std::setw(14) << stats.material_evals << '\n';
+	out << "  Paths ended by\n";
+	out << "    miss            " << std::setw(14) << stats.paths_missed << '\n';
+	out << "    absorption      " << std::setw(14) << stats.paths_absorbed << '\n';
+	out << "    depth cap       " << std::setw(14) << stats.paths_depth_cap << '\n';
+
+	out.flags(flags);
+	out.precision(precision);
+#endif
+}
+
+void write_ray_stats_json(std::ostream& out, const Ray_Stats& stats)
+{
+	const uint64_t rays = stats.rays();
+
+	out << "{\"rays\": " << rays << ", \"rays_by_depth\": [";
+	for (int i = 0; i < ray_stats_depth_bins; i++) {
+		out << (i > 0 ? ", " : "") << stats.rays_by_depth[i];
+	}
+	out << "], \"shadow_rays\": " << stats.shadow_rays
+		<< ", \"primitive_tests\": " << stats.primitive_tests << ", \"primitive_tests_per_ray\": " << per_ray(stats.primitive_tests, rays)
+		<< ", \"box_tests\": " << stats.box_tests << ", \"box_tests_per_ray\": " << per_ray(stats.box_tests, rays)
+		<< ", \"material_samples\": " << stats.material_samples << ", \"material_evals\": " << stats.material_evals
+		<< ", \"paths_missed\": " << stats.paths_missed << ", \"paths_absorbed\": " << stats.paths_absorbed
+		<< ", \"paths_depth_cap\": " << stats.paths_depth_cap << "}";
+}
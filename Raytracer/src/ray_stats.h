@@ -0,0 +1,63 @@
+﻿// /*
+//  * ray_stats.h
+//  */
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+
+// Ray statistics counters. Each thread counts into its own Ray_Stats without synchronization, the renderer takes
+// the difference over every tile and sums them once the frame is done. Building with RAYTRACER_STATS=0 removes
+// the counting code entirely, the totals then stay zero.
+#ifndef RAYTRACER_STATS
+#define RAYTRACER_STATS 1
+#endif
+
+// Rays of bounce ray_stats_depth_bins - 1 and deeper share the last bin
+constexpr int ray_stats_depth_bins = 16;
+
+struct Ray_Stats {
+	uint64_t rays_by_depth[ray_stats_depth_bins] = {}; // Camera rays at 0, bounce n at n
+	uint64_t shadow_rays      = 0;                     // Light and environment visibility rays
+	uint64_t primitive_tests  = 0;                     // Ray-sphere tests
+	uint64_t box_tests        = 0;                     // Ray-box tests in BVH traversals
+	uint64_t material_samples = 0;                     // Material::sample() calls, one per scattered bounce
+	uint64_t material_evals   = 0;                     // Material::eval() calls for light and environment samples
+
+	// Why paths ended
+	uint64_t paths_missed    = 0; // Escaped the scene
+	uint64_t paths_absorbed  = 0; // The material didn't scatter
+	uint64_t paths_depth_cap = 0; // Hit something at the last allowed bounce
+
+	uint64_t rays() const; // Path and shadow rays
+
+	Ray_Stats& operator+=(const Ray_Stats& other);
+	Ray_Stats& operator-=(const Ray_Stats& other);
+};
+
+#if RAYTRACER_STATS
+// The calling thread's counters since it started
+extern thread_local Ray_Stats ray_stats;
+
+// RAY_STAT(box_tests += n) counts into the calling thread's statistics, and compiles to nothing without them
+#define RAY_STAT(update) (ray_stats.update)
+#else
+#define RAY_STAT(update) ((void)0)
+#endif
+
+// Snapshot of the calling thread's counters, zero without RAYTRACER_STATS
+inline Ray_Stats thread_ray_stats()
+{
+#if RAYTRACER_STATS
+	return ray_stats;
+#else
+	return {};
+#endif
+}
+
+// Totals and per-ray averages as a readable table
+void print_ray_stats(std::ostream& out, const Ray_Stats& stats);
+
+// One JSON object, no trailing newline
+void write_ray_stats_json(std::ostream& out, const Ray_Stats& stats);
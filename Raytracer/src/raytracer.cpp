@@ -1,32 +1,27 @@
+﻿#include <atomic>
 #include <cstdio>
+#include <mutex>
 #include "bitmap_image.hpp"
 
+#include "aov.h"
+#include "async_writer.h"
+#include "builtin_scenes.h"
 #include "camera.h"
+#include "heatmap.h"
 #include "hittables.h"
+#include "image_stream.h"
 #include "material.h"
+#include "options.h"
+#include "renderer.h"
+#include "scene.h"
+#include "scene_cache.h"
+#include "scene_file.h"
 #include "sphere.h"
+#include "tonemap.h"
+#include "trace.h"
 #include "math/numeric.h"
 
 
-// Image
-constexpr float aspect_ratio    = 3.0f / 2.0f;
-constexpr int image_width       = 800;
-constexpr int image_height      = static_cast<int>(image_width / aspect_ratio);
-constexpr int samples_per_pixel = 50;
-constexpr int max_depth         = 6;
-
-// Camera
-constexpr float viewport_height = 2.0f;
-constexpr float viewport_width  = aspect_ratio * viewport_height;
-constexpr float focal_length    = 1.0f;
-
-const auto origin     = Point3(0, 0, 0);
-const auto horizontal = Vec3(viewport_width, 0, 0);
-const auto vertical   = Vec3(0, viewport_height, 0);
-
-// Lower left corner is (0,0)
-const Vec3 lower_left_corner = origin - (horizontal / 2.0f) - (vertical / 2.0f) - Vec3(0, 0, focal_length);
-
 float hit_sphere(const Point3& center, const float radius, const Ray& r)
 {
 	const Vec3 oc           = r.origin() - center;
@@ -41,151 +36,211 @@ float hit_sphere(const Point3& center, const float radius, const Ray& r)
 	return (-b_half - sqrtf(discriminant)) / a;
 }
 
-// Recursive
-Color3 ray_color(const Ray& r, const Hittables& world, int depth)
+// Command line values win over the scene file's
+static void apply_options(const Options& options, Render_Settings& settings, Camera_Desc& camera)
 {
-	Hit_Record record;
-
-	if (depth <= 0) {
-		return {0.0f, 0.0f, 0.0f};
+	if (options.width > 0 && options.height == 0) {
+		settings.height = std::max(1, static_cast<int>(std::lround(static_cast<double>(options.width) * settings.height / settings.width)));
 	}
+	if (options.width > 0) settings.width = options.width;
+	if (options.height > 0) settings.height = options.height;
+	if (options.samples_per_pixel > 0) settings.samples_per_pixel = options.samples_per_pixel;
+	if (options.max_depth > 0) settings.max_depth = options.max_depth;
+	if (options.tile_size > 0) settings.tile_size = options.tile_size;
+	if (options.thread_count > 0) settings.thread_count = static_cast<unsigned>(options.thread_count);
+	if (options.seed_given) settings.seed = options.seed;
+	if (options.sampler_given) settings.sampler = options.sampler;
+	if (options.roulette_depth > 0) settings.roulette_depth = options.roulette_depth;
+	if (options.adaptive_error > 0.0f) settings.adaptive_error = options.adaptive_error;
+	if (options.denoise) settings.denoise = true;
+	if (options.tone_given) settings.tone_operator = options.tone_operator;
+	if (options.exposure >= 0.0f) settings.exposure = options.exposure;
+
+	if (options.fov > 0.0f) camera.fov = options.fov;
+	if (options.aperture >= 0.0f) camera.aperture = options.aperture;
+	if (options.focus_dist > 0.0f) camera.focus_dist = options.focus_dist;
+}
 
-	// Sphere hit if true
-	if (world.hit(r, 0.001f, infinity, record)) {
-		Ray scattered;
-		Color3 attenuation;
+static bool ends_with(const std::string& text, const std::string& suffix)
+{
+	return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
 
-		if (record.mat_ptr->scatter(r, record, attenuation, scattered)) {
-			return attenuation * ray_color(scattered, world, depth - 1);
-		}
-		return {0, 0, 0};
-		// const point3 target = record.p + random_in_hemisphere(record.normal);
-		// return 0.5f * ray_color(ray(record.p, target - record.p), world, depth-1);
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!parse_options(argc, argv, options)) {
+		print_usage(argv[0]);
+		return 1;
+	}
+	if (options.help) {
+		print_usage(argv[0]);
+		return 0;
 	}
 
-	// Normalize ray direction
-	const Vec3 unit_direction = get_normal(r.direction());
-
-	// Convert (-1 to 1) y part of vector to (0 to 1)
-	const auto t = 0.5f * (unit_direction.y + 1.0f);
-
-	// blendedValue = (1 - t)*startValue + t*endValue
-	// When y=max: 0*startValue + 1*endValue
-	// When y=min: 1*startValue + 0*endValue
-	// Kind of like blending src & dst in openGL
+	if (!options.trace.empty()) {
+		trace_start();
+		trace_name_thread("main");
+	}
 
-	// When y is min, set color to white, when at max set to blue
-	return (1.0f - t) * Color3(1.0f, 1.0f, 1.0f) + t * Color3(0.4f, 0.6f, 1.0f);
-}
+	if (!options.convert.empty() && (options.scene.empty() || is_scene_cache(options.scene))) {
+		std::cerr << "main() - Error: --convert needs a text or binary scene file\n";
+		return 1;
+	}
 
-Hittables random_scene()
-{
-	Hittables world;
+	// World, from the scene file or the built-in scene
+	Render_Settings settings;
+	Scene_Description description;
+	Scene world;
 
-	auto ground_material = make_shared<Lambertian>(Color3(0.5f, 0.5f, 0.5f));
-	world.add(make_shared<Sphere>(Point3(0, -1000, 0), 1000, ground_material));
+	if (!options.scene.empty() && is_scene_cache(options.scene)) {
+		if (!load_scene_cache(options.scene, description, world)) return 1;
+	}
+	else {
+		if (!options.scene.empty()) {
+			if (!load_scene(options.scene, description)) return 1;
 
-	for (int a = -11; a < 11; a++) {
-		for (int b = -11; b < 11; b++) {
-			const auto choose_mat = random_float();
-			Point3 center(static_cast<float>(a) + 0.9f * random_float(), 0.2f, static_cast<float>(b) + 0.9f * random_float());
+			if (!options.convert.empty()) {
+				const bool cache = ends_with(options.convert, ".rtsc");
+				return (cache ? save_scene_cache(options.convert, description) : save_scene_binary(options.convert, description)) ? 0 : 1;
+			}
+		}
+		else {
+			description = default_scene();
+			//description = random_scene();
+			//description = small_lights_scene();
+			//description = glowing_spheres_scene();
+		}
 
-			if ((center - Point3(4, 0.2f, 0)).length() > 0.9f) {
-				shared_ptr<Material> sphere_material;
+		std::vector<Mesh_Load_Info> mesh_loads;
+		world = build_scene(description, &mesh_loads);
 
-				if (choose_mat < 0.8f) {
-					// diffuse
-					auto albedo     = Color3::random() * Color3::random();
-					sphere_material = make_shared<Lambertian>(albedo);
-					world.add(make_shared<Sphere>(center, 0.2, sphere_material));
-				}
-				else if (choose_mat < 0.95f) {
-					// metal
-					auto albedo     = Color3::random(0.5, 1);
-					auto fuzz       = random_float(0, 0.5);
-					sphere_material = make_shared<Metal>(albedo, fuzz);
-					world.add(make_shared<Sphere>(center, 0.2f, sphere_material));
-				}
-				else {
-					// glass
-					sphere_material = make_shared<Dielectric>(1.5f);
-					world.add(make_shared<Sphere>(center, 0.2f, sphere_material));
-				}
-			}
+		for (const auto& load : mesh_loads) {
+			std::cerr << "Loaded " << load.path << ": " << load.triangles << " triangles, " << static_cast<double>(load.bytes) / 1e6
+					  << " MB in " << 1e3 * load.seconds << " ms (" << load.megabytes_per_second() << " MB/s)\n";
 		}
 	}
 
-	auto material1 = make_shared<Dielectric>(1.5);
-	world.add(make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
+	if (description.width > 0) settings.width = description.width;
+	if (description.height > 0) settings.height = description.height;
+	if (description.samples_per_pixel > 0) settings.samples_per_pixel = description.samples_per_pixel;
+	if (description.max_depth > 0) settings.max_depth = description.max_depth;
 
-	auto material2 = make_shared<Lambertian>(Color3(0.4f, 0.2f, 0.1f));
-	world.add(make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
+	apply_options(options, settings, description.camera);
 
-	auto material3 = make_shared<Metal>(Color3(0.7f, 0.6f, 0.5f), 0.0f);
-	world.add(make_shared<Sphere>(Point3(4, 1, 0), 1.0f, material3));
+	world.build();
 
-	return world;
-}
+	// Camera
+	const Camera cam = build_camera(description.camera, static_cast<float>(settings.width) / static_cast<float>(settings.height));
 
-int main(int argc, char* argv[])
-{
-	// World
-    Hittables world;
-    auto material_ground = make_shared<Lambertian>(Color3(0.8f, 0.8f, 0.0f));
-    auto material_center = make_shared<Lambertian>(Color3(0.1f, 0.2f, 0.5f));
-    auto material_left = make_shared<Dielectric>(1.5f);
-    auto material_right = make_shared<Metal>(Color3(0.8f,0.6f,0.4f), 0.5f);
+	// Image
 
-    world.add(make_shared<Sphere>(Point3( 0.0f, -100.5f, -1.0f), 100.0f, material_ground));
-    world.add(make_shared<Sphere>(Point3( 0.0f,    0.0f, -1.0f),   0.5f, material_center));
-    world.add(make_shared<Sphere>(Point3(-1.0f,    0.0f, -1.0f),   0.5f, material_left));
-    world.add(make_shared<Sphere>(Point3(-1.0f,    0.0f, -1.0f), -0.45f, material_left));
-    world.add(make_shared<Sphere>(Point3( 1.0f,    0.0f, -1.0f),   0.5f, material_right));
+	std::vector<Aov> frame_aovs;
 
-	//auto world = random_scene();
+	if (settings.denoise) {
+		frame_aovs = {Aov::Albedo, Aov::Normal, Aov::Depth};
+	}
+	if (options.aovs) {
+		for (int i = 0; i < static_cast<int>(Aov::Count); i++) frame_aovs.push_back(static_cast<Aov>(i));
+	}
+	if (options.heatmap != Aov::Count) {
+		frame_aovs.push_back(options.heatmap);
+	}
 
-	const Point3 look_from(3, 1, 3);
-	const Point3 look_at(0, 0, 0);
-	const Vec3 vup(0, 1, 0);
-	constexpr auto dist_to_focus = 4.0f;
-	constexpr auto aperture      = 0.1f;
+	// Denoising, AOVs and heatmaps need the whole frame in memory. Otherwise tiles stream straight into
+	// preallocated, memory-mapped output files, so memory stays bounded by the tiles in flight.
+	const bool full_frame = settings.denoise || options.aovs || options.heatmap != Aov::Count;
 
+	// Output buffers, row 0 at the top
+	Aov_Buffers aovs(full_frame ? settings.width : 0, full_frame ? settings.height : 0, frame_aovs);
 
-	// Camera
-	Camera cam(look_from, look_at, vup, 25.0f, aspect_ratio, aperture, dist_to_focus);
+	const Tone_Mapper tone_mapper(settings.tone_operator, settings.exposure);
 
-	// Image
+	std::vector<std::unique_ptr<Image_Stream>> streams;
+	for (const auto& format : full_frame ? std::vector<std::string>() : options.formats) {
+		const std::string path = options.output + "." + format;
+
+		if (format == "bmp") streams.push_back(std::make_unique<Bmp_Stream>(path, settings.width, settings.height, tone_mapper));
+		if (format == "pfm") streams.push_back(std::make_unique<Pfm_Stream>(path, settings.width, settings.height));
+		if (format == "exr") streams.push_back(std::make_unique<Exr_Stream>(path, settings.width, settings.height));
 
-	bitmap_image image(image_width, image_height);
+		// Mapped_File::create() said why
+		if (!streams.back()->is_open()) return 1;
+	}
+
+	// Declared after the streams so its destructor drains the queue before they are unmapped
+	Async_Writer writer;
+	std::atomic<bool> write_ok(true);
+
+	const int tile_count = ((settings.width + settings.tile_size - 1) / settings.tile_size) *
+		((settings.height + settings.tile_size - 1) / settings.tile_size);
+	std::atomic<int> tiles_done(0);
+	std::mutex progress_mutex;
+	Render_Stats render_stats;
+
+	const bool rendered = Renderer(settings).render(world, cam, aovs, [&](const Tile& tile, Aov_Buffers& tile_buffers) {
+		if (!streams.empty()) {
+			// The copy into the mapping (and any page faults it takes) happens on the I/O thread. A full queue makes
+			// this worker wait for it, which keeps memory bounded if the disk falls behind.
+			writer.submit([&streams, &write_ok, tile, beauty = std::move(tile_buffers[Aov::Beauty])]() {
+				Trace_Span span("write tile", "io");
+				for (const auto& stream : streams) {
+					if (!stream->write_tile(tile.x0, tile.y0, beauty)) write_ok = false;
+				}
+			});
+		}
 
-	image.set_all_channels(255, 150, 50);
+		const int done = ++tiles_done;
+		std::lock_guard<std::mutex> lock(progress_mutex);
+		std::cerr << "\rTiles remaining: " << tile_count - done << " " << std::flush;
+	}, &render_stats);
 
-	for (int y = 0; y < image_height; y++) {
-		std::cerr << "\rScanlines remaining: " << image_height - y << " " << std::flush;
-		for (int x = 0; x < image_width; x++) {
-			Color3 pixel_color(0, 0, 0);
-			for (int s = 0; s < samples_per_pixel; s++) {
-				const auto u = (static_cast<float>(x) + random_float()) / (image_width - 1);
-				const auto v = (static_cast<float>(y) + random_float()) / (image_height - 1);
-				Ray r        = cam.get_ray(u, v);
-				pixel_color += ray_color(r, world, max_depth);
-			}
-			//color3 color(static_cast<float>(x) / (image_width - 1), static_cast<float>(y) / (image_height - 1), 0.25f);
+	if (!rendered) return 1;
 
-			//const auto u = static_cast<float>(x) / (image_width - 1);
-			//const auto v = static_cast<float>(y) / (image_height - 1);
-			//ray r(origin, lower_left_corner + u*horizontal + v*vertical - origin);
-			//color3 pixel_color = ray_color(r, world);
+	if (options.stats) {
+		std::cerr << '\n';
+		print_ray_stats(std::cerr, render_stats.rays);
+	}
 
-			image.set_pixel(x, y, get_color(pixel_color, samples_per_pixel));
+	// Streamed outputs are complete once the queued tiles are written and their mappings released
+	if (!full_frame) {
+		writer.finish();
+		for (const auto& stream : streams) {
+			if (!stream->close()) write_ok = false;
 		}
+		return (options.trace.empty() || trace_write(options.trace)) && write_ok ? 0 : 1;
 	}
 
-	// Render
+	const Hdr_Image& color = aovs[Aov::Beauty];
 
-	image.vertical_flip();
+	// The frame is final from here on, the writer only reads it. These outputs need the whole frame, so unlike the
+	// streamed tiles these outputs are only encoded once rendering is done.
+	if (options.aovs) {
+		writer.submit([&]() {
+			if (!aovs.save(options.output)) write_ok = false;
+		});
+	}
+	if (options.heatmap != Aov::Count) {
+		writer.submit([&]() {
+			float scale_max;
+			if (save_heatmap(options.output + ".heatmap.bmp", aovs[options.heatmap], &scale_max)) {
+				std::cerr << "\nHeatmap: red at " << scale_max << (options.heatmap == Aov::Render_Time ? " ns" : " tests") << " per pixel\n";
+			}
+			else {
+				write_ok = false;
+			}
+		});
+	}
+
+	// PFM and EXR are unclamped linear copies, exposure and tone mapping can be changed later without tracing again
+	for (const auto& format : options.formats) {
+		const std::string path = options.output + "." + format;
 
-	image.save_image("output.bmp");
+		if (format == "bmp") writer.submit([&, path]() { if (!save_bmp(path, color, tone_mapper)) write_ok = false; });
+		if (format == "pfm") writer.submit([&, path]() { if (!save_pfm(path, color)) write_ok = false; });
+		if (format == "exr") writer.submit([&, path]() { if (!aovs.save_exr(path)) write_ok = false; });
+	}
+	writer.finish();
 
-	return 0;
+	return (options.trace.empty() || trace_write(options.trace)) && write_ok ? 0 : 1;
 }
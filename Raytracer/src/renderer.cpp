@@ -0,0 +1,381 @@
+﻿#include "renderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#include "denoiser.h"
+#include "material.h"
+#include "parallel.h"
+#include "trace.h"
+
+
+const char* pixel_sampler_name(const Pixel_Sampler sampler)
+{
+	switch (sampler) {
+	case Pixel_Sampler::Random: return "random";
+	case Pixel_Sampler::Stratified: return "stratified";
+	}
+	return "unknown";
+}
+
+// Every scene intersection query on this thread, render() turns the difference over a tile into ray counts
+static thread_local uint64_t rays_traced = 0;
+
+// Max depth and Russian roulette depth of the tile this thread renders, ray_color() turns its remaining depth into
+// a bounce number with them
+static thread_local int tile_max_depth      = 0;
+static thread_local int tile_roulette_depth = 0;
+
+#if RAYTRACER_STATS
+static int depth_bin(const int depth)
+{
+	return std::min(tile_max_depth - depth, ray_stats_depth_bins - 1);
+}
+#endif
+
+// Light sample towards one emitter, weighted against the chance the BSDF sample finds the same emitter
+static Color3 sample_light(const Ray& r, const Hit_Record& record, const Scene& scene)
+{
+	Light_Sample light;
+	if (!scene.lights.sample(record.p, record.normal, light)) {
+		return {0, 0, 0};
+	}
+
+	const Color3 f = record.mat_ptr->eval(r, record, light.direction);
+	RAY_STAT(material_evals++);
+	if (f.near_zero()) {
+		return {0, 0, 0};
+	}
+
+	// Shadow ray, the light is only visible if it's the closest thing along the direction
+	const Ray shadow_ray(record.p, light.direction);
+	Hit_Record shadow_record;
+	rays_traced++;
+	RAY_STAT(shadow_rays++);
+	if (!scene.world.hit(shadow_ray, 0.001f, infinity, shadow_record) || shadow_record.object != light.object ||
+		shadow_record.primitive != light.primitive) {
+		return {0, 0, 0};
+	}
+
+	const float weight = power_heuristic(light.pdf, record.mat_ptr->pdf(r, record, light.direction));
+	return f * shadow_record.mat_ptr->emitted(shadow_ray, shadow_record) * (weight / light.pdf);
+}
+
+// Environment sample, weighted against the BSDF sample the same way
+static Color3 sample_environment(const Ray& r, const Hit_Record& record, const Scene& scene)
+{
+	Vec3 direction;
+	float pdf;
+	if (!scene.environment || !scene.environment->sample(direction, pdf)) {
+		return {0, 0, 0};
+	}
+
+	const Color3 f = record.mat_ptr->eval(r, record, direction);
+	RAY_STAT(material_evals++);
+	if (f.near_zero()) {
+		return {0, 0, 0};
+	}
+
+	// The environment is only visible if the ray escapes
+	Hit_Record shadow_record;
+	rays_traced++;
+	RAY_STAT(shadow_rays++);
+	if (scene.world.hit(Ray(record.p, direction), 0.001f, infinity, shadow_record)) {
+		return {0, 0, 0};
+	}
+
+	const float weight = power_heuristic(pdf, record.mat_ptr->pdf(r, record, direction));
+	return f * scene.environment->radiance(direction) * (weight / pdf);
+}
+
+// What a camera ray sees first, for the AOVs
+struct First_Hit {
+	Color3 albedo;
+	Vec3 normal;
+	float depth              = infinity;
+	const Material* material = nullptr;
+	const Hittable* object   = nullptr;
+	int primitive            = 0;
+};
+
+// Recursive
+// bsdf_pdf is the density the previous bounce sampled r with, zero for camera rays and specular bounces,
+// prev_normal the surface normal at r's origin, first_hit is filled in for camera rays when given
+static Color3 ray_color(const Ray& r, const Scene& scene, int depth, float bsdf_pdf = 0.0f, const Vec3& prev_normal = Vec3(),
+                        First_Hit* first_hit = nullptr)
+{
+	Hit_Record record;
+
+	if (depth <= 0) {
+		RAY_STAT(paths_depth_cap++);
+		return {0.0f, 0.0f, 0.0f};
+	}
+
+	rays_traced++;
+	RAY_STAT(rays_by_depth[depth_bin(depth)]++);
+
+	// Sphere hit if true
+	if (scene.world.hit(r, 0.001f, infinity, record)) {
+		const Material& material = *record.mat_ptr;
+		Color3 color             = material.emitted(r, record);
+
+		if (first_hit) {
+			first_hit->albedo    = material.reflectance(record);
+			first_hit->normal    = record.normal;
+			first_hit->depth     = record.t * r.direction().length();
+			first_hit->material  = record.mat_ptr.get();
+			first_hit->object    = record.object;
+			first_hit->primitive = record.primitive;
+		}
+
+		// An emitter found by a BSDF sample shares its estimate with the light sample of the previous bounce
+		if (bsdf_pdf > 0.0f && !scene.lights.empty()) {
+			color *= power_heuristic(bsdf_pdf, scene.lights.pdf(r.origin(), prev_normal, record.object, record.primitive));
+		}
+
+		// Nothing found past the last bounce could reach the camera anyway
+		if (depth == 1) {
+			RAY_STAT(paths_depth_cap++);
+			return color;
+		}
+
+		if (!material.is_specular()) {
+			color += sample_light(r, record, scene);
+			color += sample_environment(r, record, scene);
+		}
+
+		Bsdf_Sample bsdf;
+		RAY_STAT(material_samples++);
+
+		if (!material.sample(r, record, bsdf)) {
+			RAY_STAT(paths_absorbed++);
+			return color;
+		}
+
+		// Russian roulette, paths continue with the bounce's largest weight as their chance and make up for the
+		// ones ended with a larger weight. The floor keeps rare survivors from turning into fireflies.
+		if (tile_roulette_depth > 0 && tile_max_depth - depth >= tile_roulette_depth) {
+			const float survival = std::min(std::max(std::max(bsdf.weight.r, bsdf.weight.g), std::max(bsdf.weight.b, 0.05f)), 1.0f);
+			if (random_float() >= survival) {
+				RAY_STAT(paths_absorbed++);
+				return color;
+			}
+			bsdf.weight /= survival;
+		}
+
+		color += bsdf.weight * ray_color(Ray(record.p, bsdf.direction), scene, depth - 1, bsdf.pdf, record.normal);
+		return color;
+		// const point3 target = record.p + random_in_hemisphere(record.normal);
+		// return 0.5f * ray_color(ray(record.p, target - record.p), world, depth-1);
+	}
+
+	RAY_STAT(paths_missed++);
+
+	if (!scene.environment) {
+		return {0.0f, 0.0f, 0.0f};
+	}
+
+	Color3 color = scene.environment->radiance(r.direction());
+
+	if (first_hit) {
+		first_hit->albedo = color;
+	}
+
+	// Same MIS weighting as for emitters, against the environment sample of the previous bounce
+	if (bsdf_pdf > 0.0f) {
+		color *= power_heuristic(bsdf_pdf, scene.environment->pdf(r.direction()));
+	}
+	return color;
+}
+
+// Position of sample s inside the pixel, both coordinates in [0, 1)
+static void pixel_offset(const Pixel_Sampler sampler, const int strata, const int s, float& dx, float& dy)
+{
+	if (sampler == Pixel_Sampler::Stratified && s < strata * strata) {
+		dx = (static_cast<float>(s % strata) + random_float()) / static_cast<float>(strata);
+		dy = (static_cast<float>(s / strata) + random_float()) / static_cast<float>(strata);
+		return;
+	}
+	dx = random_float();
+	dy = random_float();
+}
+
+// Largest standard error of a pixel's mean over the channels, relative to the channel's value. The offset keeps
+// dark pixels, whose relative error never gets small, from taking every sample.
+static float relative_error(const Aov_Pixel& pixel)
+{
+	if (pixel.samples < 2) return infinity;
+
+	const float n = static_cast<float>(pixel.samples);
+	float worst   = 0.0f;
+	for (int c = 0; c < 3; c++) {
+		const float mean     = pixel.beauty.e[c] / n;
+		const float variance = std::max(pixel.beauty_squares.e[c] - n * mean * mean, 0.0f) / (n - 1.0f);
+		worst                = std::max(worst, std::sqrt(variance / n) / (mean + 0.05f));
+	}
+	return worst;
+}
+
+// Traces every sample of a tile into its own buffers, which need the same AOVs as the frame. Returns the number of
+// samples taken.
+static uint64_t render_tile(const Tile& tile, const Scene& world, const Camera& cam, const Render_Settings& settings, Aov_Buffers& out)
+{
+	tile_max_depth      = settings.max_depth;
+	tile_roulette_depth = settings.roulette_depth;
+
+	// Timing every pixel costs two clock reads, only paid when the render time AOV is wanted
+	using Clock      = std::chrono::steady_clock;
+	const bool timed = out.enabled(Aov::Render_Time);
+
+	const int strata      = static_cast<int>(std::sqrt(static_cast<float>(settings.samples_per_pixel)));
+	const bool adaptive   = settings.adaptive_error > 0.0f;
+	const int check_every = std::max(settings.adaptive_min_samples, 2);
+	uint64_t samples      = 0;
+
+	for (int ty = 0; ty < tile.height; ty++) {
+		// Camera v runs bottom to top
+		const int y = settings.height - 1 - (tile.y0 + ty);
+
+		for (int tx = 0; tx < tile.width; tx++) {
+			const int x = tile.x0 + tx;
+
+			const auto pixel_start = timed ? Clock::now() : Clock::time_point();
+
+			Aov_Pixel pixel;
+			for (int s = 0; s < settings.samples_per_pixel; s++) {
+				// Converged pixels stop early, checked every few samples since one lucky streak looks converged too
+				if (adaptive && s > 0 && s % check_every == 0 && relative_error(pixel) < settings.adaptive_error) break;
+
+				float dx, dy;
+				pixel_offset(settings.sampler, strata, s, dx, dy);
+				const auto u = (static_cast<float>(x) + dx) / (settings.width - 1);
+				const auto v = (static_cast<float>(y) + dy) / (settings.height - 1);
+				Ray r        = cam.get_ray(u, v);
+
+				First_Hit first_hit;
+				Aov_Sample sample;
+				const uint64_t tests_before = intersection_tests;
+
+				sample.beauty         = ray_color(r, world, settings.max_depth, 0.0f, Vec3(), &first_hit);
+				sample.albedo         = first_hit.albedo;
+				sample.normal         = first_hit.normal;
+				sample.depth          = first_hit.depth;
+				sample.material_id    = world.material_id(first_hit.material);
+				sample.object_id      = world.object_id(first_hit.object, first_hit.primitive);
+				sample.traversal_cost = intersection_tests - tests_before;
+				pixel.add(sample);
+			}
+			if (timed) {
+				pixel.render_time_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - pixel_start).count());
+			}
+			out.store(tx, ty, pixel);
+			samples += static_cast<uint64_t>(pixel.samples);
+		}
+	}
+	return samples;
+}
+
+bool Renderer::render(const Scene& scene, const Camera& camera, Aov_Buffers& framebuffer, const Tile_Callback& on_tile,
+                      Render_Stats* stats) const
+{
+	const bool full_frame = framebuffer.width > 0 || framebuffer.height > 0;
+
+	if (settings.width <= 0 || settings.height <= 0 || settings.samples_per_pixel <= 0 || settings.tile_size <= 0) {
+		std::cerr << "Renderer::render() - Error: image size, samples per pixel and tile size must be positive\n";
+		return false;
+	}
+	if (settings.roulette_depth < 0 || settings.adaptive_error < 0.0f) {
+		std::cerr << "Renderer::render() - Error: Russian roulette depth and adaptive error can't be negative\n";
+		return false;
+	}
+	if (full_frame && (framebuffer.width != settings.width || framebuffer.height != settings.height)) {
+		std::cerr << "Renderer::render() - Error: framebuffer is " << framebuffer.width << 'x' << framebuffer.height
+			<< ", the settings ask for " << settings.width << 'x' << settings.height << '\n';
+		return false;
+	}
+	if (settings.denoise && !(framebuffer.enabled(Aov::Albedo) && framebuffer.enabled(Aov::Normal) && framebuffer.enabled(Aov::Depth))) {
+		std::cerr << "Renderer::render() - Error: denoising needs a framebuffer with albedo, normal and depth\n";
+		return false;
+	}
+	if ((framebuffer.enabled(Aov::Object_Id) && scene.object_id_count() > max_exact_aov_id) ||
+		(framebuffer.enabled(Aov::Material_Id) && scene.material_id_count() > max_exact_aov_id)) {
+		std::cerr << "Renderer::render() - Error: id AOVs hold at most " << max_exact_aov_id << " distinct ids, the scene has "
+			<< scene.object_id_count() << " objects and " << scene.material_id_count() << " materials\n";
+		return false;
+	}
+
+	// Tiles render the framebuffer's AOVs, or only the beauty image when nothing but on_tile sees them
+	const std::vector<Aov> aovs = full_frame ? framebuffer.enabled_aovs() : std::vector<Aov>();
+
+	Trace_Span span("render", "render");
+
+	std::vector<Tile> tiles;
+	for (int y0 = 0; y0 < settings.height; y0 += settings.tile_size) {
+		for (int x0 = 0; x0 < settings.width; x0 += settings.tile_size) {
+			tiles.push_back({x0, y0, std::min(settings.tile_size, settings.width - x0), std::min(settings.tile_size, settings.height - y0)});
+		}
+	}
+
+	std::atomic<uint64_t> total_rays(0);
+	std::atomic<uint64_t> total_samples(0);
+	std::vector<Ray_Stats> tile_stats(tiles.size()); // Each written by its own tile, no locking needed
+
+	// parallel_for() runs tiles on this thread too, and each tile reseeds the thread's generator
+	const Pcg32 caller_rng = thread_rng();
+
+	parallel_for(static_cast<int>(tiles.size()), [&](const int i) {
+		const Tile& tile = tiles[i];
+
+		trace_name_thread("render worker");
+		Trace_Span tile_span("tile", "render");
+		if (trace_enabled()) {
+			tile_span.set_args("\"index\": " + std::to_string(i) + ", \"x\": " + std::to_string(tile.x0) + ", \"y\": " + std::to_string(tile.y0));
+		}
+
+		// Every tile restarts its random sequence so the image doesn't depend on which thread rendered it
+		seed_random(hash_seed(settings.seed, static_cast<uint64_t>(i)));
+
+		Aov_Buffers tile_buffers(tile.width, tile.height, aovs);
+		const uint64_t rays_before   = rays_traced;
+		const Ray_Stats stats_before = thread_ray_stats();
+		total_samples += render_tile(tile, scene, camera, settings, tile_buffers);
+		total_rays += rays_traced - rays_before;
+		tile_stats[i] = thread_ray_stats();
+		tile_stats[i] -= stats_before;
+
+		if (full_frame) {
+			framebuffer.store_tile(tile.x0, tile.y0, tile_buffers);
+		}
+		if (on_tile) {
+			on_tile(tile, tile_buffers);
+		}
+	}, settings.thread_count);
+
+	thread_rng() = caller_rng;
+
+	if (stats) {
+		// Every sample starts with exactly one camera ray
+		stats->primary_rays   += total_samples;
+		stats->secondary_rays += total_rays - total_samples;
+		for (const auto& tile : tile_stats) stats->rays += tile;
+	}
+
+	if (settings.denoise) {
+		Trace_Span denoise_span("denoise", "render");
+		Hdr_Image& color = framebuffer[Aov::Beauty];
+		Denoise_Settings denoise_settings;
+		denoise_settings.threads = settings.thread_count;
+		denoise(color, framebuffer[Aov::Albedo], framebuffer[Aov::Normal], framebuffer[Aov::Depth], color, denoise_settings);
+	}
+
+	return true;
+}
+
+bool render(const Scene& scene, const Camera& camera, const Render_Settings& settings, Aov_Buffers& framebuffer)
+{
+	return Renderer(settings).render(scene, camera, framebuffer);
+}
@@ -0,0 +1,82 @@
+﻿// /*
+//  * renderer.h
+//  */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "aov.h"
+#include "camera.h"
+#include "ray_stats.h"
+#include "scene.h"
+#include "tonemap.h"
+
+// Where in the pixel the camera samples land
+enum class Pixel_Sampler {
+	Random,     // Independent uniform positions
+	Stratified, // One jittered position per cell of a sqrt(spp) x sqrt(spp) grid, uniform for the samples left over
+};
+
+const char* pixel_sampler_name(Pixel_Sampler sampler);
+
+// Settings for one render
+struct Render_Settings {
+	int width                   = 800;
+	int height                  = 533;
+	int samples_per_pixel       = 50; // The most a pixel takes with adaptive sampling
+	int max_depth               = 6;
+	int tile_size               = 32;
+	unsigned thread_count       = 0; // Zero for every hardware thread
+	uint64_t seed               = 0;
+	Pixel_Sampler sampler       = Pixel_Sampler::Random;
+	int roulette_depth          = 0;    // Bounces before Russian roulette may end a path, zero for never
+	float adaptive_error        = 0.0f; // Pixels stop once their relative standard error is below this, zero to take every sample
+	int adaptive_min_samples    = 16;   // Samples before, and between, adaptive error checks
+	bool denoise                = false; // Needs a framebuffer with albedo, normal and depth
+	Tone_Operator tone_operator = Tone_Operator::Gamma_2;
+	float exposure              = 1.0f;
+};
+
+// Block of the image handed to one worker, row 0 at the top
+struct Tile {
+	int x0;
+	int y0;
+	int width;
+	int height;
+};
+
+// Rays one render traced, summed over its threads
+struct Render_Stats {
+	uint64_t primary_rays   = 0; // Camera rays, one per sample
+	uint64_t secondary_rays = 0; // Bounces, light and environment shadow rays
+	Ray_Stats rays;              // Detailed counters, zero when built with RAYTRACER_STATS=0
+};
+
+// Path traces scenes with fixed settings. render() only reads the renderer, the scene and the camera and keeps
+// its state on the stack and in thread-local storage, so renders of the same or different (built) scenes can
+// run concurrently from any number of threads.
+class Renderer {
+public:
+	// Called on worker threads as tiles finish, concurrently for different tiles. The buffers hold the tile's
+	// pixels and may be moved from.
+	using Tile_Callback = std::function<void(const Tile& tile, Aov_Buffers& buffers)>;
+
+	explicit Renderer(const Render_Settings& settings) : settings(settings) {}
+
+	// Fills every AOV enabled in the framebuffer, which is either settings.width x settings.height or empty when
+	// on_tile consumes the tiles (then only the beauty image is traced). Ray counts are added to stats when given.
+	// False when the settings can't be used.
+	bool render(const Scene& scene, const Camera& camera, Aov_Buffers& framebuffer, const Tile_Callback& on_tile = nullptr,
+	            Render_Stats* stats = nullptr) const;
+
+	const Render_Settings& render_settings() const { return settings; }
+
+private:
+	Render_Settings settings;
+};
+
+// Renders one frame, see Renderer::render()
+bool render(const Scene& scene, const Camera& camera, const Render_Settings& settings, Aov_Buffers& framebuffer);
@@ -0,0 +1,59 @@
+﻿#include "scene.h"
+
+#include "instance_set.h"
+#include "sphere_set.h"
+#include "trace.h"
+#include "triangle_mesh.h"
+
+
+// Materials in the order objects use them, through instances into the geometry they share
+static void add_material_ids(const Hittable* object, std::unordered_map<const Material*, int>& material_ids)
+{
+	const auto add = [&](const shared_ptr<Material>& material) {
+		material_ids.emplace(material.get(), static_cast<int>(material_ids.size()));
+	};
+
+	if (const auto* sphere = dynamic_cast<const Sphere*>(object)) {
+		add(sphere->mat_ptr);
+	}
+	else if (const auto* set = dynamic_cast<const Sphere_Set*>(object)) {
+		for (const auto& material : set->material_table()) add(material);
+	}
+	else if (const auto* mesh = dynamic_cast<const Triangle_Mesh*>(object)) {
+		for (const auto& material : mesh->material_table()) add(material);
+	}
+	else if (const auto* instances = dynamic_cast<const Instance_Set*>(object)) {
+		for (const auto& material : instances->material_table()) add(material);
+		for (const auto& geometry : instances->geometry_table()) add_material_ids(geometry.get(), material_ids);
+	}
+}
+
+void Scene::build()
+{
+	Trace_Span span("finalize scene", "scene");
+	lights.build();
+
+	// Objects are numbered in the order they were added, materials in the order they are first used
+	object_ids.clear();
+	material_ids.clear();
+	int next_object_id = 0;
+
+	for (const auto& object : world.objects) {
+		object_ids.emplace(object.get(), next_object_id);
+		next_object_id += object->primitive_count();
+		add_material_ids(object.get(), material_ids);
+	}
+	object_count = next_object_id;
+}
+
+int Scene::object_id(const Hittable* object, const int primitive) const
+{
+	const auto found = object_ids.find(object);
+	return found != object_ids.end() ? found->second + primitive : -1;
+}
+
+int Scene::material_id(const Material* material) const
+{
+	const auto found = material_ids.find(material);
+	return found != material_ids.end() ? found->second : -1;
+}
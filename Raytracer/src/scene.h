@@ -0,0 +1,43 @@
+﻿// /*
+//  * scene.h
+//  */
+
+#pragma once
+
+#include <unordered_map>
+
+#include "environment.h"
+#include "hittables.h"
+#include "lights.h"
+#include "sphere.h"
+
+struct Scene {
+	Hittables world;
+	Lights lights;
+	shared_ptr<Environment> environment = make_shared<Gradient_Sky>(); // Null for scenes lit only by emitters
+
+	void add(shared_ptr<Hittable> object) { world.add(object); }
+
+	// Emissive spheres go in both the world and the light list
+	void add_light(shared_ptr<Sphere> light)
+	{
+		world.add(light);
+		lights.add(light);
+	}
+
+	// Builds acceleration structures and assigns ids, call once the scene is complete
+	void build();
+
+	// Ids for the object and material AOVs, -1 for anything build() didn't see. Every primitive of an object
+	// gets its own object id.
+	int object_id(const Hittable* object, int primitive = 0) const;
+	int material_id(const Material* material) const;
+
+	int object_id_count() const { return object_count; }
+	int material_id_count() const { return static_cast<int>(material_ids.size()); }
+
+private:
+	std::unordered_map<const Hittable*, int> object_ids;
+	std::unordered_map<const Material*, int> material_ids;
+	int object_count = 0;
+};
@@ -0,0 +1,242 @@
+﻿#include "scene_cache.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+#include "mapped_file.h"
+#include "sphere_set.h"
+#include "trace.h"
+
+
+static constexpr char cache_magic[8] = {'R', 'T', 'C', 'A', 'C', 'H', 'E', 0};
+static constexpr uint32_t cache_version = 2;
+static constexpr uint64_t section_alignment = 64;
+
+static_assert(std::is_trivially_copyable<Bvh_Node>::value && sizeof(Bvh_Node) == 32, "Bvh_Node is stored raw");
+static_assert(std::is_trivially_copyable<Sphere_Desc>::value && sizeof(Sphere_Desc) == 20, "Sphere_Desc is stored raw");
+
+struct Cache_Section {
+	uint64_t offset; // From the start of the file
+	uint64_t size;   // In bytes
+};
+
+enum Cache_Sections {
+	Environment_Map_Path,
+	Materials,
+	Center_X,
+	Center_Y,
+	Center_Z,
+	Radius,
+	Sphere_Materials,
+	Nodes,
+	Section_Count
+};
+
+struct Cache_Header {
+	char magic[8];
+	uint32_t version;
+	int32_t width;
+	int32_t height;
+	int32_t samples_per_pixel;
+	int32_t max_depth;
+	Camera_Desc camera;
+	Environment_Type environment;
+	float environment_strength;
+	float environment_rotation;
+	uint32_t material_count;
+	uint32_t light_count; // Spheres with light materials among sphere_count
+	uint32_t sphere_count;
+	uint32_t node_count;
+	Cache_Section sections[Section_Count];
+};
+
+// Every byte is a field, so a value-initialized header has no indeterminate padding to write to disk
+static_assert(sizeof(Cache_Header) == 104 + Section_Count * sizeof(Cache_Section), "Cache_Header has no implicit padding");
+
+static uint64_t align_up(const uint64_t value)
+{
+	return (value + section_alignment - 1) & ~(section_alignment - 1);
+}
+
+bool is_scene_cache(const std::string& path)
+{
+	char magic[sizeof(cache_magic)] = {};
+	std::ifstream file(path, std::ios::binary);
+	file.read(magic, sizeof(magic));
+	return file.gcount() == sizeof(magic) && memcmp(magic, cache_magic, sizeof(magic)) == 0;
+}
+
+bool save_scene_cache(const std::string& path, const Scene_Description& description)
+{
+	if (!host_is_little_endian()) {
+		std::cerr << "save_scene_cache() - Error: scene caches are only supported on little-endian hosts\n";
+		return false;
+	}
+	if (!description.meshes.empty() || !description.instances.empty()) {
+		std::cerr << "save_scene_cache() - Error: scene caches can't hold meshes or instances\n";
+		return false;
+	}
+
+	// Same set as build_scene() makes, emitters included
+	uint32_t light_count = 0;
+	for (const auto& sphere : description.spheres) {
+		if (description.materials[sphere.material].type == Material_Type::Light) light_count++;
+	}
+
+	const Sphere_Set set(description.spheres, {});
+	const Sphere_Arrays& arrays = set.data();
+
+	Cache_Header header{};
+	memcpy(header.magic, cache_magic, sizeof(cache_magic));
+	header.version              = cache_version;
+	header.width                = description.width;
+	header.height               = description.height;
+	header.samples_per_pixel    = description.samples_per_pixel;
+	header.max_depth            = description.max_depth;
+	header.camera               = description.camera;
+	header.environment          = description.environment;
+	header.environment_strength = description.environment_strength;
+	header.environment_rotation = description.environment_rotation;
+	header.material_count       = static_cast<uint32_t>(description.materials.size());
+	header.light_count          = light_count;
+	header.sphere_count         = arrays.sphere_count;
+	header.node_count           = arrays.node_count;
+
+	const void* sources[Section_Count] = {
+		description.environment_map.data(), description.materials.data(), arrays.center_x, arrays.center_y, arrays.center_z, arrays.radius, arrays.material, arrays.nodes
+	};
+	const uint64_t sizes[Section_Count] = {
+		description.environment_map.size(),
+		description.materials.size() * sizeof(Material_Desc),
+		arrays.sphere_count * sizeof(float),
+		arrays.sphere_count * sizeof(float),
+		arrays.sphere_count * sizeof(float),
+		arrays.sphere_count * sizeof(float),
+		arrays.sphere_count * sizeof(uint32_t),
+		arrays.node_count * sizeof(Bvh_Node)
+	};
+
+	uint64_t file_size = align_up(sizeof(header));
+	for (int i = 0; i < Section_Count; i++) {
+		header.sections[i] = {file_size, sizes[i]};
+		file_size          = align_up(file_size + sizes[i]);
+	}
+
+	Mapped_File file;
+	if (!file.create(path, file_size)) return false;
+
+	memcpy(file.data(), &header, sizeof(header));
+	for (int i = 0; i < Section_Count; i++) {
+		if (sizes[i] > 0) memcpy(file.data() + header.sections[i].offset, sources[i], sizes[i]);
+	}
+
+	return file.close();
+}
+
+bool load_scene_cache(const std::string& path, Scene_Description& description, Scene& scene)
+{
+	Trace_Span span("load scene cache", "scene");
+	if (!host_is_little_endian()) {
+		std::cerr << "load_scene_cache() - Error: scene caches are only supported on little-endian hosts\n";
+		return false;
+	}
+
+	auto file = make_shared<Mapped_File>();
+	if (!file->open_read(path)) return false;
+
+	Cache_Header header;
+	if (file->size() < sizeof(header)) {
+		std::cerr << "load_scene_cache() - Error: " << path << " is not a scene cache\n";
+		return false;
+	}
+	memcpy(&header, file->data(), sizeof(header));
+
+	if (memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.version != cache_version) {
+		std::cerr << "load_scene_cache() - Error: " << path << " is not a version " << cache_version << " scene cache\n";
+		return false;
+	}
+
+	const uint64_t expected[Section_Count] = {
+		header.sections[Environment_Map_Path].size,
+		static_cast<uint64_t>(header.material_count) * sizeof(Material_Desc),
+		static_cast<uint64_t>(header.sphere_count) * sizeof(float),
+		static_cast<uint64_t>(header.sphere_count) * sizeof(float),
+		static_cast<uint64_t>(header.sphere_count) * sizeof(float),
+		static_cast<uint64_t>(header.sphere_count) * sizeof(float),
+		static_cast<uint64_t>(header.sphere_count) * sizeof(uint32_t),
+		static_cast<uint64_t>(header.node_count) * sizeof(Bvh_Node)
+	};
+
+	for (int i = 0; i < Section_Count; i++) {
+		const Cache_Section& section = header.sections[i];
+		if (section.size != expected[i] || section.offset % section_alignment != 0 ||
+			section.offset > file->size() || section.size > file->size() - section.offset) {
+			std::cerr << "load_scene_cache() - Error: " << path << " is truncated or corrupt\n";
+			return false;
+		}
+	}
+
+	const uint8_t* base = file->data();
+	const auto section  = [&](const Cache_Sections i) { return base + header.sections[i].offset; };
+
+	description                      = Scene_Description();
+	description.width                = header.width;
+	description.height               = header.height;
+	description.samples_per_pixel    = header.samples_per_pixel;
+	description.max_depth            = header.max_depth;
+	description.camera               = header.camera;
+	description.environment          = header.environment;
+	description.environment_strength = header.environment_strength;
+	description.environment_rotation = header.environment_rotation;
+	description.environment_map.assign(reinterpret_cast<const char*>(section(Environment_Map_Path)),
+	                                   header.sections[Environment_Map_Path].size);
+	description.materials.resize(header.material_count);
+	memcpy(description.materials.data(), section(Materials), header.sections[Materials].size);
+
+	if (!known_types(description)) {
+		std::cerr << "load_scene_cache() - Error: " << path << " has an unknown material or environment type\n";
+		return false;
+	}
+
+	const auto materials = build_materials(description.materials);
+
+	scene = Scene();
+
+	if (header.sphere_count > 0) {
+		// Checked once here so the traversal and shading can trust the mapped arrays as they are
+		const auto* sphere_materials = reinterpret_cast<const uint32_t*>(section(Sphere_Materials));
+		for (uint32_t i = 0; i < header.sphere_count; i++) {
+			if (sphere_materials[i] >= header.material_count) {
+				std::cerr << "load_scene_cache() - Error: " << path << " has a sphere with an invalid material\n";
+				return false;
+			}
+		}
+		if (!valid_bvh(reinterpret_cast<const Bvh_Node*>(section(Nodes)), header.node_count, header.sphere_count)) {
+			std::cerr << "load_scene_cache() - Error: " << path << " has a corrupt BVH\n";
+			return false;
+		}
+
+		Sphere_Arrays arrays;
+		arrays.center_x     = reinterpret_cast<const float*>(section(Center_X));
+		arrays.center_y     = reinterpret_cast<const float*>(section(Center_Y));
+		arrays.center_z     = reinterpret_cast<const float*>(section(Center_Z));
+		arrays.radius       = reinterpret_cast<const float*>(section(Radius));
+		arrays.material     = sphere_materials;
+		arrays.nodes        = reinterpret_cast<const Bvh_Node*>(section(Nodes));
+		arrays.sphere_count = header.sphere_count;
+		arrays.node_count   = header.node_count;
+
+		add_sphere_set(scene, make_shared<Sphere_Set>(arrays, materials, file), description.materials);
+	}
+
+	if (scene.lights.objects.size() != header.light_count) {
+		std::cerr << "load_scene_cache() - Error: " << path << " has " << scene.lights.objects.size() << " lights, the header says "
+				  << header.light_count << '\n';
+		return false;
+	}
+
+	scene.environment = build_environment(description);
+	return true;
+}
@@ -0,0 +1,30 @@
+﻿// /*
+//  * scene_cache.h
+//  */
+
+#pragma once
+
+#include <string>
+
+#include "scene.h"
+#include "scene_file.h"
+
+// A scene cache is a snapshot of a built scene: the settings, the material table and the sphere set's arrays
+// (emitters included) together with its BVH nodes. Every section sits at a 64-byte aligned offset from the start of
+// the file and nothing in it is a pointer, so a cache is mapped read-only and rendered from in place. Repeated
+// renders skip parsing and the BVH build, and processes rendering the same cache share its pages.
+//
+// Loading checks the section bounds, the material and environment types, every sphere's material index, the
+// light count and the BVH layout (children, leaf ranges and depth, see valid_bvh()), so a corrupt file can't
+// make the renderer read out of bounds. Floats are still trusted: NaN centers or inverted node bounds render
+// wrongly rather than fail. Caches are meant to be written by save_scene_cache() rather than edited.
+
+// True when the file starts with the cache magic number
+bool is_scene_cache(const std::string& path);
+
+// Builds the acceleration structure for the description and writes the snapshot
+bool save_scene_cache(const std::string& path, const Scene_Description& description);
+
+// Maps a cache, the scene's sphere set points straight into the mapping. description receives the settings,
+// camera, environment and materials but no spheres.
+bool load_scene_cache(const std::string& path, Scene_Description& description, Scene& scene);
@@ -0,0 +1,586 @@
+﻿#include "scene_file.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+#include <unordered_map>
+
+#include "environment.h"
+#include "hdr_image.h"
+#include "instance_set.h"
+#include "mapped_file.h"
+#include "material.h"
+#include "sphere_set.h"
+#include "trace.h"
+
+
+static constexpr char binary_magic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', 0};
+static constexpr uint32_t binary_version = 1;
+
+static_assert(std::is_trivially_copyable<Material_Desc>::value && sizeof(Material_Desc) == 20, "Material_Desc is stored raw");
+static_assert(std::is_trivially_copyable<Sphere_Desc>::value && sizeof(Sphere_Desc) == 20, "Sphere_Desc is stored raw");
+static_assert(std::is_trivially_copyable<Camera_Desc>::value && sizeof(Camera_Desc) == 48, "Camera_Desc is stored raw");
+
+// Fixed size block at the start of a binary scene, followed by the environment map path, the material table and
+// the spheres
+struct Binary_Header {
+	char magic[8];
+	uint32_t version;
+	int32_t width;
+	int32_t height;
+	int32_t samples_per_pixel;
+	int32_t max_depth;
+	Camera_Desc camera;
+	Environment_Type environment;
+	float environment_strength;
+	float environment_rotation;
+	uint32_t environment_map_length;
+	uint32_t material_count;
+	uint64_t sphere_count;
+};
+
+// Every byte is a field, so a value-initialized header has no indeterminate padding to write to disk
+static_assert(sizeof(Binary_Header) == 104, "Binary_Header has no implicit padding");
+
+// Cursor over the text of a scene file, one line at a time
+class Scene_Parser {
+public:
+	Scene_Parser(const char* begin, const char* end, const std::string& path) : cursor(begin), end(end), path(path) {}
+
+	// Moves to the first token of the next non-empty line, false at the end of the file
+	bool next_line()
+	{
+		while (cursor < end) {
+			line++;
+			skip_blanks();
+			if (cursor < end && *cursor != '\n' && *cursor != '\r') return true;
+			skip_line();
+		}
+		return false;
+	}
+
+	bool at_line_end()
+	{
+		skip_blanks();
+		return cursor >= end || *cursor == '\n' || *cursor == '\r';
+	}
+
+	void skip_line()
+	{
+		while (cursor < end && *cursor != '\n') cursor++;
+		if (cursor < end) cursor++;
+	}
+
+	bool word(std::string& out)
+	{
+		skip_blanks();
+		const char* start = cursor;
+		while (cursor < end && !is_blank(*cursor) && *cursor != '\n' && *cursor != '\r' && *cursor != '#') cursor++;
+		out.assign(start, cursor);
+		return !out.empty() || fail("expected a word");
+	}
+
+	bool number(float& out)
+	{
+		skip_blanks();
+		char* parsed_end;
+		out = std::strtof(cursor, &parsed_end);
+		if (parsed_end == cursor || parsed_end > end) return fail("expected a number");
+		cursor = parsed_end;
+		return true;
+	}
+
+	bool number(int& out)
+	{
+		float value;
+		if (!number(value)) return false;
+		out = static_cast<int>(value);
+		return true;
+	}
+
+	bool vec3(Vec3& out) { return number(out.x) && number(out.y) && number(out.z); }
+
+	bool fail(const std::string& message) const
+	{
+		std::cerr << "load_scene_text() - Error: " << path << ':' << line << ": " << message << '\n';
+		return false;
+	}
+
+private:
+	static bool is_blank(const char c) { return c == ' ' || c == '\t'; }
+
+	void skip_blanks()
+	{
+		while (cursor < end && is_blank(*cursor)) cursor++;
+		if (cursor < end && *cursor == '#') {
+			while (cursor < end && *cursor != '\n' && *cursor != '\r') cursor++;
+		}
+	}
+
+	const char* cursor;
+	const char* end;
+	const std::string& path;
+	int line = 0;
+};
+
+static bool parse_material(Scene_Parser& parser, Material_Desc& material)
+{
+	std::string type;
+	if (!parser.word(type)) return false;
+
+	material.color     = Color3(0, 0, 0);
+	material.parameter = 0.0f;
+
+	if (type == "lambertian") {
+		material.type = Material_Type::Lambertian;
+		return parser.vec3(material.color);
+	}
+	if (type == "metal") {
+		material.type = Material_Type::Metal;
+		return parser.vec3(material.color) && parser.number(material.parameter);
+	}
+	if (type == "dielectric") {
+		material.type = Material_Type::Dielectric;
+		return parser.number(material.parameter);
+	}
+	if (type == "light") {
+		material.type = Material_Type::Light;
+		return parser.vec3(material.color);
+	}
+	return parser.fail("unknown material type '" + type + "'");
+}
+
+// Transforms up to the end of the line, each applied after the ones before it
+static bool parse_transform(Scene_Parser& parser, Transform& transform)
+{
+	std::string operation;
+	transform = Transform();
+
+	while (!parser.at_line_end()) {
+		if (!parser.word(operation)) return false;
+
+		Vec3 v;
+		float degrees;
+		if (operation == "translate") {
+			if (!parser.vec3(v)) return false;
+			transform = Transform::translate(v) * transform;
+		}
+		else if (operation == "scale") {
+			if (!parser.vec3(v)) return false;
+			transform = Transform::scale(v) * transform;
+		}
+		else if (operation == "rotate") {
+			if (!parser.vec3(v) || !parser.number(degrees)) return false;
+			if (v.length2() == 0.0f) return parser.fail("rotation axis has zero length");
+			transform = Transform::rotate(v, degrees) * transform;
+		}
+		else {
+			return parser.fail("unknown transform '" + operation + "'");
+		}
+	}
+
+	if (!(std::fabs(transform.determinant()) > 0.0f)) return parser.fail("instance transform is singular");
+	return true;
+}
+
+bool load_scene_text(const std::string& path, Scene_Description& scene)
+{
+	// Read in one go rather than mapped, strtof() needs a terminator it can't run past
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (!file) {
+		std::cerr << "load_scene_text() - Error: Could not open " << path << '\n';
+		return false;
+	}
+
+	std::string text(static_cast<size_t>(file.tellg()), '\0');
+	file.seekg(0);
+	file.read(&text[0], static_cast<std::streamsize>(text.size()));
+
+	Scene_Parser parser(text.c_str(), text.c_str() + text.size(), path);
+
+	scene = Scene_Description();
+	std::unordered_map<std::string, uint32_t> material_names;
+	std::unordered_map<std::string, uint32_t> geometry_names;
+	std::string keyword;
+	std::string name;
+
+	while (parser.next_line()) {
+		if (!parser.word(keyword)) return false;
+
+		bool ok;
+		if (keyword == "sphere") {
+			Sphere_Desc sphere;
+			ok = parser.vec3(sphere.center) && parser.number(sphere.radius) && parser.word(name);
+			if (ok) {
+				const auto found = material_names.find(name);
+				if (found == material_names.end()) return parser.fail("undefined material '" + name + "'");
+				sphere.material = found->second;
+				scene.spheres.push_back(sphere);
+			}
+		}
+		else if (keyword == "mesh") {
+			Mesh_Desc mesh;
+			ok = parser.word(mesh.path) && parser.word(name);
+			if (ok) {
+				const auto found = material_names.find(name);
+				if (found == material_names.end()) return parser.fail("undefined material '" + name + "'");
+				mesh.material = found->second;
+				scene.meshes.push_back(mesh);
+			}
+		}
+		else if (keyword == "geometry") {
+			Geometry_Desc geometry;
+			std::string type;
+			ok = parser.word(name) && parser.word(type);
+			if (ok && type == "sphere") {
+				geometry.type = Geometry_Type::Sphere;
+			}
+			else if (ok && type == "mesh") {
+				geometry.type = Geometry_Type::Mesh;
+				ok            = parser.word(geometry.path);
+			}
+			else if (ok) {
+				return parser.fail("unknown geometry type '" + type + "'");
+			}
+			if (ok) {
+				if (!geometry_names.emplace(name, static_cast<uint32_t>(scene.geometries.size())).second) {
+					return parser.fail("geometry '" + name + "' is defined twice");
+				}
+				scene.geometries.push_back(geometry);
+			}
+		}
+		else if (keyword == "instance") {
+			Instance_Desc instance;
+			ok = parser.word(name);
+			if (ok) {
+				const auto found = geometry_names.find(name);
+				if (found == geometry_names.end()) return parser.fail("undefined geometry '" + name + "'");
+				instance.geometry = found->second;
+				ok                = parser.word(name);
+			}
+			if (ok) {
+				const auto found = material_names.find(name);
+				if (found == material_names.end()) return parser.fail("undefined material '" + name + "'");
+				instance.material = found->second;
+			}
+			ok = ok && parse_transform(parser, instance.transform);
+			if (ok) scene.instances.push_back(instance);
+		}
+		else if (keyword == "material") {
+			Material_Desc material;
+			ok = parser.word(name) && parse_material(parser, material);
+			if (ok) {
+				if (!material_names.emplace(name, static_cast<uint32_t>(scene.materials.size())).second) {
+					return parser.fail("material '" + name + "' is defined twice");
+				}
+				scene.materials.push_back(material);
+			}
+		}
+		else if (keyword == "camera") {
+			Camera_Desc& camera = scene.camera;
+			ok = parser.vec3(camera.look_from) && parser.vec3(camera.look_at) && parser.vec3(camera.up) &&
+				 parser.number(camera.fov) && parser.number(camera.aperture) && parser.number(camera.focus_dist);
+		}
+		else if (keyword == "image") {
+			ok = parser.number(scene.width) && parser.number(scene.height);
+			if (ok && (scene.width <= 0 || scene.height <= 0)) return parser.fail("image size must be positive");
+		}
+		else if (keyword == "samples") {
+			ok = parser.number(scene.samples_per_pixel);
+		}
+		else if (keyword == "depth") {
+			ok = parser.number(scene.max_depth);
+		}
+		else if (keyword == "environment") {
+			ok = parser.word(name);
+			if (ok && name == "none") {
+				scene.environment = Environment_Type::None;
+			}
+			else if (ok && name == "gradient") {
+				scene.environment = Environment_Type::Gradient;
+				ok                = parser.number(scene.environment_strength);
+			}
+			else if (ok && name == "map") {
+				scene.environment = Environment_Type::Map;
+				ok = parser.word(scene.environment_map) && parser.number(scene.environment_strength) &&
+					 parser.number(scene.environment_rotation);
+			}
+			else if (ok) {
+				return parser.fail("unknown environment '" + name + "'");
+			}
+		}
+		else {
+			return parser.fail("unknown keyword '" + keyword + "'");
+		}
+
+		if (!ok) return false;
+		if (!parser.at_line_end()) return parser.fail("unexpected text after '" + keyword + "'");
+		parser.skip_line();
+	}
+
+	return true;
+}
+
+bool load_scene_binary(const std::string& path, Scene_Description& scene)
+{
+	if (!host_is_little_endian()) {
+		std::cerr << "load_scene_binary() - Error: binary scenes are only supported on little-endian hosts\n";
+		return false;
+	}
+
+	Mapped_File file;
+	if (!file.open_read(path)) return false;
+
+	Binary_Header header;
+	if (file.size() < sizeof(header)) {
+		std::cerr << "load_scene_binary() - Error: " << path << " is not a binary scene\n";
+		return false;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+
+	if (memcmp(header.magic, binary_magic, sizeof(binary_magic)) != 0 || header.version != binary_version) {
+		std::cerr << "load_scene_binary() - Error: " << path << " is not a version " << binary_version << " binary scene\n";
+		return false;
+	}
+
+	const uint64_t material_bytes = static_cast<uint64_t>(header.material_count) * sizeof(Material_Desc);
+	const uint64_t sphere_bytes   = header.sphere_count * sizeof(Sphere_Desc);
+	if (file.size() != sizeof(header) + header.environment_map_length + material_bytes + sphere_bytes) {
+		std::cerr << "load_scene_binary() - Error: " << path << " is truncated\n";
+		return false;
+	}
+
+	const uint8_t* data     = file.data() + sizeof(header);
+	scene                   = Scene_Description();
+	scene.width             = header.width;
+	scene.height            = header.height;
+	scene.samples_per_pixel = header.samples_per_pixel;
+	scene.max_depth         = header.max_depth;
+	scene.camera            = header.camera;
+	scene.environment          = header.environment;
+	scene.environment_strength = header.environment_strength;
+	scene.environment_rotation = header.environment_rotation;
+	scene.environment_map.assign(reinterpret_cast<const char*>(data), header.environment_map_length);
+	data += header.environment_map_length;
+
+	scene.materials.resize(header.material_count);
+	memcpy(scene.materials.data(), data, material_bytes);
+	data += material_bytes;
+
+	scene.spheres.resize(header.sphere_count);
+	memcpy(scene.spheres.data(), data, sphere_bytes);
+
+	for (const auto& sphere : scene.spheres) {
+		if (sphere.material >= header.material_count) {
+			std::cerr << "load_scene_binary() - Error: " << path << " has a sphere with an invalid material\n";
+			return false;
+		}
+	}
+	if (!known_types(scene)) {
+		std::cerr << "load_scene_binary() - Error: " << path << " has an unknown material or environment type\n";
+		return false;
+	}
+
+	return true;
+}
+
+bool save_scene_binary(const std::string& path, const Scene_Description& scene)
+{
+	if (!host_is_little_endian()) {
+		std::cerr << "save_scene_binary() - Error: binary scenes are only supported on little-endian hosts\n";
+		return false;
+	}
+	if (!scene.meshes.empty() || !scene.instances.empty()) {
+		std::cerr << "save_scene_binary() - Error: binary scenes can't hold meshes or instances\n";
+		return false;
+	}
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << "save_scene_binary() - Error: Could not open " << path << " for writing\n";
+		return false;
+	}
+
+	Binary_Header header{};
+	memcpy(header.magic, binary_magic, sizeof(binary_magic));
+	header.version                = binary_version;
+	header.width                  = scene.width;
+	header.height                 = scene.height;
+	header.samples_per_pixel      = scene.samples_per_pixel;
+	header.max_depth              = scene.max_depth;
+	header.camera                 = scene.camera;
+	header.environment            = scene.environment;
+	header.environment_strength   = scene.environment_strength;
+	header.environment_rotation   = scene.environment_rotation;
+	header.environment_map_length = static_cast<uint32_t>(scene.environment_map.size());
+	header.material_count         = static_cast<uint32_t>(scene.materials.size());
+	header.sphere_count           = scene.spheres.size();
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(scene.environment_map.data(), static_cast<std::streamsize>(scene.environment_map.size()));
+	file.write(reinterpret_cast<const char*>(scene.materials.data()), static_cast<std::streamsize>(scene.materials.size() * sizeof(Material_Desc)));
+	file.write(reinterpret_cast<const char*>(scene.spheres.data()), static_cast<std::streamsize>(scene.spheres.size() * sizeof(Sphere_Desc)));
+
+	if (!file) {
+		std::cerr << "save_scene_binary() - Error: Could not write " << path << '\n';
+		return false;
+	}
+	return true;
+}
+
+bool load_scene(const std::string& path, Scene_Description& scene)
+{
+	Trace_Span span("load scene", "scene");
+	char magic[sizeof(binary_magic)] = {};
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		std::cerr << "load_scene() - Error: Could not open " << path << '\n';
+		return false;
+	}
+	file.read(magic, sizeof(magic));
+
+	const bool binary = file.gcount() == sizeof(magic) && memcmp(magic, binary_magic, sizeof(magic)) == 0;
+	return binary ? load_scene_binary(path, scene) : load_scene_text(path, scene);
+}
+
+bool known_types(const Scene_Description& scene)
+{
+	for (const auto& material : scene.materials) {
+		if (static_cast<uint32_t>(material.type) > static_cast<uint32_t>(Material_Type::Light)) return false;
+	}
+	return static_cast<uint32_t>(scene.environment) <= static_cast<uint32_t>(Environment_Type::Map);
+}
+
+std::vector<shared_ptr<Material>> build_materials(const std::vector<Material_Desc>& descriptions)
+{
+	std::vector<shared_ptr<Material>> materials;
+	materials.reserve(descriptions.size());
+
+	for (const auto& material : descriptions) {
+		switch (material.type) {
+			case Material_Type::Lambertian: materials.push_back(make_shared<Lambertian>(material.color)); break;
+			case Material_Type::Metal: materials.push_back(make_shared<Metal>(material.color, material.parameter)); break;
+			case Material_Type::Dielectric: materials.push_back(make_shared<Dielectric>(material.parameter)); break;
+			case Material_Type::Light: materials.push_back(make_shared<Diffuse_Light>(material.color)); break;
+			// Loaders reject unknown types, keep the indices in step if one gets here anyway
+			default: materials.push_back(make_shared<Lambertian>(material.color)); break;
+		}
+	}
+
+	return materials;
+}
+
+shared_ptr<Environment> build_environment(const Scene_Description& description)
+{
+	switch (description.environment) {
+		case Environment_Type::None: return nullptr;
+		case Environment_Type::Gradient: return make_shared<Gradient_Sky>(description.environment_strength);
+		case Environment_Type::Map: {
+			Hdr_Image map;
+			if (!load_hdr_image(description.environment_map, map)) {
+				std::cerr << "build_environment() - Error: " << description.environment_map << " could not be loaded, using the gradient sky\n";
+				return make_shared<Gradient_Sky>(description.environment_strength);
+			}
+			return make_shared<Environment_Map>(std::move(map), description.environment_strength, description.environment_rotation);
+		}
+	}
+	return nullptr;
+}
+
+// Each geometry is built for the first instance that uses it, taking that instance's material as its own. Instances
+// of meshes that couldn't be loaded are dropped.
+static shared_ptr<Instance_Set> build_instances(const Scene_Description& description, const std::vector<shared_ptr<Material>>& materials,
+												std::vector<Mesh_Load_Info>* mesh_loads)
+{
+	constexpr uint32_t not_built = 0xffffffffu;
+	constexpr uint32_t failed    = 0xfffffffeu;
+
+	std::vector<uint32_t> geometry_slots(description.geometries.size(), not_built);
+	std::vector<shared_ptr<Hittable>> geometries;
+	std::vector<Aabb> geometry_bounds;
+	std::vector<Instance> instances;
+	instances.reserve(description.instances.size());
+
+	for (const auto& instance : description.instances) {
+		uint32_t& slot = geometry_slots[instance.geometry];
+
+		if (slot == not_built) {
+			const Geometry_Desc& geometry = description.geometries[instance.geometry];
+			const auto& material          = materials[instance.material];
+
+			if (geometry.type == Geometry_Type::Sphere) {
+				slot = static_cast<uint32_t>(geometries.size());
+				geometries.push_back(make_shared<Sphere>(Point3(0, 0, 0), 1.0f, material));
+				geometry_bounds.emplace_back(Point3(-1, -1, -1), Point3(1, 1, 1));
+			}
+			else {
+				Mesh_Data mesh_data;
+				Mesh_Load_Info info;
+				slot = failed;
+
+				if (load_mesh(geometry.path, mesh_data, &info)) {
+					const auto mesh = make_shared<Triangle_Mesh>(std::move(mesh_data), std::vector<shared_ptr<Material>>{material});
+					slot            = static_cast<uint32_t>(geometries.size());
+					geometries.push_back(mesh);
+					geometry_bounds.push_back(mesh->bounds());
+					if (mesh_loads) mesh_loads->push_back(info);
+				}
+			}
+		}
+
+		if (slot != failed) instances.push_back({slot, instance.material, instance.transform});
+	}
+
+	return make_shared<Instance_Set>(std::move(geometries), geometry_bounds, instances, materials);
+}
+
+void add_sphere_set(Scene& scene, shared_ptr<Sphere_Set> set, const std::vector<Material_Desc>& materials)
+{
+	const Sphere_Arrays& arrays = set->data();
+
+	for (uint32_t i = 0; i < arrays.sphere_count; i++) {
+		const uint32_t material = arrays.material[i];
+		if (materials[material].type != Material_Type::Light) continue;
+
+		const Point3 center(arrays.center_x[i], arrays.center_y[i], arrays.center_z[i]);
+		scene.lights.add(make_shared<Sphere>(center, arrays.radius[i], set->material_table()[material]), set.get(), static_cast<int>(i));
+	}
+
+	scene.add(std::move(set));
+}
+
+Scene build_scene(const Scene_Description& description, std::vector<Mesh_Load_Info>* mesh_loads)
+{
+	Trace_Span span("build scene", "scene");
+	Scene scene;
+	const auto materials = build_materials(description.materials);
+
+	if (!description.spheres.empty()) {
+		add_sphere_set(scene, make_shared<Sphere_Set>(description.spheres, materials), description.materials);
+	}
+
+	// Emissive meshes glow where they're hit but aren't sampled as lights
+	for (const auto& mesh_desc : description.meshes) {
+		Mesh_Data mesh;
+		Mesh_Load_Info info;
+		if (!load_mesh(mesh_desc.path, mesh, &info)) continue;
+
+		scene.add(make_shared<Triangle_Mesh>(std::move(mesh), std::vector<shared_ptr<Material>>{materials[mesh_desc.material]}));
+		if (mesh_loads) mesh_loads->push_back(info);
+	}
+
+	if (!description.instances.empty()) {
+		scene.add(build_instances(description, materials, mesh_loads));
+	}
+
+	scene.environment = build_environment(description);
+	return scene;
+}
+
+Camera build_camera(const Camera_Desc& camera, const float aspect_ratio)
+{
+	return {camera.look_from, camera.look_at, camera.up, camera.fov, aspect_ratio, camera.aperture, camera.focus_dist};
+}
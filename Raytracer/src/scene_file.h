@@ -0,0 +1,136 @@
+﻿// /*
+//  * scene_file.h
+//  */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "mesh_file.h"
+#include "scene.h"
+#include "sphere_set.h"
+#include "math/transform.h"
+#include "math/vec3.h"
+
+// Scene files hold a camera, render settings, an environment, a material table and spheres. The text form is
+// meant to be written by hand or by exporters:
+//
+//   # Comments run to the end of the line
+//   image 800 533
+//   samples 50
+//   depth 6
+//   camera 3 1 3  0 0 0  0 1 0  25 0.1 4     # look_from, look_at, up, vertical fov, aperture, focus distance
+//   environment gradient 1                   # or: environment none, environment map sky.hdr <strength> <degrees>
+//   material ground lambertian 0.8 0.8 0     # lambertian <albedo>, metal <albedo> <fuzz>, dielectric <ior>,
+//   material lamp light 4 4 4                # light <emitted>
+//   sphere 0 -100.5 -1 100 ground            # center, radius, material name
+//   mesh bunny.ply ground                    # .obj or .ply file (see mesh_file.h), material name
+//   geometry ball sphere                     # shared by instances: the unit sphere, or mesh <path>
+//   instance ball lamp scale 2 2 2 translate 0 1 0   # geometry, material, then transforms applied in order:
+//                                            # translate x y z, scale x y z, rotate axis_x axis_y axis_z degrees
+//
+// The binary form stores the same thing as flat little-endian arrays that are copied in with a single read, for
+// scenes with millions of spheres. load_scene() tells them apart by the magic number. It has no meshes or
+// instances, their geometry already has files of its own.
+
+enum class Material_Type : uint32_t {
+	Lambertian,
+	Metal,
+	Dielectric,
+	Light,
+};
+
+struct Material_Desc {
+	Material_Type type;
+	Color3 color;    // Albedo, or emitted radiance for lights
+	float parameter; // Fuzz for metal, index of refraction for dielectrics
+};
+
+struct Mesh_Desc {
+	std::string path; // As given, relative to the working directory
+	uint32_t material;
+};
+
+enum class Geometry_Type : uint32_t {
+	Sphere, // Unit sphere at the origin
+	Mesh,
+};
+
+struct Geometry_Desc {
+	Geometry_Type type;
+	std::string path; // Mesh file
+};
+
+struct Instance_Desc {
+	uint32_t geometry;
+	uint32_t material;
+	Transform transform; // Object to world
+};
+
+struct Camera_Desc {
+	Point3 look_from   = Point3(3, 1, 3);
+	Point3 look_at     = Point3(0, 0, 0);
+	Vec3 up            = Vec3(0, 1, 0);
+	float fov          = 25.0f;
+	float aperture     = 0.1f;
+	float focus_dist   = 4.0f;
+};
+
+enum class Environment_Type : uint32_t {
+	None,
+	Gradient,
+	Map,
+};
+
+struct Scene_Description {
+	// Zero keeps the renderer's own setting
+	int width             = 0;
+	int height            = 0;
+	int samples_per_pixel = 0;
+	int max_depth         = 0;
+
+	Camera_Desc camera;
+
+	Environment_Type environment = Environment_Type::Gradient;
+	float environment_strength   = 1.0f;
+	float environment_rotation   = 0.0f; // Degrees around +y
+	std::string environment_map;
+
+	std::vector<Material_Desc> materials;
+	std::vector<Sphere_Desc> spheres;
+	std::vector<Mesh_Desc> meshes;
+	std::vector<Geometry_Desc> geometries;
+	std::vector<Instance_Desc> instances;
+};
+
+// Reads either form, errors (with line numbers for text files) are reported on stderr
+bool load_scene(const std::string& path, Scene_Description& scene);
+
+bool load_scene_text(const std::string& path, Scene_Description& scene);
+bool load_scene_binary(const std::string& path, Scene_Description& scene);
+bool save_scene_binary(const std::string& path, const Scene_Description& scene);
+
+// False if a description read from disk names a material or environment type this build doesn't know
+bool known_types(const Scene_Description& scene);
+
+// One Material per table entry
+std::vector<shared_ptr<Material>> build_materials(const std::vector<Material_Desc>& descriptions);
+
+// Null for Environment_Type::None. A map that can't be loaded is reported on stderr and replaced by the gradient
+// sky at the same strength.
+shared_ptr<Environment> build_environment(const Scene_Description& description);
+
+// Adds a sphere set to the scene. Its spheres with light materials also go in the light list, which finds them
+// again by their index in the set, so emitters are traced through the set's BVH like every other sphere.
+void add_sphere_set(Scene& scene, shared_ptr<Sphere_Set> set, const std::vector<Material_Desc>& materials);
+
+// All spheres share one Sphere_Set, those with light materials are also lights. Meshes are loaded and get a BVH of
+// their own, instances share one Instance_Set and each geometry is built once however many instances use it.
+// Meshes that can't be loaded are reported on stderr and left out, what the others cost to load is appended to
+// mesh_loads.
+Scene build_scene(const Scene_Description& description, std::vector<Mesh_Load_Info>* mesh_loads = nullptr);
+
+Camera build_camera(const Camera_Desc& camera, float aspect_ratio);
@@ -1,5 +1,8 @@
 ﻿#include "sphere.h"
 
+#include "ray_stats.h"
+#include "math/onb.h"
+
 
 bool Sphere::hit(const Ray& r, float t_min, float t_max, Hit_Record& record) const
 {
@@ -8,6 +11,7 @@ bool Sphere::hit(const Ray& r, float t_min, float t_max, Hit_Record& record) con
 	const auto b_half       = dot(oc, r.direction());
 	const auto c            = oc.length2() - radius * radius;
 	const auto discriminant = b_half * b_half - a * c;
+	RAY_STAT(primitive_tests++);
 
 	if (discriminant < 0) return false;
 	const auto sqrt_d = sqrtf(discriminant);
@@ -28,6 +32,48 @@ bool Sphere::hit(const Ray& r, float t_min, float t_max, Hit_Record& record) con
 	// Should normal always point outward from the surface or always point against the ray?
 	const Vec3 outward_normal = (record.p - center) / radius;
 	record.set_face_normal(r, outward_normal);
-	record.mat_ptr = mat_ptr;
+	record.mat_ptr   = mat_ptr;
+	record.object    = this;
+	record.primitive = 0;
 	return true;
 }
+
+// 1 - cos(theta_max) of the cone subtended by the sphere, written to stay accurate for small, distant spheres
+static float cone_solid_angle_term(const float radius2, const float dist2)
+{
+	const float sin2_max = radius2 / dist2;
+	return sin2_max / (1.0f + sqrtf(1.0f - sin2_max));
+}
+
+bool Sphere::sample_direction(const Point3& origin, Vec3& direction, float& pdf) const
+{
+	const Vec3 to_center = center - origin;
+	const float dist2    = to_center.length2();
+	const float radius2  = radius * radius;
+
+	if (dist2 <= radius2) return false;
+
+	const float one_minus_cos_max = cone_solid_angle_term(radius2, dist2);
+
+	// Uniform cone sampling: cos(theta) uniform in [cos_max, 1]
+	const float r1        = random_float();
+	const float r2        = random_float();
+	const float cos_theta = 1.0f - r1 * one_minus_cos_max;
+	const float sin_theta = sqrtf(fmaxf(0.0f, 1.0f - cos_theta * cos_theta));
+	const float phi       = 2.0f * pi * r2;
+
+	const Onb uvw(to_center / sqrtf(dist2));
+	direction = uvw.local(cosf(phi) * sin_theta, sinf(phi) * sin_theta, cos_theta);
+	pdf       = 1.0f / (2.0f * pi * one_minus_cos_max);
+	return true;
+}
+
+float Sphere::pdf_value(const Point3& origin) const
+{
+	const float dist2   = (center - origin).length2();
+	const float radius2 = radius * radius;
+
+	if (dist2 <= radius2) return 0.0f;
+
+	return 1.0f / (2.0f * pi * cone_solid_angle_term(radius2, dist2));
+}
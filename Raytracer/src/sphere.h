@@ -5,6 +5,7 @@
 #pragma once
 #include "hittable.h"
 #include "ray.h"
+#include "math/aabb.h"
 #include "math/numeric.h"
 #include "math/vec3.h"
 
@@ -17,6 +18,18 @@ public:
 
 	bool hit(const Ray& r, float t_min, float t_max, Hit_Record& record) const override;
 
+	Aabb bounding_box() const
+	{
+		const float r = fabs(radius);
+		return {center - Vec3(r, r, r), center + Vec3(r, r, r)};
+	}
+
+	// Samples a direction from origin uniformly over the cone the sphere subtends, false if origin is inside
+	bool sample_direction(const Point3& origin, Vec3& direction, float& pdf) const;
+
+	// Solid angle density of sample_direction() for any direction from origin that hits the sphere
+	float pdf_value(const Point3& origin) const;
+
 	Point3 center;
 	float radius;
 	shared_ptr<Material> mat_ptr;
@@ -0,0 +1,103 @@
+﻿#include "sphere_set.h"
+
+#include "ray_stats.h"
+
+
+Sphere_Set::Sphere_Set(const std::vector<Sphere_Desc>& spheres, std::vector<shared_ptr<Material>> materials)
+	: materials(std::move(materials))
+{
+	std::vector<Aabb> bounds;
+	bounds.reserve(spheres.size());
+	for (const auto& sphere : spheres) {
+		const float r = fabs(sphere.radius);
+		bounds.emplace_back(sphere.center - Vec3(r, r, r), sphere.center + Vec3(r, r, r));
+	}
+
+	std::vector<uint32_t> order;
+	build_bvh(bounds, owned_nodes, order);
+
+	const size_t n = spheres.size();
+	owned_floats.resize(4 * n);
+	owned_materials.resize(n);
+
+	for (size_t i = 0; i < n; i++) {
+		const Sphere_Desc& sphere = spheres[order[i]];
+		owned_floats[i]           = sphere.center.x;
+		owned_floats[n + i]       = sphere.center.y;
+		owned_floats[2 * n + i]   = sphere.center.z;
+		owned_floats[3 * n + i]   = sphere.radius;
+		owned_materials[i]        = sphere.material;
+	}
+
+	arrays.center_x     = owned_floats.data();
+	arrays.center_y     = owned_floats.data() + n;
+	arrays.center_z     = owned_floats.data() + 2 * n;
+	arrays.radius       = owned_floats.data() + 3 * n;
+	arrays.material     = owned_materials.data();
+	arrays.nodes        = owned_nodes.data();
+	arrays.sphere_count = static_cast<uint32_t>(n);
+	arrays.node_count   = static_cast<uint32_t>(owned_nodes.size());
+}
+
+Sphere_Set::Sphere_Set(const Sphere_Arrays& arrays, std::vector<shared_ptr<Material>> materials,
+                       shared_ptr<const void> storage)
+	: arrays(arrays), materials(std::move(materials)), storage(std::move(storage))
+{
+}
+
+bool Sphere_Set::hit(const Ray& r, const float t_min, float t_max, Hit_Record& record) const
+{
+	if (arrays.node_count == 0) return false;
+
+	const Point3 origin   = r.origin();
+	const Vec3 direction  = r.direction();
+	const Vec3 inv_dir    = Vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	const float a         = direction.length2();
+	uint64_t sphere_count = 0; // Ray-sphere tests for the statistics
+	int64_t closest       = -1;
+	float closest_t       = t_max;
+	Bvh_Walk_Counts counts;
+
+	walk_bvh(arrays.nodes, origin, inv_dir, t_min, closest_t, counts, [&](const uint32_t first, const uint32_t count) {
+		sphere_count += count;
+		for (uint32_t i = first; i < first + count; i++) {
+			const float ox      = origin.x - arrays.center_x[i];
+			const float oy      = origin.y - arrays.center_y[i];
+			const float oz      = origin.z - arrays.center_z[i];
+			const float radius  = arrays.radius[i];
+			const float b_half  = ox * direction.x + oy * direction.y + oz * direction.z;
+			const float c       = ox * ox + oy * oy + oz * oz - radius * radius;
+			const float discriminant = b_half * b_half - a * c;
+
+			if (discriminant < 0) continue;
+			const float sqrt_d = sqrtf(discriminant);
+
+			// Nearest root in range, the same choice Sphere::hit() makes
+			float root = (-b_half - sqrt_d) / a;
+			if (root < t_min || root > closest_t) {
+				root = (-b_half + sqrt_d) / a;
+				if (root < t_min || root > closest_t) continue;
+			}
+
+			closest_t = root;
+			closest   = i;
+		}
+	});
+
+	intersection_tests += counts.nodes + sphere_count;
+	RAY_STAT(box_tests += counts.boxes);
+	RAY_STAT(primitive_tests += sphere_count);
+	if (closest < 0) return false;
+
+	const auto i = static_cast<uint32_t>(closest);
+	record.t     = closest_t;
+	record.p     = r.at(closest_t);
+
+	const Point3 center       = Point3(arrays.center_x[i], arrays.center_y[i], arrays.center_z[i]);
+	const Vec3 outward_normal = (record.p - center) / arrays.radius[i];
+	record.set_face_normal(r, outward_normal);
+	record.mat_ptr   = materials[arrays.material[i]];
+	record.object    = this;
+	record.primitive = static_cast<int>(i);
+	return true;
+}
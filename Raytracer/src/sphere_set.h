@@ -0,0 +1,58 @@
+﻿// /*
+//  * sphere_set.h
+//  */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "bvh.h"
+#include "hittable.h"
+#include "hittables.h"
+
+struct Sphere_Desc {
+	Point3 center;
+	float radius;
+	uint32_t material; // Index into the set's material table
+};
+
+// Read-only views of a sphere set's structure of arrays, spheres stored in BVH leaf order
+struct Sphere_Arrays {
+	const float* center_x    = nullptr;
+	const float* center_y    = nullptr;
+	const float* center_z    = nullptr;
+	const float* radius      = nullptr;
+	const uint32_t* material = nullptr;
+	const Bvh_Node* nodes    = nullptr;
+	uint32_t sphere_count    = 0;
+	uint32_t node_count      = 0;
+};
+
+// Many spheres behind one BVH, kept as flat arrays rather than individual objects. The arrays are either owned
+// or borrowed from elsewhere (a mapped scene cache) without being copied. Hits report the sphere's index in
+// Hit_Record::primitive.
+class Sphere_Set : public Hittable {
+public:
+	// Builds a BVH over the spheres and stores them in leaf order
+	Sphere_Set(const std::vector<Sphere_Desc>& spheres, std::vector<shared_ptr<Material>> materials);
+
+	// Uses arrays that are already laid out, storage keeps whatever holds them alive
+	Sphere_Set(const Sphere_Arrays& arrays, std::vector<shared_ptr<Material>> materials, shared_ptr<const void> storage);
+
+	bool hit(const Ray& r, float t_min, float t_max, Hit_Record& record) const override;
+
+	int primitive_count() const override { return static_cast<int>(arrays.sphere_count); }
+
+	const Sphere_Arrays& data() const { return arrays; }
+	const std::vector<shared_ptr<Material>>& material_table() const { return materials; }
+
+private:
+	Sphere_Arrays arrays;
+	std::vector<shared_ptr<Material>> materials;
+
+	std::vector<float> owned_floats;
+	std::vector<uint32_t> owned_materials;
+	std::vector<Bvh_Node> owned_nodes;
+	shared_ptr<const void> storage;
+};
@@ -0,0 +1,110 @@
+﻿#include "tonemap.h"
+
+#include <cmath>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TONEMAP_SSE2 1
+#include <emmintrin.h>
+#endif
+
+
+const char* tone_operator_name(const Tone_Operator op)
+{
+	switch (op) {
+		case Tone_Operator::Gamma_2: return "gamma2";
+		case Tone_Operator::Srgb: return "srgb";
+		case Tone_Operator::Reinhard: return "reinhard";
+		case Tone_Operator::Aces: return "aces";
+	}
+	return "unknown";
+}
+
+static float srgb_encode(const float linear)
+{
+	return linear <= 0.0031308f ? 12.92f * linear : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+}
+
+// Narkowicz 2015, "ACES Filmic Tone Mapping Curve"
+static constexpr float aces_a = 2.51f;
+static constexpr float aces_b = 0.03f;
+static constexpr float aces_c = 2.43f;
+static constexpr float aces_d = 0.59f;
+static constexpr float aces_e = 0.14f;
+
+Tone_Mapper::Tone_Mapper(const Tone_Operator op, const float exposure) : tone_op(op), exposure(exposure), lut(lut_size)
+{
+	for (int i = 0; i < lut_size; i++) {
+		const float v = static_cast<float>(i) / static_cast<float>(lut_size - 1);
+		lut[i]        = float_to_byte(op == Tone_Operator::Gamma_2 ? sqrtf(v) : clamp(srgb_encode(v), 0.0f, 1.0f));
+	}
+}
+
+void Tone_Mapper::resolve(const float* in, uint8_t* out, const size_t count) const
+{
+	constexpr float scale = static_cast<float>(lut_size - 1);
+	size_t i              = 0;
+
+#ifdef TONEMAP_SSE2
+	const __m128 v_exposure = _mm_set1_ps(exposure);
+	const __m128 v_zero     = _mm_setzero_ps();
+	const __m128 v_one      = _mm_set1_ps(1.0f);
+	const __m128 v_scale    = _mm_set1_ps(scale);
+	const __m128 v_half     = _mm_set1_ps(0.5f);
+	const __m128 v_a        = _mm_set1_ps(aces_a);
+	const __m128 v_b        = _mm_set1_ps(aces_b);
+	const __m128 v_c        = _mm_set1_ps(aces_c);
+	const __m128 v_d        = _mm_set1_ps(aces_d);
+	const __m128 v_e        = _mm_set1_ps(aces_e);
+
+	alignas(16) int32_t index[4];
+
+	for (; i + 4 <= count; i += 4) {
+		// max() with zero second also turns NaN into black
+		__m128 v = _mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), v_exposure), v_zero);
+
+		if (tone_op == Tone_Operator::Reinhard) {
+			v = _mm_div_ps(v, _mm_add_ps(v, v_one));
+		}
+		else if (tone_op == Tone_Operator::Aces) {
+			const __m128 num = _mm_mul_ps(v, _mm_add_ps(_mm_mul_ps(v, v_a), v_b));
+			const __m128 den = _mm_add_ps(_mm_mul_ps(v, _mm_add_ps(_mm_mul_ps(v, v_c), v_d)), v_e);
+			v                = _mm_div_ps(num, den);
+		}
+
+		v = _mm_min_ps(v, v_one);
+		_mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, v_scale), v_half)));
+
+		out[i + 0] = lut[index[0]];
+		out[i + 1] = lut[index[1]];
+		out[i + 2] = lut[index[2]];
+		out[i + 3] = lut[index[3]];
+	}
+#endif
+
+	for (; i < count; i++) {
+		float v = in[i] * exposure;
+		v       = v > 0.0f ? v : 0.0f;
+
+		if (tone_op == Tone_Operator::Reinhard) {
+			v = v / (v + 1.0f);
+		}
+		else if (tone_op == Tone_Operator::Aces) {
+			v = (v * (v * aces_a + aces_b)) / (v * (v * aces_c + aces_d) + aces_e);
+		}
+
+		v      = v < 1.0f ? v : 1.0f;
+		out[i] = lut[static_cast<int>(v * scale + 0.5f)];
+	}
+}
+
+void Tone_Mapper::resolve_bgr(const Color3* in, uint8_t* out, const int count) const
+{
+	static_assert(sizeof(Color3) == 3 * sizeof(float), "Color3 must be three packed floats");
+
+	resolve(&in->x, out, static_cast<size_t>(count) * 3);
+
+	for (int x = 0; x < count; x++) {
+		std::swap(out[x * 3 + 0], out[x * 3 + 2]);
+	}
+}
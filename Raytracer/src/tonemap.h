@@ -0,0 +1,43 @@
+﻿// /*
+//  * tonemap.h
+//  */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "math/vec3.h"
+
+enum class Tone_Operator {
+	Gamma_2,  // Clamp and gamma 2.0, what get_color() always did
+	Srgb,     // Clamp and the exact piecewise sRGB transfer curve
+	Reinhard, // x / (1 + x) per channel, then sRGB
+	Aces,     // Narkowicz's fit of the ACES filmic curve, then sRGB
+};
+
+const char* tone_operator_name(Tone_Operator op);
+
+// Resolves linear float pixels to 8-bit. The tone curve runs four channels at a time (SSE2 when available) and
+// display encoding is a table lookup, so a whole frame can be resolved for every progressive preview.
+class Tone_Mapper {
+public:
+	explicit Tone_Mapper(Tone_Operator op = Tone_Operator::Gamma_2, float exposure = 1.0f);
+
+	// Resolves count floats, channels are independent so any interleaving comes out in the same order
+	void resolve(const float* in, uint8_t* out, size_t count) const;
+
+	// One row of pixels in the BGR byte order BMP files use
+	void resolve_bgr(const Color3* in, uint8_t* out, int count) const;
+
+	Tone_Operator op() const { return tone_op; }
+
+private:
+	// Entries span [0, 1] after the tone curve, fine enough that neighbours differ by at most one code near black
+	static constexpr int lut_size = 1 << 16;
+
+	Tone_Operator tone_op;
+	float exposure;
+	std::vector<uint8_t> lut;
+};
@@ -0,0 +1,138 @@
+﻿#include "trace.h"
+
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Trace_Event {
+	const char* name;
+	const char* category;
+	int thread;
+	double start_us;
+	double duration_us;
+	std::string args;
+};
+
+struct Trace_Thread {
+	int id;
+	std::string name;
+};
+
+static std::atomic<bool> enabled(false);
+static std::atomic<int> next_thread_id(0);
+static Clock::time_point origin;
+
+static std::mutex mutex;
+static std::vector<Trace_Event> events;
+static std::vector<Trace_Thread> threads;
+
+// Small sequential ids read better in the viewer than hashed std::thread::ids
+static thread_local int thread_id     = -1;
+static thread_local bool thread_named = false;
+
+static int current_thread()
+{
+	if (thread_id < 0) thread_id = next_thread_id++;
+	return thread_id;
+}
+
+static double since_origin_us(const Clock::time_point time)
+{
+	return std::chrono::duration<double, std::micro>(time - origin).count();
+}
+
+static void write_json_text(std::ostream& out, const std::string& text)
+{
+	out << '"';
+	for (const char c : text) {
+		if (c == '"' || c == '\\') out << '\\';
+		out << c;
+	}
+	out << '"';
+}
+
+
+void trace_start()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (enabled) return;
+
+	origin = Clock::now();
+	enabled.store(true, std::memory_order_release);
+}
+
+bool trace_enabled()
+{
+	return enabled.load(std::memory_order_relaxed);
+}
+
+void trace_name_thread(const char* name)
+{
+	if (!trace_enabled() || thread_named) return;
+	thread_named = true;
+
+	const int id = current_thread();
+	std::lock_guard<std::mutex> lock(mutex);
+	threads.push_back({id, name});
+}
+
+bool trace_write(const std::string& path)
+{
+	std::ofstream file(path);
+	if (!file) {
+		std::cerr << "trace_write() - Error: Could not open " << path << " for writing\n";
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+	bool first = true;
+
+	for (const auto& thread : threads) {
+		file << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread.id
+			<< ", \"args\": {\"name\": ";
+		write_json_text(file, thread.name);
+		file << "}}";
+		first = false;
+	}
+
+	file << std::fixed << std::setprecision(3);
+	for (const auto& event : events) {
+		file << (first ? "\n" : ",\n") << "{\"name\": ";
+		write_json_text(file, event.name);
+		file << ", \"cat\": ";
+		write_json_text(file, event.category);
+		file << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread << ", \"ts\": " << event.start_us
+			<< ", \"dur\": " << event.duration_us;
+		if (!event.args.empty()) file << ", \"args\": {" << event.args << '}';
+		file << '}';
+		first = false;
+	}
+
+	file << "\n]}\n";
+	return static_cast<bool>(file);
+}
+
+Trace_Span::Trace_Span(const char* name, const char* category)
+	: name(name), category(category), active(trace_enabled())
+{
+	if (active) start = Clock::now();
+}
+
+Trace_Span::~Trace_Span()
+{
+	if (!active) return;
+
+	const auto end = Clock::now();
+	Trace_Event event{name, category, current_thread(), since_origin_us(start),
+	                  std::chrono::duration<double, std::micro>(end - start).count(), std::move(args)};
+
+	std::lock_guard<std::mutex> lock(mutex);
+	events.push_back(std::move(event));
+}
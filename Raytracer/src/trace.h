@@ -0,0 +1,41 @@
+﻿// /*
+//  * trace.h
+//  */
+
+#pragma once
+
+#include <chrono>
+#include <string>
+
+// Timeline of the render phases as Chrome trace events (chrome://tracing, ui.perfetto.dev). Recording is off
+// until trace_start(), a Trace_Span then costs one relaxed load. Spans are coarse (phases, tiles, file writes),
+// so recorded events go into one mutex-guarded list.
+
+void trace_start();
+bool trace_enabled();
+
+// Names the calling thread's track, the first name given sticks
+void trace_name_thread(const char* name);
+
+// Writes every event recorded so far, errors are reported on stderr
+bool trace_write(const std::string& path);
+
+// Records the time between construction and destruction as one complete event on the calling thread's track
+class Trace_Span {
+public:
+	Trace_Span(const char* name, const char* category);
+	~Trace_Span();
+
+	Trace_Span(const Trace_Span&)            = delete;
+	Trace_Span& operator=(const Trace_Span&) = delete;
+
+	// Extra key/value pairs shown with the event, a JSON object body such as "\"x\": 32, \"y\": 0"
+	void set_args(std::string json_members) { args = std::move(json_members); }
+
+private:
+	const char* name;
+	const char* category;
+	bool active;
+	std::chrono::steady_clock::time_point start;
+	std::string args;
+};
@@ -0,0 +1,272 @@
+﻿#include "triangle_mesh.h"
+
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+#include "ray_stats.h"
+
+
+// Ray transformed so that it runs along +z from the origin, the setup of Woop, Benthin and Wald's watertight
+// ray-triangle test (JCGT 2013). The triangle's vertices are sheared into that space and the edge functions
+// evaluated in 2D, so a ray through a shared edge or vertex hits at least one of the triangles meeting there.
+struct Watertight_Ray {
+	Point3 origin;
+	int kx, ky, kz; // Permuted axes, kz the largest component of the direction
+	float sx, sy, sz;
+};
+
+static Watertight_Ray watertight_ray(const Ray& r)
+{
+	const Vec3 d = r.direction();
+
+	Watertight_Ray ray;
+	ray.origin = r.origin();
+	ray.kz     = fabsf(d.x) > fabsf(d.y) ? (fabsf(d.x) > fabsf(d.z) ? 0 : 2) : (fabsf(d.y) > fabsf(d.z) ? 1 : 2);
+	ray.kx     = (ray.kz + 1) % 3;
+	ray.ky     = (ray.kx + 1) % 3;
+
+	// Keeps the winding, and with it the sign of the edge functions, the same whichever way the ray points
+	if (d[ray.kz] < 0.0f) std::swap(ray.kx, ray.ky);
+
+	ray.sx = d[ray.kx] / d[ray.kz];
+	ray.sy = d[ray.ky] / d[ray.kz];
+	ray.sz = 1.0f / d[ray.kz];
+	return ray;
+}
+
+// Distance and barycentric weights of p1 and p2 when the ray hits the triangle within (t_min, t_max)
+static bool hit_triangle(const Watertight_Ray& ray, const Point3& p0, const Point3& p1, const Point3& p2, const float t_min,
+                         const float t_max, float& t, float& b1, float& b2)
+{
+	const Vec3 a = p0 - ray.origin;
+	const Vec3 b = p1 - ray.origin;
+	const Vec3 c = p2 - ray.origin;
+
+	const float ax = a[ray.kx] - ray.sx * a[ray.kz];
+	const float ay = a[ray.ky] - ray.sy * a[ray.kz];
+	const float bx = b[ray.kx] - ray.sx * b[ray.kz];
+	const float by = b[ray.ky] - ray.sy * b[ray.kz];
+	const float cx = c[ray.kx] - ray.sx * c[ray.kz];
+	const float cy = c[ray.ky] - ray.sy * c[ray.kz];
+
+	float u = cx * by - cy * bx;
+	float v = ax * cy - ay * cx;
+	float w = bx * ay - by * ax;
+
+	// Exactly on an edge in single precision, double precision decides which side
+	if (u == 0.0f || v == 0.0f || w == 0.0f) {
+		u = static_cast<float>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx);
+		v = static_cast<float>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx);
+		w = static_cast<float>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax);
+	}
+
+	if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f)) return false;
+
+	float det = u + v + w;
+	if (det == 0.0f) return false;
+
+	const float az = ray.sz * a[ray.kz];
+	const float bz = ray.sz * b[ray.kz];
+	const float cz = ray.sz * c[ray.kz];
+	float scaled_t = u * az + v * bz + w * cz;
+
+	// Compare against the range before dividing
+	if (det < 0.0f) {
+		det      = -det;
+		scaled_t = -scaled_t;
+		u        = -u;
+		v        = -v;
+		w        = -w;
+	}
+	if (scaled_t <= t_min * det || scaled_t >= t_max * det) return false;
+
+	const float inv_det = 1.0f / det;
+	t                   = scaled_t * inv_det;
+	b1                  = v * inv_det;
+	b2                  = w * inv_det;
+	return true;
+}
+
+static bool valid_mesh(const Mesh_Data& mesh, const size_t material_count)
+{
+	const size_t vertices = mesh.positions.size();
+
+	if (mesh.indices.size() % 3 != 0) {
+		std::cerr << "Triangle_Mesh() - Error: " << mesh.indices.size() << " indices don't make whole triangles\n";
+		return false;
+	}
+	for (const uint32_t index : mesh.indices) {
+		if (index >= vertices) {
+			std::cerr << "Triangle_Mesh() - Error: vertex index " << index << " out of range, the mesh has " << vertices << " vertices\n";
+			return false;
+		}
+	}
+	if ((!mesh.normals.empty() && mesh.normals.size() != vertices) || (!mesh.uvs.empty() && mesh.uvs.size() != 2 * vertices)) {
+		std::cerr << "Triangle_Mesh() - Error: normals and uvs need one entry per vertex\n";
+		return false;
+	}
+	if (!mesh.materials.empty() && mesh.materials.size() != mesh.triangle_count()) {
+		std::cerr << "Triangle_Mesh() - Error: per-triangle materials need one entry per triangle\n";
+		return false;
+	}
+	for (const uint32_t material : mesh.materials) {
+		if (material >= material_count) {
+			std::cerr << "Triangle_Mesh() - Error: material " << material << " out of range, the table has " << material_count << " entries\n";
+			return false;
+		}
+	}
+	if (mesh.materials.empty() && mesh.triangle_count() > 0 && material_count == 0) {
+		std::cerr << "Triangle_Mesh() - Error: no material\n";
+		return false;
+	}
+	return true;
+}
+
+
+Triangle_Mesh::Triangle_Mesh(Mesh_Data mesh_data, std::vector<shared_ptr<Material>> materials)
+	: mesh(std::move(mesh_data)), materials(std::move(materials))
+{
+	if (!valid_mesh(mesh, this->materials.size())) {
+		mesh = Mesh_Data();
+		return;
+	}
+
+	const size_t n = mesh.triangle_count();
+	std::vector<Aabb> triangle_bounds(n);
+	for (size_t i = 0; i < n; i++) {
+		for (int corner = 0; corner < 3; corner++) {
+			triangle_bounds[i].expand(mesh.positions[mesh.indices[3 * i + corner]]);
+		}
+		box.expand(triangle_bounds[i]);
+	}
+
+	std::vector<uint32_t> order;
+	build_bvh(triangle_bounds, nodes, order);
+	triangle_bounds = std::vector<Aabb>();
+	nodes.shrink_to_fit();
+
+	// Triangles in leaf order
+	std::vector<uint32_t> indices(mesh.indices.size());
+	for (size_t i = 0; i < n; i++) {
+		for (int corner = 0; corner < 3; corner++) indices[3 * i + corner] = mesh.indices[3 * order[i] + corner];
+	}
+	mesh.indices = std::move(indices);
+
+	if (!mesh.materials.empty()) {
+		std::vector<uint32_t> triangle_materials(n);
+		for (size_t i = 0; i < n; i++) triangle_materials[i] = mesh.materials[order[i]];
+		mesh.materials = std::move(triangle_materials);
+	}
+}
+
+size_t Triangle_Mesh::memory_bytes() const
+{
+	return mesh.positions.capacity() * sizeof(Point3) + mesh.normals.capacity() * sizeof(Vec3) + mesh.uvs.capacity() * sizeof(float)
+		+ mesh.indices.capacity() * sizeof(uint32_t) + mesh.materials.capacity() * sizeof(uint32_t) + nodes.capacity() * sizeof(Bvh_Node);
+}
+
+bool Triangle_Mesh::hit(const Ray& r, const float t_min, const float t_max, Hit_Record& record) const
+{
+	if (nodes.empty()) return false;
+
+	const Vec3 direction     = r.direction();
+	const Vec3 inv_dir       = Vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+	const Watertight_Ray ray = watertight_ray(r);
+	const Point3* positions  = mesh.positions.data();
+	const uint32_t* indices  = mesh.indices.data();
+	uint64_t triangle_count  = 0; // Ray-triangle tests for the statistics
+	int64_t closest          = -1;
+	float closest_t          = t_max;
+	float closest_b1         = 0.0f;
+	float closest_b2         = 0.0f;
+	Bvh_Walk_Counts counts;
+
+	walk_bvh(nodes.data(), r.origin(), inv_dir, t_min, closest_t, counts, [&](const uint32_t first, const uint32_t count) {
+		triangle_count += count;
+		for (uint32_t i = first; i < first + count; i++) {
+			const uint32_t* corners = indices + 3 * static_cast<size_t>(i);
+			float t, b1, b2;
+			if (hit_triangle(ray, positions[corners[0]], positions[corners[1]], positions[corners[2]], t_min, closest_t, t, b1, b2)) {
+				closest_t  = t;
+				closest    = i;
+				closest_b1 = b1;
+				closest_b2 = b2;
+			}
+		}
+	});
+
+	intersection_tests += counts.nodes + triangle_count;
+	RAY_STAT(box_tests += counts.boxes);
+	RAY_STAT(primitive_tests += triangle_count);
+	if (closest < 0) return false;
+
+	const auto i         = static_cast<size_t>(closest);
+	const uint32_t i0    = indices[3 * i];
+	const uint32_t i1    = indices[3 * i + 1];
+	const uint32_t i2    = indices[3 * i + 2];
+	const float b0       = 1.0f - closest_b1 - closest_b2;
+	const Vec3 geometric = unit_vector(cross(positions[i1] - positions[i0], positions[i2] - positions[i0]));
+
+	record.t          = closest_t;
+	record.p          = r.at(closest_t);
+	record.front_face = dot(direction, geometric) < 0.0f;
+
+	// The side comes from the geometric normal, the interpolated one only bends it
+	Vec3 normal = geometric;
+	if (!mesh.normals.empty()) {
+		const Vec3 shading = b0 * mesh.normals[i0] + closest_b1 * mesh.normals[i1] + closest_b2 * mesh.normals[i2];
+		if (shading.length2() > 0.0f) normal = unit_vector(dot(shading, geometric) < 0.0f ? -shading : shading);
+	}
+	record.normal = record.front_face ? normal : -normal;
+
+	if (!mesh.uvs.empty()) {
+		record.u = b0 * mesh.uvs[2 * i0] + closest_b1 * mesh.uvs[2 * i1] + closest_b2 * mesh.uvs[2 * i2];
+		record.v = b0 * mesh.uvs[2 * i0 + 1] + closest_b1 * mesh.uvs[2 * i1 + 1] + closest_b2 * mesh.uvs[2 * i2 + 1];
+	}
+
+	record.mat_ptr   = materials[mesh.materials.empty() ? 0 : mesh.materials[i]];
+	record.object    = this;
+	record.primitive = static_cast<int>(i);
+	return true;
+}
+
+Mesh_Data make_sphere_mesh(const Point3& center, const float radius, const int rings, const int segments)
+{
+	Mesh_Data mesh;
+
+	// A seam column of duplicated vertices, so u runs from 0 to 1 without wrapping. Seam and pole copies have to
+	// land on exactly the same points, or the mesh gets cracks as wide as sinf(2 pi) is far from zero.
+	for (int ring = 0; ring <= rings; ring++) {
+		const float theta     = pi * static_cast<float>(ring) / static_cast<float>(rings);
+		const bool pole       = ring == 0 || ring == rings;
+		const float sin_theta = pole ? 0.0f : sinf(theta);
+		const float cos_theta = pole ? (ring == 0 ? 1.0f : -1.0f) : cosf(theta);
+
+		for (int segment = 0; segment <= segments; segment++) {
+			const float phi    = 2.0f * pi * static_cast<float>(segment % segments) / static_cast<float>(segments);
+			const Vec3 outward = Vec3(sin_theta * cosf(phi), cos_theta, -sin_theta * sinf(phi));
+
+			mesh.positions.push_back(center + radius * outward);
+			mesh.normals.push_back(outward);
+			mesh.uvs.push_back(static_cast<float>(segment) / static_cast<float>(segments));
+			mesh.uvs.push_back(1.0f - static_cast<float>(ring) / static_cast<float>(rings));
+		}
+	}
+
+	const auto vertex = [segments](const int ring, const int segment) { return static_cast<uint32_t>(ring * (segments + 1) + segment); };
+
+	// Quads between neighbouring rings, the ones touching a pole lose their degenerate half
+	for (int ring = 0; ring < rings; ring++) {
+		for (int segment = 0; segment < segments; segment++) {
+			const uint32_t top_left     = vertex(ring, segment);
+			const uint32_t top_right    = vertex(ring, segment + 1);
+			const uint32_t bottom_left  = vertex(ring + 1, segment);
+			const uint32_t bottom_right = vertex(ring + 1, segment + 1);
+
+			if (ring > 0) mesh.indices.insert(mesh.indices.end(), {top_left, bottom_left, top_right});
+			if (ring < rings - 1) mesh.indices.insert(mesh.indices.end(), {top_right, bottom_left, bottom_right});
+		}
+	}
+	return mesh;
+}
@@ -0,0 +1,54 @@
+﻿// /*
+//  * triangle_mesh.h
+//  */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "bvh.h"
+#include "hittable.h"
+#include "hittables.h"
+#include "math/aabb.h"
+
+// Shared vertex buffers and 32-bit vertex indices, three per triangle. Normals and uvs are optional, when given
+// there is one per position and the same index picks all three.
+struct Mesh_Data {
+	std::vector<Point3> positions;
+	std::vector<Vec3> normals;       // Shading normals, the geometric normal is used when empty
+	std::vector<float> uvs;          // Two per vertex
+	std::vector<uint32_t> indices;   // Counter-clockwise seen from the front
+	std::vector<uint32_t> materials; // One material table index per triangle, or empty for the first material
+
+	size_t triangle_count() const { return indices.size() / 3; }
+};
+
+// Triangles behind one BVH. The triangles are stored in BVH leaf order, so leaves address contiguous ranges of the
+// index buffer and there's nothing per triangle beyond its indices (and material). Hits report the triangle's
+// index in that order in Hit_Record::primitive and its interpolated uv in Hit_Record::u and v.
+class Triangle_Mesh : public Hittable {
+public:
+	// Takes the buffers over, indices out of range are reported on stderr and leave the mesh empty
+	Triangle_Mesh(Mesh_Data mesh, std::vector<shared_ptr<Material>> materials);
+
+	bool hit(const Ray& r, float t_min, float t_max, Hit_Record& record) const override;
+
+	int primitive_count() const override { return static_cast<int>(mesh.triangle_count()); }
+
+	const Mesh_Data& data() const { return mesh; }
+	const Aabb& bounds() const { return box; }
+	const std::vector<shared_ptr<Material>>& material_table() const { return materials; }
+
+	// Buffers and BVH, what the mesh costs once built
+	size_t memory_bytes() const;
+
+private:
+	Mesh_Data mesh;
+	std::vector<Bvh_Node> nodes;
+	std::vector<shared_ptr<Material>> materials;
+	Aabb box;
+};
+
+// Latitude-longitude tessellated sphere with normals and uvs, for tests and benchmarks
+Mesh_Data make_sphere_mesh(const Point3& center, float radius, int rings, int segments);
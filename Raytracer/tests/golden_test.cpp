@@ -0,0 +1,226 @@
+﻿#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "aov.h"
+#include "builtin_scenes.h"
+#include "hdr_image.h"
+#include "renderer.h"
+#include "scene_file.h"
+#include "tonemap.h"
+#include "math/numeric.h"
+
+// Golden-image regression test. Each scene is rendered small, at a fixed sample count and seed, and checked
+// against three stored images:
+//
+//   <scene>.golden.bmp      The same render as the test makes, 8-bit. A bitwise match is reported but not
+//                           required: a faster intersection routine or a sampler that draws its random numbers
+//                           in another order changes the noise without changing what the image converges to.
+//   <scene>.reference.pfm   A converged linear render of the scene (reference_spp samples, another seed).
+//   <scene>.variance.pfm    The per-pixel sample variance of that render.
+//
+// The test passes when the render is as close to the reference as the golden render is (bitmap_image::psnr,
+// with a small margin), and the per-pixel differences are what the Monte Carlo noise explains: every channel's
+// difference is divided by its standard error from the variance AOV, few pixels may land beyond outlier_z and
+// the image-wide sum of differences must stay within bias_z standard errors, which catches small systematic
+// shifts that no single pixel would show.
+//
+// raytracer_golden_test --golden-dir DIR --update rewrites the stored images after an intended change.
+
+static constexpr int width         = 72;
+static constexpr int height        = 48;
+static constexpr int test_spp      = 64;
+static constexpr int reference_spp = 4096;
+static constexpr int max_depth     = 6;
+
+static constexpr double psnr_margin_db = 1.0;   // Below the golden render's PSNR against the reference
+static constexpr double outlier_z      = 5.0;
+static constexpr double max_outliers   = 0.005; // Fraction of channels, allows for the heavy tails of path tracing
+static constexpr double bias_z         = 5.0;
+static constexpr double min_std_error  = 1e-3;  // Floor for pixels whose samples all agree
+
+struct Golden_Scene {
+	std::string name;
+	std::function<Scene_Description()> build;
+};
+
+static const std::vector<Golden_Scene> golden_scenes = {
+	{"five_spheres", []() { return default_scene(); }},
+	{"small_lights", []() { return small_lights_scene(); }},
+	{"random_scene", []() { return random_scene(); }},
+};
+
+static Render_Settings golden_settings(const int samples_per_pixel, const uint64_t seed)
+{
+	Render_Settings settings;
+	settings.width             = width;
+	settings.height            = height;
+	settings.samples_per_pixel = samples_per_pixel;
+	settings.max_depth         = max_depth;
+	settings.seed              = seed;
+	return settings;
+}
+
+// The scene is generated from a fixed seed, so every render of it sees the same spheres
+static bool render_scene(const Golden_Scene& golden, const Render_Settings& settings, Aov_Buffers& framebuffer)
+{
+	seed_random(1);
+	const Scene_Description description = golden.build();
+
+	Scene world = build_scene(description);
+	world.build();
+	const Camera camera = build_camera(description.camera, static_cast<float>(width) / static_cast<float>(height));
+
+	return Renderer(settings).render(world, camera, framebuffer);
+}
+
+static bitmap_image to_bitmap(const Hdr_Image& image)
+{
+	const Tone_Mapper tone_mapper;
+	bitmap_image bitmap(image.width, image.height);
+	for (int y = 0; y < image.height; y++) {
+		tone_mapper.resolve_bgr(&image.at(0, y), bitmap.row(y), image.width);
+	}
+	return bitmap;
+}
+
+static bool update_golden(const Golden_Scene& golden, const std::string& prefix)
+{
+	Aov_Buffers test(width, height);
+	Aov_Buffers reference(width, height, {Aov::Variance});
+	if (!render_scene(golden, golden_settings(test_spp, 1), test)) return false;
+	if (!render_scene(golden, golden_settings(reference_spp, 2), reference)) return false;
+
+	if (!save_bitmap(prefix + ".golden.bmp", to_bitmap(test[Aov::Beauty]))) return false;
+	if (!save_pfm(prefix + ".reference.pfm", reference[Aov::Beauty])) return false;
+	if (!save_pfm(prefix + ".variance.pfm", reference[Aov::Variance])) return false;
+
+	std::cout << golden.name << ": wrote " << prefix << ".golden.bmp, .reference.pfm and .variance.pfm\n";
+	return true;
+}
+
+static bool check_golden(const Golden_Scene& golden, const std::string& prefix, const std::string& output_dir)
+{
+	const bitmap_image golden_bitmap(prefix + ".golden.bmp");
+	Hdr_Image reference;
+	Hdr_Image reference_variance;
+	if (golden_bitmap.width() != width || golden_bitmap.height() != height || !load_pfm(prefix + ".reference.pfm", reference) ||
+		reference.width != width || reference.height != height || !load_pfm(prefix + ".variance.pfm", reference_variance) ||
+		reference_variance.width != width || reference_variance.height != height) {
+		std::cerr << golden.name << ": missing or mismatched golden images under " << prefix << ", run with --update\n";
+		return false;
+	}
+
+	Aov_Buffers test(width, height, {Aov::Variance});
+	if (!render_scene(golden, golden_settings(test_spp, 1), test)) return false;
+
+	const Hdr_Image& beauty   = test[Aov::Beauty];
+	const Hdr_Image& variance = test[Aov::Variance];
+	bitmap_image test_bitmap  = to_bitmap(beauty);
+
+	// Exact
+	int differing = 0;
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			differing += memcmp(test_bitmap.row(y) + 3 * x, golden_bitmap.row(y) + 3 * x, 3) != 0 ? 1 : 0;
+		}
+	}
+
+	// PSNR against the converged reference, relative to the golden render's
+	bitmap_image reference_bitmap = to_bitmap(reference);
+	const double test_psnr        = test_bitmap.psnr(reference_bitmap);
+	const double golden_psnr      = bitmap_image(golden_bitmap).psnr(reference_bitmap);
+
+	// Per-pixel standard scores, the reference's own noise included. 64 samples can miss a small light every time
+	// and report no variance at all, so the reference's far steadier estimate is used where it is larger
+	int outliers       = 0;
+	double bias_sum[3] = {};
+	double bias_var[3] = {};
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			for (int c = 0; c < 3; c++) {
+				const double value    = beauty.at(x, y)[c];
+				const double expected = reference.at(x, y)[c];
+				const double var      = std::max(variance.at(x, y)[c], reference_variance.at(x, y)[c]);
+				const double se2      = var / test_spp + var / reference_spp + min_std_error * min_std_error;
+
+				if (std::fabs(value - expected) > outlier_z * std::sqrt(se2)) outliers++;
+				bias_sum[c] += value - expected;
+				bias_var[c] += se2;
+			}
+		}
+	}
+
+	const double outlier_fraction = static_cast<double>(outliers) / (3.0 * width * height);
+	double worst_bias             = 0.0;
+	for (int c = 0; c < 3; c++) {
+		worst_bias = std::max(worst_bias, std::fabs(bias_sum[c]) / std::sqrt(bias_var[c]));
+	}
+
+	const bool psnr_ok    = test_psnr >= golden_psnr - psnr_margin_db;
+	const bool outlier_ok = outlier_fraction <= max_outliers;
+	const bool bias_ok    = worst_bias <= bias_z;
+
+	std::cout << golden.name << ": " << (differing == 0 ? "bitwise identical to the golden render" : std::to_string(differing) + " of " +
+		std::to_string(width * height) + " pixels differ from the golden render") << '\n'
+		<< "  PSNR vs reference " << test_psnr << " dB (golden " << golden_psnr << " dB)" << (psnr_ok ? "" : "  FAIL") << '\n'
+		<< "  |z| > " << outlier_z << " in " << 100.0 * outlier_fraction << "% of channels (max " << 100.0 * max_outliers << "%)"
+		<< (outlier_ok ? "" : "  FAIL") << '\n'
+		<< "  image-wide bias " << worst_bias << " standard errors (max " << bias_z << ")" << (bias_ok ? "" : "  FAIL") << '\n';
+
+	if (psnr_ok && outlier_ok && bias_ok) return true;
+
+	// Leave the failing render for a look
+	const std::string failed = output_dir + "/" + golden.name + ".failed";
+	std::cerr << golden.name << ": failed";
+	if (save_bitmap(failed + ".bmp", test_bitmap) && save_pfm(failed + ".pfm", beauty)) {
+		std::cerr << ", render written to " << failed << ".bmp/.pfm";
+	}
+	std::cerr << '\n';
+	return false;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string golden_dir;
+	std::string output_dir = ".";
+	std::string scene;
+	bool update = false;
+
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+
+		if (arg == "--update") update = true;
+		else if (arg == "--golden-dir" && i + 1 < argc) golden_dir = argv[++i];
+		else if (arg == "--output-dir" && i + 1 < argc) output_dir = argv[++i];
+		else if (arg == "--scene" && i + 1 < argc) scene = argv[++i];
+		else {
+			golden_dir.clear();
+			break;
+		}
+	}
+	if (golden_dir.empty()) {
+		std::cerr << "Usage: " << argv[0] << " --golden-dir DIR [--scene NAME] [--output-dir DIR] [--update]\n";
+		return 2;
+	}
+
+	int failures = 0;
+	int checked  = 0;
+	for (const auto& golden : golden_scenes) {
+		if (!scene.empty() && golden.name != scene) continue;
+		checked++;
+
+		const std::string prefix = golden_dir + "/" + golden.name;
+		if (!(update ? update_golden(golden, prefix) : check_golden(golden, prefix, output_dir))) failures++;
+	}
+
+	if (checked == 0) {
+		std::cerr << "main() - Error: no golden scene named " << scene << '\n';
+		return 2;
+	}
+	return failures == 0 ? 0 : 1;
+}